@@ -0,0 +1,194 @@
+/* @@@LICENSE
+*
+* Copyright (c) 2026 LuneOS Project
+*
+* This file is part of location-service.
+*
+* location-service is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* location-service is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with location-service.  If not, see <http://www.gnu.org/licenses/>.
+*
+* LICENSE@@@ */
+
+
+#include "location_admission.h"
+
+/* Apps with a full bucket and nothing queued are forgotten once there are
+ * more than this many */
+#define ADMISSION_MAX_IDLE_APPS	64
+
+struct admission_app {
+	char *app_id;
+	double tokens;
+	gint64 refilled;
+	GQueue pending;
+	bool scheduled;
+};
+
+/* Requests beyond the in-flight limit wait in a queue per app. Apps with
+ * waiting requests take turns, so a single app flooding the service can't
+ * starve the others. */
+struct location_admission {
+	GHashTable *apps;
+	GQueue schedule;
+	guint in_flight;
+};
+
+static void admission_app_free(struct admission_app *app)
+{
+	g_free(app->app_id);
+	g_free(app);
+}
+
+struct location_admission *location_admission_new(void)
+{
+	struct location_admission *admission;
+
+	admission = g_new0(struct location_admission, 1);
+	admission->apps = g_hash_table_new_full(g_str_hash, g_str_equal, NULL,
+	                                        (GDestroyNotify) admission_app_free);
+	g_queue_init(&admission->schedule);
+
+	return admission;
+}
+
+void location_admission_free(struct location_admission *admission, GDestroyNotify free_item)
+{
+	struct admission_app *app;
+	gpointer item;
+
+	if (!admission)
+		return;
+
+	while ((app = g_queue_pop_head(&admission->schedule))) {
+		while ((item = g_queue_pop_head(&app->pending)))
+			free_item(item);
+	}
+
+	g_hash_table_destroy(admission->apps);
+	g_free(admission);
+}
+
+static void refill(struct admission_app *app)
+{
+	gint64 now = g_get_monotonic_time();
+
+	app->tokens += (now - app->refilled) /
+		(double) (LOCATION_ADMISSION_REFILL_INTERVAL * G_USEC_PER_SEC);
+	if (app->tokens > LOCATION_ADMISSION_BURST)
+		app->tokens = LOCATION_ADMISSION_BURST;
+	app->refilled = now;
+}
+
+static gboolean app_is_idle(gpointer key, gpointer value, gpointer user_data)
+{
+	struct admission_app *app = value;
+
+	refill(app);
+	return !app->scheduled && app->tokens >= LOCATION_ADMISSION_BURST;
+}
+
+static struct admission_app *lookup_app(struct location_admission *admission, const char *app_id)
+{
+	struct admission_app *app;
+
+	app = g_hash_table_lookup(admission->apps, app_id);
+	if (app)
+		return app;
+
+	if (g_hash_table_size(admission->apps) >= ADMISSION_MAX_IDLE_APPS)
+		g_hash_table_foreach_remove(admission->apps, app_is_idle, NULL);
+
+	app = g_new0(struct admission_app, 1);
+	app->app_id = g_strdup(app_id);
+	app->tokens = LOCATION_ADMISSION_BURST;
+	app->refilled = g_get_monotonic_time();
+	g_queue_init(&app->pending);
+	g_hash_table_insert(admission->apps, app->app_id, app);
+
+	return app;
+}
+
+/* Decides whether the request item of app_id may run now, has to wait for
+ * location_admission_finish() to hand it out or is over the app's limit */
+LocationAdmission location_admission_request(struct location_admission *admission, const char *app_id,
+                                             gpointer item)
+{
+	struct admission_app *app;
+
+	app = lookup_app(admission, app_id ? app_id : "");
+	refill(app);
+
+	if (app->tokens < 1 || g_queue_get_length(&app->pending) >= LOCATION_ADMISSION_MAX_QUEUED)
+		return LOCATION_ADMISSION_REJECTED;
+	app->tokens -= 1;
+
+	if (admission->in_flight < LOCATION_ADMISSION_MAX_IN_FLIGHT) {
+		admission->in_flight++;
+		return LOCATION_ADMISSION_RUN;
+	}
+
+	g_queue_push_tail(&app->pending, item);
+	if (!app->scheduled) {
+		g_queue_push_tail(&admission->schedule, app);
+		app->scheduled = true;
+	}
+
+	return LOCATION_ADMISSION_QUEUED;
+}
+
+/* A running request finished. Returns the next queued request, which now
+ * counts as running, or NULL. */
+gpointer location_admission_finish(struct location_admission *admission)
+{
+	struct admission_app *app;
+	gpointer item;
+
+	if (admission->in_flight > 0)
+		admission->in_flight--;
+
+	app = g_queue_pop_head(&admission->schedule);
+	if (!app)
+		return NULL;
+
+	item = g_queue_pop_head(&app->pending);
+	if (g_queue_is_empty(&app->pending))
+		app->scheduled = false;
+	else
+		g_queue_push_tail(&admission->schedule, app);
+
+	admission->in_flight++;
+	return item;
+}
+
+/* Drops a queued request, e.g. because its caller went away */
+bool location_admission_remove(struct location_admission *admission, gpointer item)
+{
+	GList *iter;
+	struct admission_app *app;
+
+	for (iter = admission->schedule.head; iter; iter = iter->next) {
+		app = iter->data;
+		if (!g_queue_remove(&app->pending, item))
+			continue;
+
+		if (g_queue_is_empty(&app->pending)) {
+			g_queue_delete_link(&admission->schedule, iter);
+			app->scheduled = false;
+		}
+		return true;
+	}
+
+	return false;
+}
+
+// vim:ts=4:sw=4:noexpandtab
@@ -0,0 +1,56 @@
+/* @@@LICENSE
+*
+* Copyright (c) 2026 LuneOS Project
+*
+* This file is part of location-service.
+*
+* location-service is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* location-service is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with location-service.  If not, see <http://www.gnu.org/licenses/>.
+*
+* LICENSE@@@ */
+
+
+#ifndef LOCATION_ADMISSION_H_
+#define LOCATION_ADMISSION_H_
+
+#include <stdbool.h>
+#include <glib.h>
+
+/* One-shot requests which may run at the same time */
+#define LOCATION_ADMISSION_MAX_IN_FLIGHT	4
+/* Every app may start this many requests at once and gets a new one every
+ * LOCATION_ADMISSION_REFILL_INTERVAL seconds */
+#define LOCATION_ADMISSION_BURST			5
+#define LOCATION_ADMISSION_REFILL_INTERVAL	2
+/* Requests of a single app waiting for a free slot */
+#define LOCATION_ADMISSION_MAX_QUEUED		4
+
+typedef enum {
+	LOCATION_ADMISSION_RUN,
+	LOCATION_ADMISSION_QUEUED,
+	LOCATION_ADMISSION_REJECTED,
+} LocationAdmission;
+
+struct location_admission;
+
+struct location_admission *location_admission_new(void);
+void location_admission_free(struct location_admission *admission, GDestroyNotify free_item);
+
+LocationAdmission location_admission_request(struct location_admission *admission, const char *app_id,
+                                             gpointer item);
+gpointer location_admission_finish(struct location_admission *admission);
+bool location_admission_remove(struct location_admission *admission, gpointer item);
+
+#endif
+
+// vim:ts=4:sw=4:noexpandtab
@@ -0,0 +1,223 @@
+/* @@@LICENSE
+*
+* Copyright (c) 2026 LuneOS Project
+*
+* This file is part of location-service.
+*
+* location-service is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* location-service is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with location-service.  If not, see <http://www.gnu.org/licenses/>.
+*
+* LICENSE@@@ */
+
+#include "location_cache.h"
+#include "location_state.h"
+
+#define LOCATION_CACHE_FILE	"last-fix"
+#define LOCATION_CACHE_LEVELS	(GCLUE_ACCURACY_LEVEL_EXACT + 1)
+
+struct location_cache {
+	struct location_fix fixes[LOCATION_CACHE_LEVELS];
+	bool valid[LOCATION_CACHE_LEVELS];
+	bool dirty;
+	bool persistent;
+	gint64 last_save;
+	guint save_timeout;
+};
+
+static bool level_is_valid(GClueAccuracyLevel level)
+{
+	return level > 0 && level < LOCATION_CACHE_LEVELS;
+}
+
+static void cache_load(struct location_cache *cache)
+{
+	GKeyFile *keyfile;
+	gchar group[16];
+	int level;
+
+	keyfile = location_state_load(LOCATION_CACHE_FILE);
+
+	for (level = 1; level < LOCATION_CACHE_LEVELS; level++) {
+		struct location_fix *fix = &cache->fixes[level];
+
+		g_snprintf(group, sizeof(group), "level-%d", level);
+		if (!g_key_file_has_group(keyfile, group))
+			continue;
+
+		fix->latitude = g_key_file_get_double(keyfile, group, "latitude", NULL);
+		fix->longitude = g_key_file_get_double(keyfile, group, "longitude", NULL);
+		fix->altitude = g_key_file_get_double(keyfile, group, "altitude", NULL);
+		fix->horiz_accuracy = g_key_file_get_double(keyfile, group, "horizAccuracy", NULL);
+		fix->vert_accuracy = g_key_file_get_double(keyfile, group, "vertAccuracy", NULL);
+		fix->heading = g_key_file_get_double(keyfile, group, "heading", NULL);
+		fix->velocity = g_key_file_get_double(keyfile, group, "velocity", NULL);
+		fix->timestamp = g_key_file_get_double(keyfile, group, "timestamp", NULL);
+		cache->valid[level] = fix->timestamp > 0;
+	}
+
+	g_key_file_free(keyfile);
+}
+
+static void cache_save(struct location_cache *cache)
+{
+	GKeyFile *keyfile;
+	gchar group[16];
+	int level;
+
+	keyfile = g_key_file_new();
+
+	for (level = 1; level < LOCATION_CACHE_LEVELS; level++) {
+		const struct location_fix *fix = &cache->fixes[level];
+
+		if (!cache->valid[level])
+			continue;
+
+		g_snprintf(group, sizeof(group), "level-%d", level);
+		g_key_file_set_double(keyfile, group, "latitude", fix->latitude);
+		g_key_file_set_double(keyfile, group, "longitude", fix->longitude);
+		g_key_file_set_double(keyfile, group, "altitude", fix->altitude);
+		g_key_file_set_double(keyfile, group, "horizAccuracy", fix->horiz_accuracy);
+		g_key_file_set_double(keyfile, group, "vertAccuracy", fix->vert_accuracy);
+		g_key_file_set_double(keyfile, group, "heading", fix->heading);
+		g_key_file_set_double(keyfile, group, "velocity", fix->velocity);
+		g_key_file_set_double(keyfile, group, "timestamp", fix->timestamp);
+	}
+
+	if (location_state_save(LOCATION_CACHE_FILE, keyfile))
+		cache->dirty = false;
+	cache->last_save = g_get_monotonic_time();
+
+	g_key_file_free(keyfile);
+}
+
+static gboolean cache_save_timeout_cb(gpointer user_data)
+{
+	struct location_cache *cache = user_data;
+
+	cache->save_timeout = 0;
+	cache_save(cache);
+
+	return FALSE;
+}
+
+struct location_cache *location_cache_new(bool persistent)
+{
+	struct location_cache *cache;
+
+	cache = g_new0(struct location_cache, 1);
+	cache->persistent = persistent;
+	if (persistent)
+		cache_load(cache);
+
+	return cache;
+}
+
+void location_cache_free(struct location_cache *cache)
+{
+	if (!cache)
+		return;
+
+	location_cache_flush(cache);
+	g_free(cache);
+}
+
+void location_cache_flush(struct location_cache *cache)
+{
+	if (cache->save_timeout) {
+		g_source_remove(cache->save_timeout);
+		cache->save_timeout = 0;
+	}
+
+	if (cache->dirty)
+		cache_save(cache);
+}
+
+void location_cache_update(struct location_cache *cache, GClueAccuracyLevel level, const struct location_fix *fix)
+{
+	gint64 elapsed;
+	guint delay;
+
+	if (!level_is_valid(level))
+		return;
+
+	cache->fixes[level] = *fix;
+	cache->valid[level] = true;
+	if (!cache->persistent)
+		return;
+
+	cache->dirty = true;
+
+	/* Every fix updates memory, but the state file is rewritten at most
+	 * once per LOCATION_CACHE_SAVE_INTERVAL */
+	if (cache->save_timeout)
+		return;
+
+	elapsed = (g_get_monotonic_time() - cache->last_save) / G_USEC_PER_SEC;
+	if (cache->last_save == 0 || elapsed >= LOCATION_CACHE_SAVE_INTERVAL)
+		delay = 1;
+	else
+		delay = LOCATION_CACHE_SAVE_INTERVAL - elapsed;
+
+	cache->save_timeout = g_timeout_add_seconds(delay, cache_save_timeout_cb, cache);
+}
+
+const struct location_fix *location_cache_lookup(struct location_cache *cache, GClueAccuracyLevel level, double max_age)
+{
+	const struct location_fix *fix;
+	double age;
+
+	if (!level_is_valid(level) || !cache->valid[level])
+		return NULL;
+
+	fix = &cache->fixes[level];
+	age = g_get_real_time() / (double) G_USEC_PER_SEC - fix->timestamp;
+	if (age < 0 || age > max_age)
+		return NULL;
+
+	return fix;
+}
+
+/* The most recent fix of any level, NULL when there is none */
+const struct location_fix *location_cache_latest(struct location_cache *cache)
+{
+	const struct location_fix *latest = NULL;
+	int level;
+
+	for (level = 1; level < LOCATION_CACHE_LEVELS; level++) {
+		if (cache->valid[level] &&
+			(!latest || cache->fixes[level].timestamp > latest->timestamp))
+			latest = &cache->fixes[level];
+	}
+
+	return latest;
+}
+
+/* The most recent fix which satisfies the level, see
+ * location_fix_satisfies(), and is at most max_age seconds old, NULL when
+ * there is none */
+const struct location_fix *location_cache_best(struct location_cache *cache, GClueAccuracyLevel level, double max_age)
+{
+	const struct location_fix *best = NULL, *fix;
+	int n;
+
+	for (n = 1; n < LOCATION_CACHE_LEVELS; n++) {
+		fix = location_cache_lookup(cache, n, max_age);
+		if (fix && location_fix_satisfies(fix, n, level) &&
+			(!best || fix->timestamp > best->timestamp))
+			best = fix;
+	}
+
+	return best;
+}
+
+// vim:ts=4:sw=4:noexpandtab
@@ -0,0 +1,44 @@
+/* @@@LICENSE
+*
+* Copyright (c) 2026 LuneOS Project
+*
+* This file is part of location-service.
+*
+* location-service is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* location-service is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with location-service.  If not, see <http://www.gnu.org/licenses/>.
+*
+* LICENSE@@@ */
+
+#ifndef LOCATION_CACHE_H_
+#define LOCATION_CACHE_H_
+
+#include "location_common.h"
+
+/* Minimum number of seconds between two writes of the state file */
+#define LOCATION_CACHE_SAVE_INTERVAL	30
+
+struct location_cache;
+
+/* A cache which isn't persistent starts empty and never touches the state
+ * file */
+struct location_cache *location_cache_new(bool persistent);
+void location_cache_free(struct location_cache *cache);
+void location_cache_update(struct location_cache *cache, GClueAccuracyLevel level, const struct location_fix *fix);
+const struct location_fix *location_cache_lookup(struct location_cache *cache, GClueAccuracyLevel level, double max_age);
+const struct location_fix *location_cache_latest(struct location_cache *cache);
+const struct location_fix *location_cache_best(struct location_cache *cache, GClueAccuracyLevel level, double max_age);
+void location_cache_flush(struct location_cache *cache);
+
+#endif
+
+// vim:ts=4:sw=4:noexpandtab
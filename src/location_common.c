@@ -19,35 +19,196 @@
 *
 * LICENSE@@@ */
 
+#include <math.h>
+
 #include "location_common.h"
 
-void location_to_reply(GDBusProxy *location, jvalue_ref *reply_obj)
+/* Meters per degree of latitude */
+#define METERS_PER_DEGREE	111320.0
+
+/* Horizontal accuracy in meters a fix needs to count as being of a level */
+double location_accuracy_bound(GClueAccuracyLevel level)
+{
+	switch (level) {
+	case GCLUE_ACCURACY_LEVEL_COUNTRY:
+		return 300000;
+	case GCLUE_ACCURACY_LEVEL_CITY:
+		return 15000;
+	case GCLUE_ACCURACY_LEVEL_NEIGHBORHOOD:
+		return 1000;
+	case GCLUE_ACCURACY_LEVEL_STREET:
+		return 100;
+	default:
+		return 20;
+	}
+}
+
+bool location_fix_satisfies(const struct location_fix *fix, GClueAccuracyLevel fix_level, GClueAccuracyLevel level)
+{
+	if (fix->horiz_accuracy > 0)
+		return fix->horiz_accuracy <= location_accuracy_bound(level);
+
+	return fix_level >= level;
+}
+
+/* Snaps the position to a grid as coarse as the level and drops what would
+ * give away more, for callers which must not learn more than they asked
+ * for */
+void location_fix_reduce_precision(struct location_fix *fix, GClueAccuracyLevel level)
+{
+	double bound, step;
+
+	if (level >= GCLUE_ACCURACY_LEVEL_EXACT)
+		return;
+
+	bound = location_accuracy_bound(level);
+	step = bound / METERS_PER_DEGREE;
+	fix->latitude = CLAMP(round(fix->latitude / step) * step, -90, 90);
+
+	step /= MAX(cos(fix->latitude * M_PI / 180), 0.01);
+	fix->longitude = round(fix->longitude / step) * step;
+	if (fix->longitude > 180)
+		fix->longitude -= 360;
+	else if (fix->longitude < -180)
+		fix->longitude += 360;
+
+	fix->horiz_accuracy = MAX(fix->horiz_accuracy, bound);
+	fix->altitude = -1;
+	fix->vert_accuracy = -1;
+	fix->heading = -1;
+	fix->velocity = -1;
+}
+
+static void get_double(GVariant *value, double *field)
 {
+	if (g_variant_is_of_type(value, G_VARIANT_TYPE_DOUBLE))
+		*field = g_variant_get_double(value);
+}
+
+/* Decodes the properties of a GeoClue2 Location object, the a{sv} returned
+ * by org.freedesktop.DBus.Properties.GetAll, in a single pass. Older
+ * GeoClue versions have no Speed, Heading or Timestamp; their fixes get the
+ * time they were decoded at. */
+void location_fix_from_properties(GVariant *properties, struct location_fix *fix)
+{
+	GVariantIter iter;
+	const gchar *key;
 	GVariant *value;
-	gdouble latitude, longitude, accuracy, altitude;
-
-	value = g_dbus_proxy_get_cached_property (location, "Latitude");
-	latitude = g_variant_get_double (value);
-	g_variant_unref(value);
-	value = g_dbus_proxy_get_cached_property (location, "Longitude");
-	longitude = g_variant_get_double (value);
-	g_variant_unref(value);
-	value = g_dbus_proxy_get_cached_property (location, "Accuracy");
-	accuracy = g_variant_get_double (value);
-	g_variant_unref(value);
-        value = g_dbus_proxy_get_cached_property (location, "Altitude");
-        altitude = g_variant_get_double (value);
-	g_variant_unref(value);
-        if (altitude == -G_MAXDOUBLE) altitude = -1;
+	guint64 seconds, microseconds;
+
+	fix->latitude = 0;
+	fix->longitude = 0;
+	fix->altitude = -1;
+	fix->horiz_accuracy = -1;
+	fix->vert_accuracy = -1;
+	fix->heading = -1;
+	fix->velocity = -1;
+	fix->timestamp = -1;
+	fix->description = NULL;
 
+	g_variant_iter_init(&iter, properties);
+	while (g_variant_iter_loop(&iter, "{&sv}", &key, &value)) {
+		if (!g_strcmp0(key, "Latitude"))
+			get_double(value, &fix->latitude);
+		else if (!g_strcmp0(key, "Longitude"))
+			get_double(value, &fix->longitude);
+		else if (!g_strcmp0(key, "Accuracy"))
+			get_double(value, &fix->horiz_accuracy);
+		else if (!g_strcmp0(key, "Altitude"))
+			get_double(value, &fix->altitude);
+		else if (!g_strcmp0(key, "Speed"))
+			get_double(value, &fix->velocity);
+		else if (!g_strcmp0(key, "Heading"))
+			get_double(value, &fix->heading);
+		else if (!g_strcmp0(key, "Timestamp") && g_variant_is_of_type(value, G_VARIANT_TYPE("(tt)"))) {
+			g_variant_get(value, "(tt)", &seconds, &microseconds);
+			if (seconds > 0)
+				fix->timestamp = seconds + microseconds / (double) G_USEC_PER_SEC;
+		}
+		else if (!g_strcmp0(key, "Description") && g_variant_is_of_type(value, G_VARIANT_TYPE_STRING)) {
+			if (*g_variant_get_string(value, NULL))
+				fix->description = g_intern_string(g_variant_get_string(value, NULL));
+		}
+	}
+
+	/* GeoClue marks unknown values with -G_MAXDOUBLE or negative ones */
+	if (fix->altitude == -G_MAXDOUBLE)
+		fix->altitude = -1;
+	if (fix->velocity < 0)
+		fix->velocity = -1;
+	if (fix->heading < 0)
+		fix->heading = -1;
+	if (fix->timestamp < 0)
+		fix->timestamp = g_get_real_time() / (double) G_USEC_PER_SEC;
+}
+
+static double reply_get_double(jvalue_ref reply_obj, const char *name)
+{
+	jvalue_ref value_obj = NULL;
+	double value = -1;
+
+	if (jobject_get_exists(reply_obj, j_cstr_to_buffer(name), &value_obj) &&
+		jis_number(value_obj))
+		jnumber_get_f64(value_obj, &value);
+
+	return value;
+}
+
+bool location_fix_from_reply(jvalue_ref reply_obj, struct location_fix *fix)
+{
+	jvalue_ref value_obj = NULL;
+	int32_t error_code = -1;
+
+	if (!jobject_get_exists(reply_obj, J_CSTR_TO_BUF("errorCode"), &value_obj) ||
+		!jis_number(value_obj))
+		return false;
+	jnumber_get_i32(value_obj, &error_code);
+	if (error_code != 0)
+		return false;
+
+	if (!jobject_get_exists(reply_obj, J_CSTR_TO_BUF("latitude"), &value_obj) ||
+		!jobject_get_exists(reply_obj, J_CSTR_TO_BUF("longitude"), &value_obj))
+		return false;
+
+	fix->latitude = reply_get_double(reply_obj, "latitude");
+	fix->longitude = reply_get_double(reply_obj, "longitude");
+	fix->altitude = reply_get_double(reply_obj, "altitude");
+	fix->horiz_accuracy = reply_get_double(reply_obj, "horizAccuracy");
+	fix->vert_accuracy = reply_get_double(reply_obj, "vertAccuracy");
+	fix->heading = reply_get_double(reply_obj, "heading");
+	fix->velocity = reply_get_double(reply_obj, "velocity");
+	fix->timestamp = reply_get_double(reply_obj, "timestamp");
+	fix->description = NULL;
+	if (jobject_get_exists(reply_obj, J_CSTR_TO_BUF("description"), &value_obj) &&
+		jis_string(value_obj)) {
+		raw_buffer buffer = jstring_get_fast(value_obj);
+		gchar *description = g_strndup(buffer.m_str, buffer.m_len);
+
+		fix->description = g_intern_string(description);
+		g_free(description);
+	}
+
+	return true;
+}
+
+/* Only the fields of the fix, for fixes within a larger reply */
+void location_fix_to_json(const struct location_fix *fix, jvalue_ref fix_obj)
+{
+	jobject_put(fix_obj, J_CSTR_TO_JVAL("altitude"), jnumber_create_f64(fix->altitude));
+	jobject_put(fix_obj, J_CSTR_TO_JVAL("heading"), jnumber_create_f64(fix->heading));
+	jobject_put(fix_obj, J_CSTR_TO_JVAL("horizAccuracy"), jnumber_create_f64(fix->horiz_accuracy));
+	jobject_put(fix_obj, J_CSTR_TO_JVAL("latitude"), jnumber_create_f64(fix->latitude));
+	jobject_put(fix_obj, J_CSTR_TO_JVAL("longitude"), jnumber_create_f64(fix->longitude));
+	jobject_put(fix_obj, J_CSTR_TO_JVAL("timestamp"), jnumber_create_f64(fix->timestamp));
+	jobject_put(fix_obj, J_CSTR_TO_JVAL("velocity"), jnumber_create_f64(fix->velocity));
+	jobject_put(fix_obj, J_CSTR_TO_JVAL("vertAccuracy"), jnumber_create_f64(fix->vert_accuracy));
+	if (fix->description)
+		jobject_put(fix_obj, J_CSTR_TO_JVAL("description"), jstring_create(fix->description));
+}
+
+void location_fix_to_reply(const struct location_fix *fix, jvalue_ref *reply_obj)
+{
 	jobject_put(*reply_obj, J_CSTR_TO_JVAL("returnValue"), jboolean_create(true));
 	jobject_put(*reply_obj, J_CSTR_TO_JVAL("errorCode"), jnumber_create_i32(0));
-	jobject_put(*reply_obj, J_CSTR_TO_JVAL("altitude"), jnumber_create_f64(altitude));
-	jobject_put(*reply_obj, J_CSTR_TO_JVAL("heading"), jnumber_create_f64(-1));
-	jobject_put(*reply_obj, J_CSTR_TO_JVAL("horizAccuracy"), jnumber_create_f64(accuracy));
-	jobject_put(*reply_obj, J_CSTR_TO_JVAL("latitude"), jnumber_create_f64(latitude));
-	jobject_put(*reply_obj, J_CSTR_TO_JVAL("longitude"), jnumber_create_f64(longitude));
-	jobject_put(*reply_obj, J_CSTR_TO_JVAL("timestamp"), jnumber_create_f64(time(NULL)));
-	jobject_put(*reply_obj, J_CSTR_TO_JVAL("velocity"), jnumber_create_f64(-1));
-	jobject_put(*reply_obj, J_CSTR_TO_JVAL("vertAccuracy"), jnumber_create_f64(-1));
+	location_fix_to_json(fix, *reply_obj);
 }
@@ -22,6 +22,7 @@
 #ifndef LOCATION_COMMON_H_
 #define LOCATION_COMMON_H_
 
+#include <stdbool.h>
 #include <pbnjson.h>
 #include <glib/gi18n.h>
 #include <gio/gio.h>
@@ -34,6 +35,34 @@ typedef enum {
 	GCLUE_ACCURACY_LEVEL_EXACT = 8,
 } GClueAccuracyLevel;
 
-void location_to_reply(GDBusProxy *location, jvalue_ref *reply_obj);
+/* A single position fix with the same fields we send in a reply. Unknown
+ * values are -1, timestamp is in seconds since the epoch. Description names
+ * the source, e.g. GeoClue's "GPS" or "WiFi"; it is an interned string, so
+ * fixes can be copied freely, and NULL when unknown. Fixes are passed
+ * around as this struct and only turned into JSON when sent. */
+struct location_fix {
+	double latitude;
+	double longitude;
+	double altitude;
+	double horiz_accuracy;
+	double vert_accuracy;
+	double heading;
+	double velocity;
+	double timestamp;
+	const char *description;
+};
+
+/* A fix satisfies a request of a level when its horizontal accuracy is
+ * within what that level stands for. Only a fix of unknown accuracy is
+ * judged by its level, it satisfies requests of its own or any lower
+ * level. */
+double location_accuracy_bound(GClueAccuracyLevel level);
+bool location_fix_satisfies(const struct location_fix *fix, GClueAccuracyLevel fix_level, GClueAccuracyLevel level);
+void location_fix_reduce_precision(struct location_fix *fix, GClueAccuracyLevel level);
+
+void location_fix_from_properties(GVariant *properties, struct location_fix *fix);
+bool location_fix_from_reply(jvalue_ref reply_obj, struct location_fix *fix);
+void location_fix_to_json(const struct location_fix *fix, jvalue_ref fix_obj);
+void location_fix_to_reply(const struct location_fix *fix, jvalue_ref *reply_obj);
 
 #endif
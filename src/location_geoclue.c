@@ -0,0 +1,600 @@
+/* @@@LICENSE
+*
+* Copyright (c) 2026 LuneOS Project
+*
+* This file is part of location-service.
+*
+* location-service is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* location-service is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with location-service.  If not, see <http://www.gnu.org/licenses/>.
+*
+* LICENSE@@@ */
+
+
+#include <glib.h>
+#include <gio/gio.h>
+
+#include "location_geoclue.h"
+#include "location_service.h"
+
+#define GEOCLUE_NAME "org.freedesktop.GeoClue2"
+
+/* Delays in milliseconds between attempts to rebuild the client after
+ * GeoClue came back, doubled after every failed attempt */
+#define RECONNECT_INITIAL_DELAY 100
+#define RECONNECT_MAX_DELAY 30000
+
+enum geoclue_task_type {
+	GEOCLUE_TASK_START,
+	GEOCLUE_TASK_STOP,
+	GEOCLUE_TASK_SET_DEMAND,
+	GEOCLUE_TASK_QUIT,
+};
+
+struct location_geoclue_provider {
+	struct location_provider provider;
+	GThread *thread;
+	GMainContext *context;
+	GMainLoop *loop;
+
+	/* Only used from the main context. The generation is bumped on every
+	 * start and stop so results of an earlier session get dropped. */
+	struct location_service *service;
+	guint generation;
+
+	/* Only used from the worker thread. While active a session is wanted
+	 * and the client gets rebuilt whenever GeoClue reappears. */
+	GDBusProxy *manager;
+	GDBusProxy *client_props;
+	GDBusProxy *client;
+	struct location_demand demand;
+	guint worker_generation;
+	guint name_watch;
+	bool active;
+	GSource *reconnect_source;
+	guint reconnect_delay;
+	gint64 vanished_time;
+};
+
+struct geoclue_task {
+	struct location_geoclue_provider *geoclue;
+	enum geoclue_task_type type;
+	guint generation;
+	struct location_demand demand;
+};
+
+enum geoclue_result_type {
+	GEOCLUE_RESULT_STARTED,
+	GEOCLUE_RESULT_FIX,
+	GEOCLUE_RESULT_DEGRADED,
+	GEOCLUE_RESULT_RECOVERED,
+};
+
+/* Result handed from the worker thread to the main context */
+struct geoclue_result {
+	struct location_geoclue_provider *geoclue;
+	guint generation;
+	enum geoclue_result_type type;
+	bool success;
+	GClueAccuracyLevel level;
+	struct location_fix fix;
+};
+
+/* Not g_main_context_invoke(), that runs the callback right away when the
+ * calling thread can acquire the context, e.g. before the worker thread
+ * started or after the main loop finished */
+static void invoke_in_context(GMainContext *context, GSourceFunc func, gpointer data)
+{
+	GSource *source;
+
+	source = g_idle_source_new();
+	g_source_set_priority(source, G_PRIORITY_DEFAULT);
+	g_source_set_callback(source, func, data, g_free);
+	g_source_attach(source, context);
+	g_source_unref(source);
+}
+
+static gboolean result_cb(gpointer user_data)
+{
+	struct geoclue_result *result = user_data;
+	struct location_geoclue_provider *geoclue = result->geoclue;
+
+	if (result->generation != geoclue->generation || !geoclue->service)
+		return FALSE;
+
+	switch (result->type) {
+	case GEOCLUE_RESULT_STARTED:
+		location_service_provider_started(geoclue->service, result->success);
+		break;
+	case GEOCLUE_RESULT_FIX:
+		location_service_handle_fix(geoclue->service, result->level, &result->fix);
+		break;
+	case GEOCLUE_RESULT_DEGRADED:
+		location_service_provider_degraded(geoclue->service, true);
+		break;
+	case GEOCLUE_RESULT_RECOVERED:
+		location_service_provider_degraded(geoclue->service, false);
+		break;
+	}
+
+	return FALSE;
+}
+
+static void post_result(struct location_geoclue_provider *geoclue, struct geoclue_result *result)
+{
+	result->geoclue = geoclue;
+	result->generation = geoclue->worker_generation;
+	invoke_in_context(NULL, result_cb, result);
+}
+
+static void post_state(struct location_geoclue_provider *geoclue, enum geoclue_result_type type)
+{
+	struct geoclue_result *result;
+
+	result = g_new0(struct geoclue_result, 1);
+	result->type = type;
+	post_result(geoclue, result);
+}
+
+static bool set_client_property(GDBusProxy *client_props, const char *name, GVariant *value)
+{
+	GError *error = NULL;
+	GVariant *results = g_dbus_proxy_call_sync (client_props,
+	                   "Set",
+	                   g_variant_new ("(ssv)",
+	                                  "org.freedesktop.GeoClue2.Client",
+	                                  name,
+	                                  value),
+	                   G_DBUS_CALL_FLAGS_NONE,
+	                   -1,
+	                   NULL,
+	                   &error);
+
+	if (results == NULL) {
+		g_critical ("Failed to set GeoClue2 client property %s: %s", name, error->message);
+		g_error_free (error);
+		return false;
+	}
+	g_variant_unref (results);
+
+	return true;
+}
+
+static void
+on_client_signal (GDBusProxy *client,
+                  gchar      *sender_name,
+                  gchar      *signal_name,
+                  GVariant   *parameters,
+                  gpointer    user_data)
+{
+	struct location_geoclue_provider *geoclue = user_data;
+	struct geoclue_result *result;
+	char *location_path;
+
+	if (g_strcmp0 (signal_name, "LocationUpdated") != 0)
+		return;
+
+	g_assert (g_variant_n_children (parameters) > 1);
+	g_variant_get_child (parameters, 1, "&o", &location_path);
+	GError *error = NULL;
+
+	/* One round trip for all properties instead of a proxy per update */
+	GVariant *properties = g_dbus_connection_call_sync (g_dbus_proxy_get_connection (client),
+	                          "org.freedesktop.GeoClue2",
+	                          location_path,
+	                          "org.freedesktop.DBus.Properties",
+	                          "GetAll",
+	                          g_variant_new ("(s)", "org.freedesktop.GeoClue2.Location"),
+	                          G_VARIANT_TYPE ("(a{sv})"),
+	                          G_DBUS_CALL_FLAGS_NONE,
+	                          -1,
+	                          NULL,
+	                          &error);
+	if (properties == NULL) {
+		g_critical ("Failed to get GeoClue2 location: %s", error->message);
+		g_error_free(error);
+		return;
+	}
+
+	GVariant *dict = g_variant_get_child_value (properties, 0);
+	result = g_new0(struct geoclue_result, 1);
+	result->type = GEOCLUE_RESULT_FIX;
+	result->level = geoclue->demand.level;
+	location_fix_from_properties(dict, &result->fix);
+	g_variant_unref (dict);
+	g_variant_unref (properties);
+
+	post_result(geoclue, result);
+}
+
+/* Without stop the client is dropped without telling GeoClue, which is
+ * what we want once GeoClue is gone and calls would only time out */
+static void release_client(struct location_geoclue_provider *geoclue, bool stop)
+{
+	if (geoclue->client && stop) {
+		GError *error = NULL;
+		GVariant *results = g_dbus_proxy_call_sync(geoclue->client,
+		                   "Stop",
+		                   NULL,
+		                   G_DBUS_CALL_FLAGS_NONE,
+		                   -1,
+		                   NULL,
+		                   &error);
+		if (results == NULL) {
+			g_critical("Failed to stop GeoClue2 client: %s", error->message);
+			g_error_free(error);
+		}
+		else
+			g_variant_unref(results);
+	}
+
+	if (geoclue->client)
+		g_signal_handlers_disconnect_by_data(geoclue->client, geoclue);
+
+	if (geoclue->manager)
+		g_object_unref(geoclue->manager);
+	if (geoclue->client_props)
+		g_object_unref(geoclue->client_props);
+	if (geoclue->client)
+		g_object_unref(geoclue->client);
+	geoclue->manager = NULL;
+	geoclue->client_props = NULL;
+	geoclue->client = NULL;
+}
+
+static bool create_subscribed_client(struct location_geoclue_provider *geoclue)
+{
+	GVariant *results = NULL;
+	const char *client_path;
+	GError *error = NULL;
+	GDBusProxy *manager = g_dbus_proxy_new_for_bus_sync (G_BUS_TYPE_SYSTEM,
+	                          G_DBUS_PROXY_FLAGS_NONE,
+	                          NULL,
+	                          "org.freedesktop.GeoClue2",
+	                          "/org/freedesktop/GeoClue2/Manager",
+	                          "org.freedesktop.GeoClue2.Manager",
+	                          NULL,
+	                          &error);
+	if (error != NULL) {
+		g_critical ("Failed to connect to GeoClue2 service: %s", error->message);
+		goto error;
+	}
+	geoclue->manager = manager;
+
+	results = g_dbus_proxy_call_sync (manager,
+	                   "GetClient",
+	                   NULL,
+	                   G_DBUS_CALL_FLAGS_NONE,
+	                   -1,
+	                   NULL,
+	                   &error);
+
+	if (results == NULL) {
+		g_critical ("Failed to connect to GeoClue2 service: %s", error->message);
+		goto error;
+	}
+
+	g_assert (g_variant_n_children (results) > 0);
+	g_variant_get_child (results, 0, "&o", &client_path);
+
+	GDBusProxy *client_props = g_dbus_proxy_new_for_bus_sync (G_BUS_TYPE_SYSTEM,
+	                          G_DBUS_PROXY_FLAGS_NONE,
+	                          NULL,
+	                          "org.freedesktop.GeoClue2",
+	                          client_path,
+	                          "org.freedesktop.DBus.Properties",
+	                          NULL,
+	                          &error);
+
+	g_variant_unref (results);
+	if (error != NULL) {
+		g_critical ("Failed to connect to GeoClue2 service: %s", error->message);
+		goto error;
+	}
+	geoclue->client_props = client_props;
+
+	if (!set_client_property(client_props, "DesktopId",
+	                         g_variant_new ("s", "location-service")))
+		goto error;
+
+	if (!set_client_property(client_props, "RequestedAccuracyLevel",
+	                         g_variant_new ("u", geoclue->demand.level)))
+		goto error;
+
+	/* Older GeoClue versions lack TimeThreshold, we just get more signals */
+	set_client_property(client_props, "TimeThreshold",
+	                    g_variant_new ("u", geoclue->demand.time_threshold));
+	set_client_property(client_props, "DistanceThreshold",
+	                    g_variant_new ("u", geoclue->demand.distance_threshold));
+
+	GDBusProxy *client = g_dbus_proxy_new_for_bus_sync (G_BUS_TYPE_SYSTEM,
+	                          G_DBUS_PROXY_FLAGS_NONE,
+	                          NULL,
+	                          "org.freedesktop.GeoClue2",
+	                          g_dbus_proxy_get_object_path (client_props),
+	                          "org.freedesktop.GeoClue2.Client",
+	                          NULL,
+	                          &error);
+	if (error != NULL) {
+		g_critical ("Failed to connect to GeoClue2 service: %s", error->message);
+		goto error;
+	}
+
+	geoclue->client = client;
+	g_signal_connect (client, "g-signal",
+	                  G_CALLBACK (on_client_signal), geoclue);
+	return true;
+error:
+	/* Whatever was built so far goes, GeoClue drops its side of the client
+	 * with our connection */
+	if (error)
+		g_error_free (error);
+	release_client(geoclue, false);
+	return false;
+}
+
+static bool start_client(struct location_geoclue_provider *geoclue)
+{
+	if (!create_subscribed_client(geoclue))
+		return false;
+
+	GError *error = NULL;
+	GVariant *results = g_dbus_proxy_call_sync(geoclue->client,
+	                   "Start",
+	                   NULL,
+	                   G_DBUS_CALL_FLAGS_NONE,
+	                   -1,
+	                   NULL,
+	                   &error);
+	if (results == NULL) {
+		g_critical("Failed to start GeoClue2 client: %s", error->message);
+		g_error_free(error);
+		return false;
+	}
+	g_variant_unref(results);
+
+	return true;
+}
+
+/* Only changed properties are set, each one is a D-Bus round trip */
+static void apply_demand(struct location_geoclue_provider *geoclue, const struct location_demand *demand)
+{
+	if (demand->level != geoclue->demand.level &&
+		set_client_property(geoclue->client_props, "RequestedAccuracyLevel",
+		                    g_variant_new ("u", demand->level)))
+		geoclue->demand.level = demand->level;
+
+	if (demand->time_threshold != geoclue->demand.time_threshold &&
+		set_client_property(geoclue->client_props, "TimeThreshold",
+		                    g_variant_new ("u", demand->time_threshold)))
+		geoclue->demand.time_threshold = demand->time_threshold;
+
+	if (demand->distance_threshold != geoclue->demand.distance_threshold &&
+		set_client_property(geoclue->client_props, "DistanceThreshold",
+		                    g_variant_new ("u", demand->distance_threshold)))
+		geoclue->demand.distance_threshold = demand->distance_threshold;
+}
+
+static void cancel_reconnect(struct location_geoclue_provider *geoclue)
+{
+	if (!geoclue->reconnect_source)
+		return;
+
+	g_source_destroy(geoclue->reconnect_source);
+	g_source_unref(geoclue->reconnect_source);
+	geoclue->reconnect_source = NULL;
+}
+
+static gboolean reconnect_cb(gpointer user_data);
+
+static void schedule_reconnect(struct location_geoclue_provider *geoclue, guint delay)
+{
+	cancel_reconnect(geoclue);
+
+	geoclue->reconnect_source = g_timeout_source_new(delay);
+	g_source_set_callback(geoclue->reconnect_source, reconnect_cb, geoclue, NULL);
+	g_source_attach(geoclue->reconnect_source, geoclue->context);
+}
+
+/* Rebuilds the client with the current demand, on failure tries again
+ * later with a longer delay */
+static gboolean reconnect_cb(gpointer user_data)
+{
+	struct location_geoclue_provider *geoclue = user_data;
+
+	g_source_unref(geoclue->reconnect_source);
+	geoclue->reconnect_source = NULL;
+
+	if (!geoclue->active)
+		return FALSE;
+
+	release_client(geoclue, false);
+	if (start_client(geoclue)) {
+		g_message("GeoClue client restored after %" G_GINT64_FORMAT " ms",
+		          (g_get_monotonic_time() - geoclue->vanished_time) / 1000);
+		geoclue->reconnect_delay = RECONNECT_INITIAL_DELAY;
+		post_state(geoclue, GEOCLUE_RESULT_RECOVERED);
+		return FALSE;
+	}
+
+	release_client(geoclue, true);
+	g_warning("Failed to restore GeoClue client, retrying in %u ms", geoclue->reconnect_delay);
+	schedule_reconnect(geoclue, geoclue->reconnect_delay);
+	geoclue->reconnect_delay = MIN(geoclue->reconnect_delay * 2, RECONNECT_MAX_DELAY);
+
+	return FALSE;
+}
+
+static void name_appeared_cb(GDBusConnection *connection, const gchar *name, const gchar *owner,
+                             gpointer user_data)
+{
+	struct location_geoclue_provider *geoclue = user_data;
+
+	/* The first attempt is right away, GeoClue answers as soon as it
+	 * owns its name */
+	if (geoclue->active && !geoclue->client) {
+		geoclue->reconnect_delay = RECONNECT_INITIAL_DELAY;
+		schedule_reconnect(geoclue, 0);
+	}
+}
+
+static void name_vanished_cb(GDBusConnection *connection, const gchar *name, gpointer user_data)
+{
+	struct location_geoclue_provider *geoclue = user_data;
+
+	cancel_reconnect(geoclue);
+
+	if (!geoclue->active || !geoclue->client)
+		return;
+
+	g_warning("GeoClue disappeared, waiting for it to come back");
+	geoclue->vanished_time = g_get_monotonic_time();
+	release_client(geoclue, false);
+	post_state(geoclue, GEOCLUE_RESULT_DEGRADED);
+}
+
+/* Runs on the worker thread */
+static gboolean task_cb(gpointer user_data)
+{
+	struct geoclue_task *task = user_data;
+	struct location_geoclue_provider *geoclue = task->geoclue;
+	struct geoclue_result *result;
+
+	switch (task->type) {
+	case GEOCLUE_TASK_START:
+		cancel_reconnect(geoclue);
+		release_client(geoclue, true);
+		geoclue->worker_generation = task->generation;
+		geoclue->demand = task->demand;
+
+		result = g_new0(struct geoclue_result, 1);
+		result->type = GEOCLUE_RESULT_STARTED;
+		result->success = start_client(geoclue);
+		if (!result->success)
+			release_client(geoclue, true);
+		geoclue->active = result->success;
+		post_result(geoclue, result);
+		break;
+	case GEOCLUE_TASK_STOP:
+		geoclue->active = false;
+		cancel_reconnect(geoclue);
+		release_client(geoclue, true);
+		break;
+	case GEOCLUE_TASK_SET_DEMAND:
+		/* Without a client the demand is applied when it is rebuilt */
+		if (geoclue->client_props)
+			apply_demand(geoclue, &task->demand);
+		else
+			geoclue->demand = task->demand;
+		break;
+	case GEOCLUE_TASK_QUIT:
+		geoclue->active = false;
+		cancel_reconnect(geoclue);
+		release_client(geoclue, true);
+		g_bus_unwatch_name(geoclue->name_watch);
+		g_main_loop_quit(geoclue->loop);
+		break;
+	}
+
+	return FALSE;
+}
+
+static void queue_task(struct location_geoclue_provider *geoclue, enum geoclue_task_type type,
+                       const struct location_demand *demand)
+{
+	struct geoclue_task *task;
+
+	task = g_new0(struct geoclue_task, 1);
+	task->geoclue = geoclue;
+	task->type = type;
+	task->generation = geoclue->generation;
+	if (demand)
+		task->demand = *demand;
+
+	invoke_in_context(geoclue->context, task_cb, task);
+}
+
+static gpointer worker_thread(gpointer user_data)
+{
+	struct location_geoclue_provider *geoclue = user_data;
+
+	/* Proxies created here deliver their signals to this context */
+	g_main_context_push_thread_default(geoclue->context);
+	geoclue->name_watch = g_bus_watch_name(G_BUS_TYPE_SYSTEM, GEOCLUE_NAME, G_BUS_NAME_WATCHER_FLAGS_NONE,
+	                                       name_appeared_cb, name_vanished_cb, geoclue, NULL);
+	g_main_loop_run(geoclue->loop);
+	g_main_context_pop_thread_default(geoclue->context);
+
+	return NULL;
+}
+
+static bool geoclue_start(struct location_provider *provider, struct location_service *service)
+{
+	struct location_geoclue_provider *geoclue = (struct location_geoclue_provider *) provider;
+
+	geoclue->service = service;
+	geoclue->generation++;
+	queue_task(geoclue, GEOCLUE_TASK_START, &service->demand);
+
+	return true;
+}
+
+static void geoclue_stop(struct location_provider *provider, struct location_service *service)
+{
+	struct location_geoclue_provider *geoclue = (struct location_geoclue_provider *) provider;
+
+	geoclue->generation++;
+	queue_task(geoclue, GEOCLUE_TASK_STOP, NULL);
+}
+
+static void geoclue_set_demand(struct location_provider *provider, struct location_service *service,
+                               const struct location_demand *demand)
+{
+	struct location_geoclue_provider *geoclue = (struct location_geoclue_provider *) provider;
+
+	queue_task(geoclue, GEOCLUE_TASK_SET_DEMAND, demand);
+}
+
+static void geoclue_free(struct location_provider *provider)
+{
+	struct location_geoclue_provider *geoclue = (struct location_geoclue_provider *) provider;
+
+	geoclue->generation++;
+	queue_task(geoclue, GEOCLUE_TASK_QUIT, NULL);
+	g_thread_join(geoclue->thread);
+
+	g_main_loop_unref(geoclue->loop);
+	g_main_context_unref(geoclue->context);
+	g_free(geoclue);
+}
+
+struct location_provider *location_geoclue_provider_new(void)
+{
+	struct location_geoclue_provider *geoclue;
+
+	geoclue = g_new0(struct location_geoclue_provider, 1);
+	geoclue->provider.name = "geoclue";
+	geoclue->provider.async = true;
+	geoclue->provider.one_shot_helper = true;
+	geoclue->provider.start = geoclue_start;
+	geoclue->provider.stop = geoclue_stop;
+	geoclue->provider.set_demand = geoclue_set_demand;
+	geoclue->provider.free = geoclue_free;
+
+	geoclue->context = g_main_context_new();
+	geoclue->loop = g_main_loop_new(geoclue->context, FALSE);
+	geoclue->thread = g_thread_new("geoclue", worker_thread, geoclue);
+
+	return &geoclue->provider;
+}
+
+// vim:ts=4:sw=4:noexpandtab
@@ -0,0 +1,35 @@
+/* @@@LICENSE
+*
+* Copyright (c) 2026 LuneOS Project
+*
+* This file is part of location-service.
+*
+* location-service is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* location-service is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with location-service.  If not, see <http://www.gnu.org/licenses/>.
+*
+* LICENSE@@@ */
+
+
+#ifndef LOCATION_GEOCLUE_H_
+#define LOCATION_GEOCLUE_H_
+
+struct location_provider;
+
+/* Provider talking to GeoClue2. All D-Bus calls are made from a worker
+ * thread with its own main context, fixes and the outcome of starting are
+ * handed back to the thread running the default main context. */
+struct location_provider *location_geoclue_provider_new(void);
+
+#endif
+
+// vim:ts=4:sw=4:noexpandtab
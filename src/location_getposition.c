@@ -23,16 +23,23 @@
 
 #include <pbnjson.h>
 
+#include <stdio.h>
 #include <stdlib.h>
+#include <signal.h>
 #include <glib.h>
+#include <glib-unix.h>
 #include <locale.h>
 #include <glib/gi18n.h>
 #include <gio/gio.h>
 #include "location_common.h"
 
 /* Commandline options */
-static gint timeout = 30; /* seconds */
+static gint timeout = -1; /* seconds */
 static GClueAccuracyLevel accuracy_level = GCLUE_ACCURACY_LEVEL_COUNTRY;
+static gint count = 1;
+static gint interval = 0; /* milliseconds */
+static gboolean follow = FALSE;
+static gboolean timing = FALSE;
 
 static GOptionEntry entries[] =
 {
@@ -41,7 +48,7 @@ static GOptionEntry entries[] =
           0,
           G_OPTION_ARG_INT,
           &timeout,
-          N_("Exit after T seconds. Default: 30"),
+          N_("Exit after T seconds. Default: 30, no timeout when streaming"),
           "T" },
         { "accuracy-level",
           'a',
@@ -55,18 +62,75 @@ static GOptionEntry entries[] =
              "Street = 6, "
              "Exact = 8."),
           "A" },
+        { "count",
+          'n',
+          0,
+          G_OPTION_ARG_INT,
+          &count,
+          N_("Print N fixes, one JSON object per line. Default: 1"),
+          "N" },
+        { "interval",
+          'i',
+          0,
+          G_OPTION_ARG_INT,
+          &interval,
+          N_("Print at most one fix every MS milliseconds"),
+          "MS" },
+        { "follow",
+          'f',
+          0,
+          G_OPTION_ARG_NONE,
+          &follow,
+          N_("Print fixes until interrupted"),
+          NULL },
+        { "timing",
+          'T',
+          0,
+          G_OPTION_ARG_NONE,
+          &timing,
+          N_("Add sinceStart and latency in milliseconds to every fix"),
+          NULL },
         { NULL }
 };
 
 GDBusProxy *manager;
+GDBusProxy *client_proxy;
 GMainLoop *main_loop;
 
+/* With more than one fix every fix is printed on a line of its own */
+static gboolean streaming;
+static gint printed;
+static gint64 start_time;
+static gint64 last_print_time;
+
+/* A LocationUpdated signal whose Location properties are being fetched */
+struct location_update {
+        gint64 received;
+};
+
 static void log_handler(const gchar *log_domain, GLogLevelFlags log_level,
                         const gchar *message, gpointer user_data)
 {
         g_printerr("%s\n", message);
 }
 
+static void
+stop_client (void)
+{
+        if (!client_proxy)
+                return;
+
+        g_dbus_proxy_call_sync (client_proxy,
+                           "Stop",
+                           NULL,
+                           G_DBUS_CALL_FLAGS_NONE,
+                           -1,
+                           NULL,
+                           NULL);
+        g_object_unref (client_proxy);
+        client_proxy = NULL;
+}
+
 static gboolean
 on_location_timeout (gpointer user_data)
 {
@@ -77,40 +141,75 @@ on_location_timeout (gpointer user_data)
         return FALSE;
 }
 
+static gboolean
+on_quit_signal (gpointer user_data)
+{
+        stop_client ();
+        on_location_timeout (NULL);
+
+        return FALSE;
+}
+
 static void
-on_location_proxy_ready (GObject      *source_object,
-                         GAsyncResult *res,
-                         gpointer      user_data)
+on_location_properties_ready (GObject      *source_object,
+                              GAsyncResult *res,
+                              gpointer      user_data)
 {
-        GDBusProxy *location;
-        GDBusProxy *client = user_data;
+        struct location_update *update = user_data;
+        struct location_fix fix;
+        GVariant *properties, *dict;
         GError *error = NULL;
+        gint64 now;
 
-        location = g_dbus_proxy_new_for_bus_finish (res, &error);
-        if (error != NULL) {
-            g_critical ("Failed to connect to GeoClue2 service: %s", error->message);
+        properties = g_dbus_connection_call_finish (G_DBUS_CONNECTION (source_object), res, &error);
+        if (properties == NULL) {
+            g_critical ("Failed to get GeoClue2 location: %s", error->message);
 
             exit (-7);
         }
 
+        now = g_get_monotonic_time ();
+        if (interval > 0 && printed > 0 &&
+            now - last_print_time < (gint64) interval * 1000) {
+                g_variant_unref (properties);
+                g_free (update);
+                return;
+        }
+
+        dict = g_variant_get_child_value (properties, 0);
+        location_fix_from_properties (dict, &fix);
+        g_variant_unref (dict);
+        g_variant_unref (properties);
+
         jvalue_ref reply_obj = NULL;
         reply_obj = jobject_create();
-        g_object_unref (location);
-        location_to_reply(location, &reply_obj);
+        location_fix_to_reply(&fix, &reply_obj);
 
-        g_print("%s",jvalue_tostring_simple(reply_obj));
+        if (timing) {
+                jobject_put (reply_obj, J_CSTR_TO_JVAL ("sinceStart"),
+                             jnumber_create_i64 ((now - start_time) / 1000));
+                jobject_put (reply_obj, J_CSTR_TO_JVAL ("latency"),
+                             jnumber_create_i64 ((now - update->received) / 1000));
+        }
+
+        if (streaming) {
+                g_print("%s\n",jvalue_tostring_simple(reply_obj));
+                fflush (stdout);
+        }
+        else
+                g_print("%s",jvalue_tostring_simple(reply_obj));
 
         if (!jis_null(reply_obj))
             j_release(&reply_obj);
 
-        g_dbus_proxy_call_sync (client,
-                           "Stop",
-                           NULL,
-                           G_DBUS_CALL_FLAGS_NONE,
-                           -1,
-                           NULL,
-                           &error);
-        on_location_timeout (NULL);
+        g_free (update);
+        last_print_time = now;
+        printed++;
+
+        if (count > 0 && printed >= count) {
+                stop_client ();
+                on_location_timeout (NULL);
+        }
 }
 
 static void
@@ -144,22 +243,29 @@ on_client_signal (GDBusProxy *client,
                   GVariant   *parameters,
                   gpointer    user_data)
 {
+        struct location_update *update;
         char *location_path;
         if (g_strcmp0 (signal_name, "LocationUpdated") != 0)
                 return;
 
+        update = g_new0 (struct location_update, 1);
+        update->received = g_get_monotonic_time ();
+
         g_assert (g_variant_n_children (parameters) > 1);
         g_variant_get_child (parameters, 1, "&o", &location_path);
 
-        g_dbus_proxy_new_for_bus (G_BUS_TYPE_SYSTEM,
-                                  G_DBUS_PROXY_FLAGS_NONE,
-                                  NULL,
-                                  "org.freedesktop.GeoClue2",
-                                  location_path,
-                                  "org.freedesktop.GeoClue2.Location",
-                                  NULL,
-                                  on_location_proxy_ready,
-                                  user_data);
+        g_dbus_connection_call (g_dbus_proxy_get_connection (client),
+                                "org.freedesktop.GeoClue2",
+                                location_path,
+                                "org.freedesktop.DBus.Properties",
+                                "GetAll",
+                                g_variant_new ("(s)", "org.freedesktop.GeoClue2.Location"),
+                                G_VARIANT_TYPE ("(a{sv})"),
+                                G_DBUS_CALL_FLAGS_NONE,
+                                -1,
+                                NULL,
+                                on_location_properties_ready,
+                                update);
 }
 
 static void
@@ -179,6 +285,7 @@ on_start_ready (GObject      *source_object,
         }
 
         g_variant_unref (results);
+        start_time = g_get_monotonic_time ();
 }
 
 static void
@@ -196,6 +303,7 @@ on_client_proxy_ready (GObject      *source_object,
             exit (-5);
         }
 
+        client_proxy = client;
         g_signal_connect (client, "g-signal",
                           G_CALLBACK (on_client_signal), client);
         g_signal_connect (client, "g-properties-changed",
@@ -210,7 +318,45 @@ on_client_proxy_ready (GObject      *source_object,
                            on_start_ready,
                            user_data);
 
-        g_timeout_add_seconds (timeout, on_location_timeout, NULL);
+        if (timeout > 0)
+                g_timeout_add_seconds (timeout, on_location_timeout, NULL);
+}
+
+static void
+create_client_proxy (GDBusProxy *client_props,
+                     gpointer    user_data)
+{
+        g_dbus_proxy_new_for_bus (G_BUS_TYPE_SYSTEM,
+                                  G_DBUS_PROXY_FLAGS_NONE,
+                                  NULL,
+                                  "org.freedesktop.GeoClue2",
+                                  g_dbus_proxy_get_object_path (client_props),
+                                  "org.freedesktop.GeoClue2.Client",
+                                  NULL,
+                                  on_client_proxy_ready,
+                                  user_data);
+}
+
+static void
+on_set_time_threshold_ready (GObject      *source_object,
+                             GAsyncResult *res,
+                             gpointer      user_data)
+{
+        GDBusProxy *client_props = G_DBUS_PROXY (source_object);
+        GVariant *results;
+        GError *error = NULL;
+
+        /* Not fatal, older GeoClue versions don't know the property and
+         * fixes are then only filtered here */
+        results = g_dbus_proxy_call_finish (client_props, res, &error);
+        if (results == NULL) {
+            g_warning ("Failed to set GeoClue2 time threshold: %s", error->message);
+            g_error_free (error);
+        }
+        else
+            g_variant_unref (results);
+
+        create_client_proxy (client_props, user_data);
 }
 
 static void
@@ -230,15 +376,22 @@ on_set_accuracy_level_ready (GObject      *source_object,
         }
         g_variant_unref (results);
 
-        g_dbus_proxy_new_for_bus (G_BUS_TYPE_SYSTEM,
-                                  G_DBUS_PROXY_FLAGS_NONE,
-                                  NULL,
-                                  "org.freedesktop.GeoClue2",
-                                  g_dbus_proxy_get_object_path (client_props),
-                                  "org.freedesktop.GeoClue2.Client",
-                                  NULL,
-                                  on_client_proxy_ready,
-                                  user_data);
+        if (interval < 1000) {
+                create_client_proxy (client_props, user_data);
+                return;
+        }
+
+        g_dbus_proxy_call (client_props,
+                           "Set",
+                           g_variant_new ("(ssv)",
+                                          "org.freedesktop.GeoClue2.Client",
+                                          "TimeThreshold",
+                                          g_variant_new ("u", interval / 1000)),
+                           G_DBUS_CALL_FLAGS_NONE,
+                           -1,
+                           NULL,
+                           on_set_time_threshold_ready,
+                           user_data);
 }
 
 static void
@@ -376,6 +529,15 @@ main (gint argc, gchar *argv[])
         }
         g_option_context_free (context);
 
+        if (follow)
+                count = 0;
+        streaming = count != 1;
+        if (timeout < 0)
+                timeout = streaming ? 0 : 30;
+
+        g_unix_signal_add (SIGINT, on_quit_signal, NULL);
+        g_unix_signal_add (SIGTERM, on_quit_signal, NULL);
+
         g_dbus_proxy_new_for_bus (G_BUS_TYPE_SYSTEM,
                                   G_DBUS_PROXY_FLAGS_NONE,
                                   NULL,
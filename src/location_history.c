@@ -0,0 +1,186 @@
+/* @@@LICENSE
+*
+* Copyright (c) 2026 LuneOS Project
+*
+* This file is part of location-service.
+*
+* location-service is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* location-service is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with location-service.  If not, see <http://www.gnu.org/licenses/>.
+*
+* LICENSE@@@ */
+
+
+#include <math.h>
+#include <string.h>
+
+#include "location_history.h"
+
+#define METERS_PER_DEGREE	111319.49
+
+struct location_history {
+	struct location_history_point *points;
+	guint first;
+	guint count;
+};
+
+struct location_history *location_history_new(void)
+{
+	struct location_history *history;
+
+	history = g_new0(struct location_history, 1);
+	history->points = g_new(struct location_history_point, LOCATION_HISTORY_CAPACITY);
+
+	return history;
+}
+
+void location_history_free(struct location_history *history)
+{
+	if (!history)
+		return;
+
+	g_free(history->points);
+	g_free(history);
+}
+
+void location_history_point_from_fix(struct location_history_point *point, const struct location_fix *fix)
+{
+	point->latitude = fix->latitude;
+	point->longitude = fix->longitude;
+	point->timestamp = fix->timestamp;
+	point->horiz_accuracy = fix->horiz_accuracy;
+}
+
+/* The oldest point is dropped once the history is full */
+void location_history_append(struct location_history *history, const struct location_fix *fix)
+{
+	guint index;
+
+	if (history->count < LOCATION_HISTORY_CAPACITY) {
+		index = (history->first + history->count) % LOCATION_HISTORY_CAPACITY;
+		history->count++;
+	}
+	else {
+		index = history->first;
+		history->first = (history->first + 1) % LOCATION_HISTORY_CAPACITY;
+	}
+
+	location_history_point_from_fix(&history->points[index], fix);
+}
+
+/* Distance in meters of point from the segment start-end, in a plane
+ * tangent at start which is good enough for the few kilometers between
+ * two points of a track */
+static double segment_distance(const struct location_history_point *start, const struct location_history_point *end,
+                               const struct location_history_point *point)
+{
+	double scale = cos(start->latitude * M_PI / 180);
+	double dx, dy, px, py, length, t;
+
+	dx = remainder(end->longitude - start->longitude, 360) * scale;
+	dy = end->latitude - start->latitude;
+	px = remainder(point->longitude - start->longitude, 360) * scale;
+	py = point->latitude - start->latitude;
+
+	length = dx * dx + dy * dy;
+	t = length > 0 ? CLAMP((px * dx + py * dy) / length, 0, 1) : 0;
+	px -= t * dx;
+	py -= t * dy;
+
+	return sqrt(px * px + py * py) * METERS_PER_DEGREE;
+}
+
+/* The points between since and until, in seconds since the epoch, with
+ * every point dropped which is within tolerance meters of the simplified
+ * track. num_points is set to the number of points before simplification.
+ * The range is simplified by the same simplifier as live tracks, so the
+ * work per point stays bounded however long the range is and subscribers
+ * carry on from the last point as if they had been there all along. */
+GArray *location_history_query(struct location_history *history, double since, double until, double tolerance,
+                               guint *num_points)
+{
+	GArray *points = g_array_new(FALSE, FALSE, sizeof(struct location_history_point));
+	const struct location_history_point *point;
+	struct location_simplifier simplifier;
+	struct location_history_point committed;
+	guint n;
+
+	location_simplifier_init(&simplifier, tolerance, NULL);
+	*num_points = 0;
+
+	for (n = 0; n < history->count; n++) {
+		point = &history->points[(history->first + n) % LOCATION_HISTORY_CAPACITY];
+		if (point->timestamp < since || point->timestamp > until)
+			continue;
+
+		(*num_points)++;
+		if (tolerance <= 0)
+			g_array_append_vals(points, point, 1);
+		else if (location_simplifier_add(&simplifier, point, &committed))
+			g_array_append_vals(points, &committed, 1);
+	}
+
+	/* The newest point ends the track */
+	if (tolerance > 0 && simplifier.count > 0)
+		g_array_append_vals(points, &simplifier.window[simplifier.count - 1], 1);
+
+	return points;
+}
+
+/* anchor is the last point the receiver already has, if any */
+void location_simplifier_init(struct location_simplifier *simplifier, double tolerance,
+                              const struct location_history_point *anchor)
+{
+	memset(simplifier, 0, sizeof(*simplifier));
+	simplifier->tolerance = tolerance;
+	if (anchor) {
+		simplifier->anchor = *anchor;
+		simplifier->has_anchor = true;
+	}
+}
+
+/* Returns true with the point to send in committed when point can't be
+ * added to the segment being built anymore */
+bool location_simplifier_add(struct location_simplifier *simplifier, const struct location_history_point *point,
+                             struct location_history_point *committed)
+{
+	guint n;
+
+	if (!simplifier->has_anchor) {
+		simplifier->anchor = *point;
+		simplifier->has_anchor = true;
+		*committed = *point;
+		return true;
+	}
+
+	if (simplifier->count < LOCATION_SIMPLIFIER_WINDOW) {
+		for (n = 0; n < simplifier->count; n++) {
+			if (segment_distance(&simplifier->anchor, point, &simplifier->window[n]) > simplifier->tolerance)
+				break;
+		}
+
+		if (n == simplifier->count) {
+			simplifier->window[simplifier->count++] = *point;
+			return false;
+		}
+	}
+
+	/* The newest pending point ends the segment and starts the next one */
+	*committed = simplifier->window[simplifier->count - 1];
+	simplifier->anchor = *committed;
+	simplifier->window[0] = *point;
+	simplifier->count = 1;
+
+	return true;
+}
+
+// vim:ts=4:sw=4:noexpandtab
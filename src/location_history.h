@@ -0,0 +1,74 @@
+/* @@@LICENSE
+*
+* Copyright (c) 2026 LuneOS Project
+*
+* This file is part of location-service.
+*
+* location-service is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* location-service is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with location-service.  If not, see <http://www.gnu.org/licenses/>.
+*
+* LICENSE@@@ */
+
+
+#ifndef LOCATION_HISTORY_H_
+#define LOCATION_HISTORY_H_
+
+#include <stdbool.h>
+#include <glib.h>
+
+#include "location_common.h"
+
+/* The fixes of the tracking session kept in memory, a day at one fix per
+ * second and a bit more */
+#define LOCATION_HISTORY_CAPACITY	(96 * 1024)
+
+/* Most points a live simplifier holds back before it commits one */
+#define LOCATION_SIMPLIFIER_WINDOW	64
+
+struct location_history_point {
+	double latitude;
+	double longitude;
+	double timestamp;
+	double horiz_accuracy;
+};
+
+/* Simplifies a live track one point at a time: the pending points after
+ * the last committed one are kept as long as a single segment from it to
+ * the newest point stays within tolerance of all of them. Every point costs
+ * at most LOCATION_SIMPLIFIER_WINDOW distance tests, earlier points are
+ * never looked at again. */
+struct location_simplifier {
+	double tolerance;
+	bool has_anchor;
+	struct location_history_point anchor;
+	struct location_history_point window[LOCATION_SIMPLIFIER_WINDOW];
+	guint count;
+};
+
+struct location_history;
+
+struct location_history *location_history_new(void);
+void location_history_free(struct location_history *history);
+void location_history_append(struct location_history *history, const struct location_fix *fix);
+GArray *location_history_query(struct location_history *history, double since, double until, double tolerance,
+                               guint *num_points);
+
+void location_history_point_from_fix(struct location_history_point *point, const struct location_fix *fix);
+void location_simplifier_init(struct location_simplifier *simplifier, double tolerance,
+                              const struct location_history_point *anchor);
+bool location_simplifier_add(struct location_simplifier *simplifier, const struct location_history_point *point,
+                             struct location_history_point *committed);
+
+#endif
+
+// vim:ts=4:sw=4:noexpandtab
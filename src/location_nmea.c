@@ -0,0 +1,192 @@
+/* @@@LICENSE
+*
+* Copyright (c) 2026 LuneOS Project
+*
+* This file is part of location-service.
+*
+* location-service is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* location-service is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with location-service.  If not, see <http://www.gnu.org/licenses/>.
+*
+* LICENSE@@@ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+#include <glib-unix.h>
+
+#include "location_nmea.h"
+#include "location_service.h"
+
+/* Seconds to wait before reopening a device which went away */
+#define NMEA_REOPEN_DELAY	1
+
+struct location_nmea_provider {
+	struct location_provider provider;
+	struct location_service *service;
+	char *device;
+	int fd;
+	bool inherited;
+	guint watch;
+	guint reopen_timeout;
+	struct nmea_parser parser;
+};
+
+static void nmea_fix_cb(const struct location_fix *fix, void *user_data)
+{
+	struct location_nmea_provider *nmea = user_data;
+
+	/* The session may have been stopped by an earlier fix of this read */
+	if (nmea->fd < 0)
+		return;
+
+	location_service_handle_fix(nmea->service, GCLUE_ACCURACY_LEVEL_EXACT, fix);
+}
+
+static bool nmea_open(struct location_nmea_provider *nmea);
+
+static void nmea_close(struct location_nmea_provider *nmea)
+{
+	if (nmea->watch) {
+		g_source_remove(nmea->watch);
+		nmea->watch = 0;
+	}
+
+	if (nmea->fd >= 0 && !nmea->inherited)
+		close(nmea->fd);
+	nmea->fd = -1;
+}
+
+static gboolean nmea_reopen_cb(gpointer user_data)
+{
+	struct location_nmea_provider *nmea = user_data;
+
+	if (nmea_open(nmea)) {
+		nmea->reopen_timeout = 0;
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+static gboolean nmea_read_cb(gint fd, GIOCondition condition, gpointer user_data)
+{
+	struct location_nmea_provider *nmea = user_data;
+	size_t space;
+	ssize_t length;
+	char *buffer;
+
+	for (;;) {
+		buffer = nmea_parser_get_buffer(&nmea->parser, &space);
+		length = read(fd, buffer, space);
+		if (length > 0) {
+			nmea_parser_commit(&nmea->parser, length);
+			if (nmea->fd < 0)
+				return FALSE;
+			continue;
+		}
+
+		if (length < 0 && (errno == EAGAIN || errno == EINTR))
+			return TRUE;
+
+		break;
+	}
+
+	/* End of file or an error: the writer of the FIFO or the pty master went
+	 * away, try again later */
+	g_warning("Lost NMEA device %s", nmea->device);
+	nmea->watch = 0;
+	nmea_close(nmea);
+	if (!nmea->inherited)
+		nmea->reopen_timeout = g_timeout_add_seconds(NMEA_REOPEN_DELAY, nmea_reopen_cb, nmea);
+
+	return FALSE;
+}
+
+static bool nmea_open(struct location_nmea_provider *nmea)
+{
+	struct termios tio;
+
+	if (g_str_has_prefix(nmea->device, "fd:")) {
+		nmea->fd = atoi(nmea->device + 3);
+		nmea->inherited = true;
+		fcntl(nmea->fd, F_SETFL, fcntl(nmea->fd, F_GETFL) | O_NONBLOCK);
+	}
+	else {
+		nmea->fd = open(nmea->device, O_RDONLY | O_NOCTTY | O_NONBLOCK);
+		if (nmea->fd < 0) {
+			g_warning("Failed to open NMEA device %s: %s", nmea->device, strerror(errno));
+			return false;
+		}
+	}
+
+	/* Keep the configured line speed but switch off any line processing */
+	if (isatty(nmea->fd) && tcgetattr(nmea->fd, &tio) == 0) {
+		cfmakeraw(&tio);
+		tcsetattr(nmea->fd, TCSANOW, &tio);
+	}
+
+	nmea_parser_init(&nmea->parser, nmea_fix_cb, nmea);
+	nmea->watch = g_unix_fd_add(nmea->fd, G_IO_IN | G_IO_HUP | G_IO_ERR, nmea_read_cb, nmea);
+
+	return true;
+}
+
+static bool nmea_start(struct location_provider *provider, struct location_service *service)
+{
+	struct location_nmea_provider *nmea = (struct location_nmea_provider *) provider;
+
+	nmea->service = service;
+
+	return nmea_open(nmea);
+}
+
+static void nmea_stop(struct location_provider *provider, struct location_service *service)
+{
+	struct location_nmea_provider *nmea = (struct location_nmea_provider *) provider;
+
+	if (nmea->reopen_timeout) {
+		g_source_remove(nmea->reopen_timeout);
+		nmea->reopen_timeout = 0;
+	}
+
+	nmea_close(nmea);
+}
+
+static void nmea_free(struct location_provider *provider)
+{
+	struct location_nmea_provider *nmea = (struct location_nmea_provider *) provider;
+
+	nmea_stop(provider, nmea->service);
+	g_free(nmea->device);
+	g_free(nmea);
+}
+
+struct location_provider *location_nmea_provider_new(const char *device)
+{
+	struct location_nmea_provider *nmea;
+
+	nmea = g_new0(struct location_nmea_provider, 1);
+	nmea->provider.name = "nmea";
+	nmea->provider.start = nmea_start;
+	nmea->provider.stop = nmea_stop;
+	nmea->provider.free = nmea_free;
+	nmea->device = g_strdup(device);
+	nmea->fd = -1;
+
+	return &nmea->provider;
+}
+
+// vim:ts=4:sw=4:noexpandtab
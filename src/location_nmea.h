@@ -0,0 +1,87 @@
+/* @@@LICENSE
+*
+* Copyright (c) 2026 LuneOS Project
+*
+* This file is part of location-service.
+*
+* location-service is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* location-service is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with location-service.  If not, see <http://www.gnu.org/licenses/>.
+*
+* LICENSE@@@ */
+
+#ifndef LOCATION_NMEA_H_
+#define LOCATION_NMEA_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "location_common.h"
+
+/* NMEA 0183 limits a sentence to 82 characters, leave room for broken
+ * receivers which exceed it */
+#define NMEA_MAX_SENTENCE	128
+#define NMEA_MAX_FIELDS		24
+
+/* User equivalent range error in meters used to turn DOP values into
+ * accuracies */
+#define NMEA_UERE			5.0
+
+typedef void (*nmea_fix_func)(const struct location_fix *fix, void *user_data);
+
+/* Fields of the epoch (all sentences sharing one UTC time) being assembled */
+struct nmea_epoch {
+	double time;
+	int date;
+	bool has_gga;
+	bool has_rmc;
+	bool has_vtg;
+	bool valid;
+	bool emitted;
+	double latitude;
+	double longitude;
+	double altitude;
+	double velocity;
+	double heading;
+};
+
+/* Streaming parser. Data is read straight into the parser's buffer and
+ * sentences are checked and split in place, nothing is allocated per
+ * sentence. */
+struct nmea_parser {
+	char buffer[NMEA_MAX_SENTENCE * 4];
+	size_t length;
+	struct nmea_epoch epoch;
+	double hdop;
+	double vdop;
+	/* The receiver sends VTG after GGA and RMC, so epochs are only
+	 * emitted once VTG arrived or the next epoch begins */
+	bool late_vtg;
+	unsigned int bad_checksums;
+	nmea_fix_func fix_cb;
+	void *user_data;
+};
+
+void nmea_parser_init(struct nmea_parser *parser, nmea_fix_func fix_cb, void *user_data);
+char *nmea_parser_get_buffer(struct nmea_parser *parser, size_t *space);
+void nmea_parser_commit(struct nmea_parser *parser, size_t length);
+bool nmea_parse_sentence(struct nmea_parser *parser, char *sentence, size_t length);
+
+struct location_provider;
+
+/* Provider reading NMEA from a tty, pty or FIFO. "fd:N" uses the already
+ * open file descriptor N. */
+struct location_provider *location_nmea_provider_new(const char *device);
+
+#endif
+
+// vim:ts=4:sw=4:noexpandtab
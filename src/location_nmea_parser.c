@@ -0,0 +1,346 @@
+/* @@@LICENSE
+*
+* Copyright (c) 2026 LuneOS Project
+*
+* This file is part of location-service.
+*
+* location-service is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* location-service is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with location-service.  If not, see <http://www.gnu.org/licenses/>.
+*
+* LICENSE@@@ */
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "location_nmea.h"
+
+#define KNOTS_TO_MPS		0.514444
+#define KMH_TO_MPS			(1 / 3.6)
+
+static int hex_value(char c)
+{
+	if (c >= '0' && c <= '9')
+		return c - '0';
+	if (c >= 'A' && c <= 'F')
+		return c - 'A' + 10;
+	if (c >= 'a' && c <= 'f')
+		return c - 'a' + 10;
+	return -1;
+}
+
+static bool parse_double(const char *field, double *value)
+{
+	char *end;
+
+	if (field[0] == '\0')
+		return false;
+
+	*value = g_ascii_strtod(field, &end);
+	return *end == '\0';
+}
+
+/* ddmm.mmmm (or dddmm.mmmm) plus hemisphere into signed degrees */
+static bool parse_coordinate(const char *field, const char *hemisphere, double *value)
+{
+	double raw, degrees;
+
+	if (!parse_double(field, &raw))
+		return false;
+
+	degrees = floor(raw / 100);
+	*value = degrees + (raw - degrees * 100) / 60;
+	if (hemisphere[0] == 'S' || hemisphere[0] == 'W')
+		*value = -*value;
+
+	return true;
+}
+
+static gint64 days_from_civil(int year, int month, int day)
+{
+	int era, yoe, doy, doe;
+
+	year -= month <= 2;
+	era = (year >= 0 ? year : year - 399) / 400;
+	yoe = year - era * 400;
+	doy = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+	doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+
+	return (gint64) era * 146097 + doe - 719468;
+}
+
+static double epoch_timestamp(const struct nmea_epoch *epoch)
+{
+	int hours, minutes, day, month, year;
+	double seconds;
+
+	if (epoch->date <= 0 || epoch->time < 0)
+		return time(NULL);
+
+	hours = (int) (epoch->time / 10000);
+	minutes = (int) (epoch->time / 100) % 100;
+	seconds = fmod(epoch->time, 100);
+	day = epoch->date / 10000;
+	month = (epoch->date / 100) % 100;
+	year = epoch->date % 100;
+	year += year < 80 ? 2000 : 1900;
+
+	return days_from_civil(year, month, day) * 86400.0 +
+		hours * 3600 + minutes * 60 + seconds;
+}
+
+static void epoch_emit(struct nmea_parser *parser)
+{
+	struct nmea_epoch *epoch = &parser->epoch;
+	struct location_fix fix;
+
+	if (!epoch->valid || epoch->emitted)
+		return;
+
+	fix.latitude = epoch->latitude;
+	fix.longitude = epoch->longitude;
+	fix.altitude = epoch->altitude;
+	fix.horiz_accuracy = parser->hdop > 0 ? parser->hdop * NMEA_UERE : -1;
+	fix.vert_accuracy = parser->vdop > 0 ? parser->vdop * NMEA_UERE : -1;
+	fix.heading = epoch->heading;
+	fix.velocity = epoch->velocity;
+	fix.timestamp = epoch_timestamp(epoch);
+	fix.description = "NMEA";
+
+	epoch->emitted = true;
+	parser->fix_cb(&fix, parser->user_data);
+}
+
+/* An epoch is complete with GGA and RMC, and with VTG as well for receivers
+ * which send it after them, so heading and speed aren't lost */
+static void epoch_complete(struct nmea_parser *parser)
+{
+	struct nmea_epoch *epoch = &parser->epoch;
+
+	if (epoch->has_gga && epoch->has_rmc && (epoch->has_vtg || !parser->late_vtg))
+		epoch_emit(parser);
+}
+
+/* A sentence with a new UTC time closes the previous epoch */
+static void epoch_begin(struct nmea_parser *parser, const char *time_field)
+{
+	struct nmea_epoch *epoch = &parser->epoch;
+	double time;
+
+	if (!parse_double(time_field, &time))
+		time = -1;
+
+	if (time == epoch->time)
+		return;
+
+	/* The VTG we waited for never came, the receiver stopped sending it */
+	if (parser->late_vtg && !epoch->emitted && epoch->has_gga && epoch->has_rmc &&
+		!epoch->has_vtg)
+		parser->late_vtg = false;
+
+	epoch_emit(parser);
+
+	memset(epoch, 0, sizeof(*epoch));
+	epoch->time = time;
+	epoch->altitude = -1;
+	epoch->velocity = -1;
+	epoch->heading = -1;
+}
+
+static void parse_gga(struct nmea_parser *parser, char **fields, int count)
+{
+	struct nmea_epoch *epoch = &parser->epoch;
+	double value;
+
+	if (count < 10)
+		return;
+
+	epoch_begin(parser, fields[1]);
+
+	if (atoi(fields[6]) > 0 &&
+		parse_coordinate(fields[2], fields[3], &epoch->latitude) &&
+		parse_coordinate(fields[4], fields[5], &epoch->longitude))
+		epoch->valid = true;
+
+	if (parse_double(fields[8], &value))
+		parser->hdop = value;
+	if (parse_double(fields[9], &value))
+		epoch->altitude = value;
+
+	epoch->has_gga = true;
+	epoch_complete(parser);
+}
+
+static void parse_rmc(struct nmea_parser *parser, char **fields, int count)
+{
+	struct nmea_epoch *epoch = &parser->epoch;
+	double value;
+
+	if (count < 10)
+		return;
+
+	epoch_begin(parser, fields[1]);
+
+	if (fields[2][0] == 'A' &&
+		parse_coordinate(fields[3], fields[4], &epoch->latitude) &&
+		parse_coordinate(fields[5], fields[6], &epoch->longitude))
+		epoch->valid = true;
+
+	if (parse_double(fields[7], &value))
+		epoch->velocity = value * KNOTS_TO_MPS;
+	if (parse_double(fields[8], &value))
+		epoch->heading = value;
+	epoch->date = atoi(fields[9]);
+
+	epoch->has_rmc = true;
+	epoch_complete(parser);
+}
+
+/* GSA and VTG carry no time and belong to the current epoch. DOP values
+ * are kept for the following epochs as receivers send GSA less often. */
+static void parse_gsa(struct nmea_parser *parser, char **fields, int count)
+{
+	double value;
+
+	if (count < 18)
+		return;
+
+	if (parse_double(fields[16], &value))
+		parser->hdop = value;
+	if (parse_double(fields[17], &value))
+		parser->vdop = value;
+}
+
+static void parse_vtg(struct nmea_parser *parser, char **fields, int count)
+{
+	struct nmea_epoch *epoch = &parser->epoch;
+	double value;
+
+	if (count < 8)
+		return;
+
+	/* Too late for this epoch, wait for VTG from now on */
+	if (epoch->emitted) {
+		parser->late_vtg = true;
+		return;
+	}
+
+	if (parse_double(fields[1], &value))
+		epoch->heading = value;
+	if (parse_double(fields[7], &value))
+		epoch->velocity = value * KMH_TO_MPS;
+
+	epoch->has_vtg = true;
+	epoch_complete(parser);
+}
+
+void nmea_parser_init(struct nmea_parser *parser, nmea_fix_func fix_cb, void *user_data)
+{
+	memset(parser, 0, sizeof(*parser));
+	parser->epoch.time = -1;
+	parser->fix_cb = fix_cb;
+	parser->user_data = user_data;
+}
+
+/* Checks and splits a single sentence without the line terminator. The
+ * sentence is modified in place. */
+bool nmea_parse_sentence(struct nmea_parser *parser, char *sentence, size_t length)
+{
+	char *fields[NMEA_MAX_FIELDS];
+	guint8 checksum = 0;
+	char *star = NULL;
+	int count = 0;
+	size_t n;
+
+	if (length < 7 || sentence[0] != '$')
+		return false;
+
+	for (n = 1; n < length; n++) {
+		if (sentence[n] == '*') {
+			star = &sentence[n];
+			break;
+		}
+		checksum ^= (guint8) sentence[n];
+	}
+
+	if (!star || star + 2 >= sentence + length ||
+		hex_value(star[1]) < 0 || hex_value(star[2]) < 0 ||
+		checksum != (hex_value(star[1]) << 4 | hex_value(star[2]))) {
+		parser->bad_checksums++;
+		return false;
+	}
+
+	*star = '\0';
+	fields[count++] = sentence + 1;
+	for (n = 1; &sentence[n] < star && count < NMEA_MAX_FIELDS; n++) {
+		if (sentence[n] == ',') {
+			sentence[n] = '\0';
+			fields[count++] = &sentence[n + 1];
+		}
+	}
+
+	/* Accept any talker, GP, GL, GN, ... */
+	if (strlen(fields[0]) != 5)
+		return false;
+
+	if (!strcmp(fields[0] + 2, "GGA"))
+		parse_gga(parser, fields, count);
+	else if (!strcmp(fields[0] + 2, "RMC"))
+		parse_rmc(parser, fields, count);
+	else if (!strcmp(fields[0] + 2, "GSA"))
+		parse_gsa(parser, fields, count);
+	else if (!strcmp(fields[0] + 2, "VTG"))
+		parse_vtg(parser, fields, count);
+
+	return true;
+}
+
+char *nmea_parser_get_buffer(struct nmea_parser *parser, size_t *space)
+{
+	/* Whatever filled the buffer without a line break isn't NMEA */
+	if (parser->length == sizeof(parser->buffer))
+		parser->length = 0;
+
+	*space = sizeof(parser->buffer) - parser->length;
+	return parser->buffer + parser->length;
+}
+
+void nmea_parser_commit(struct nmea_parser *parser, size_t length)
+{
+	char *start = parser->buffer;
+	char *end = parser->buffer + parser->length + length;
+	char *newline, *dollar;
+	size_t line_length;
+
+	while ((newline = memchr(start, '\n', end - start))) {
+		line_length = newline - start;
+		if (line_length > 0 && start[line_length - 1] == '\r')
+			line_length--;
+
+		/* Skip garbage in front of the sentence, e.g. after a resync */
+		dollar = memchr(start, '$', line_length);
+		if (dollar)
+			nmea_parse_sentence(parser, dollar, line_length - (dollar - start));
+
+		start = newline + 1;
+	}
+
+	parser->length = end - start;
+	if (parser->length > NMEA_MAX_SENTENCE)
+		parser->length = 0;
+	else if (start != parser->buffer)
+		memmove(parser->buffer, start, parser->length);
+}
+
+// vim:ts=4:sw=4:noexpandtab
@@ -0,0 +1,338 @@
+/* @@@LICENSE
+*
+* Copyright (c) 2026 LuneOS Project
+*
+* This file is part of location-service.
+*
+* location-service is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* location-service is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with location-service.  If not, see <http://www.gnu.org/licenses/>.
+*
+* LICENSE@@@ */
+
+/* Writes NMEA sentences to a pty so the NMEA provider and parser can be
+ * exercised without a receiver. With --check the synthetic track is fed
+ * straight into the parser instead and the parsed fixes are compared with
+ * the track. */
+
+#define _XOPEN_SOURCE 600
+
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <glib.h>
+
+#include "location_nmea.h"
+
+#define EARTH_RADIUS		6371000.0
+#define MPS_TO_KNOTS		(1 / 0.514444)
+#define MPS_TO_KMH			3.6
+
+/* Tolerances of the check, the sentences round to 0.0001 minutes, 0.1
+ * degrees and 0.1 knots */
+#define CHECK_DISTANCE		1.0
+#define CHECK_HEADING		0.1
+#define CHECK_VELOCITY		0.05
+/* Start of the checked track, well before now so fixes the parser had to
+ * date with the current time stand out */
+#define CHECK_START			1577836800
+
+static gint option_rate = 1;
+static gint option_corrupt = 0;
+static gdouble option_latitude = 52.52;
+static gdouble option_longitude = 13.405;
+static gdouble option_radius = 200;
+static gdouble option_speed = 5;
+static gchar *option_log = NULL;
+static gboolean option_late_vtg = FALSE;
+static gint option_check = 0;
+
+static GOptionEntry options[] = {
+	{ "rate", 'r', 0, G_OPTION_ARG_INT, &option_rate,
+				"Epochs, or lines of the log, per second", "N" },
+	{ "corrupt", 'c', 0, G_OPTION_ARG_INT, &option_corrupt,
+				"Damage every Nth sentence", "N" },
+	{ "latitude", 0, 0, G_OPTION_ARG_DOUBLE, &option_latitude,
+				"Latitude of the center of the track", "DEG" },
+	{ "longitude", 0, 0, G_OPTION_ARG_DOUBLE, &option_longitude,
+				"Longitude of the center of the track", "DEG" },
+	{ "radius", 0, 0, G_OPTION_ARG_DOUBLE, &option_radius,
+				"Radius of the track", "M" },
+	{ "speed", 0, 0, G_OPTION_ARG_DOUBLE, &option_speed,
+				"Speed along the track", "M/S" },
+	{ "log", 'l', 0, G_OPTION_ARG_FILENAME, &option_log,
+				"Write the lines of a NMEA log instead of a synthetic track", "FILE" },
+	{ "late-vtg", 0, 0, G_OPTION_ARG_NONE, &option_late_vtg,
+				"Send speed and course only in VTG after GGA and RMC", NULL },
+	{ "check", 0, 0, G_OPTION_ARG_INT, &option_check,
+				"Parse N epochs of the synthetic track and check the fixes", "N" },
+	{ NULL },
+};
+
+static unsigned int sentences;
+
+/* Epochs of the synthetic track as written, for --check */
+struct check_epoch {
+	double latitude;
+	double longitude;
+	double course;
+	unsigned int fixes;
+};
+
+static struct nmea_parser *check_parser;
+static struct check_epoch *check_epochs;
+static time_t check_start;
+static unsigned int check_failures;
+static unsigned int check_no_motion;
+static unsigned int check_undated;
+
+static void write_sentence(int fd, const char *body)
+{
+	char line[256];
+	guint8 checksum = 0;
+	const char *c;
+	int length;
+
+	for (c = body; *c; c++)
+		checksum ^= (guint8) *c;
+
+	length = snprintf(line, sizeof(line), "$%s*%02X\r\n", body, checksum);
+
+	sentences++;
+	if (option_corrupt > 0 && sentences % option_corrupt == 0)
+		line[length / 2] ^= 0x01;
+
+	if (check_parser) {
+		size_t space;
+		char *buffer = nmea_parser_get_buffer(check_parser, &space);
+
+		length = MIN((size_t) length, space);
+		memcpy(buffer, line, length);
+		nmea_parser_commit(check_parser, length);
+		return;
+	}
+
+	if (write(fd, line, length) < 0 && errno != EAGAIN)
+		g_warning("Failed to write sentence: %s", strerror(errno));
+}
+
+static void format_coordinate(char *buffer, size_t size, double value, int width, char positive, char negative)
+{
+	double degrees, minutes;
+
+	degrees = floor(fabs(value));
+	minutes = (fabs(value) - degrees) * 60;
+	snprintf(buffer, size, "%0*d%07.4f,%c", width, (int) degrees, minutes,
+			 value < 0 ? negative : positive);
+}
+
+static void write_epoch(int fd, double elapsed)
+{
+	char body[192], lat[32], lon[32], utc[16], date[8], motion[32] = ",";
+	double angle, latitude, longitude, course;
+	time_t now = check_parser ? check_start + (time_t) elapsed : time(NULL);
+	struct tm tm;
+
+	angle = elapsed * option_speed / option_radius;
+	latitude = option_latitude + (option_radius * sin(angle) / EARTH_RADIUS) * 180 / M_PI;
+	longitude = option_longitude + (option_radius * cos(angle) /
+		(EARTH_RADIUS * cos(option_latitude * M_PI / 180))) * 180 / M_PI;
+	course = fmod(360 - angle * 180 / M_PI, 360);
+
+	if (check_parser) {
+		struct check_epoch *epoch = &check_epochs[lround(elapsed * option_rate)];
+
+		epoch->latitude = latitude;
+		epoch->longitude = longitude;
+		epoch->course = course;
+	}
+
+	gmtime_r(&now, &tm);
+	snprintf(utc, sizeof(utc), "%02d%02d%05.2f", tm.tm_hour, tm.tm_min,
+			 tm.tm_sec + fmod(elapsed, 1));
+	snprintf(date, sizeof(date), "%02d%02d%02d", tm.tm_mday, tm.tm_mon + 1, tm.tm_year % 100);
+	format_coordinate(lat, sizeof(lat), latitude, 2, 'N', 'S');
+	format_coordinate(lon, sizeof(lon), longitude, 3, 'E', 'W');
+
+	snprintf(body, sizeof(body), "GPGGA,%s,%s,%s,1,08,0.9,34.5,M,46.9,M,,", utc, lat, lon);
+	write_sentence(fd, body);
+	snprintf(body, sizeof(body), "GPGSA,A,3,04,05,09,12,17,24,25,29,,,,,1.6,0.9,1.3");
+	write_sentence(fd, body);
+	if (!option_late_vtg)
+		snprintf(motion, sizeof(motion), "%.1f,%.1f", option_speed * MPS_TO_KNOTS, course);
+	snprintf(body, sizeof(body), "GPRMC,%s,A,%s,%s,%s,%s,,,A", utc, lat, lon, motion, date);
+	write_sentence(fd, body);
+	snprintf(body, sizeof(body), "GPVTG,%.1f,T,,M,%.1f,N,%.1f,K,A", course,
+			 option_speed * MPS_TO_KNOTS, option_speed * MPS_TO_KMH);
+	write_sentence(fd, body);
+}
+
+static void check_fail(const char *format, ...)
+{
+	va_list args;
+
+	va_start(args, format);
+	vfprintf(stderr, format, args);
+	va_end(args);
+	fputc('\n', stderr);
+
+	check_failures++;
+}
+
+static void check_fix_cb(const struct location_fix *fix, void *user_data)
+{
+	struct check_epoch *epoch;
+	double dx, dy, heading;
+	long index;
+
+	/* Without RMC the epoch has no date */
+	if (fix->timestamp >= time(NULL) - 1) {
+		check_undated++;
+		return;
+	}
+
+	index = lround((fix->timestamp - check_start) * option_rate);
+	if (index < 0 || index >= option_check) {
+		check_fail("Fix with unexpected timestamp %.2f", fix->timestamp);
+		return;
+	}
+
+	epoch = &check_epochs[index];
+	if (epoch->fixes++ > 0)
+		check_fail("Epoch %ld emitted more than once", index);
+
+	dy = (fix->latitude - epoch->latitude) * M_PI / 180 * EARTH_RADIUS;
+	dx = (fix->longitude - epoch->longitude) * M_PI / 180 * EARTH_RADIUS *
+		cos(epoch->latitude * M_PI / 180);
+	if (hypot(dx, dy) > CHECK_DISTANCE)
+		check_fail("Epoch %ld is %.2f m off the track", index, hypot(dx, dy));
+
+	if (fix->heading < 0 || fix->velocity < 0) {
+		check_no_motion++;
+		return;
+	}
+
+	heading = fabs(fmod(fix->heading - epoch->course + 540, 360) - 180);
+	if (heading > CHECK_HEADING || fabs(fix->velocity - option_speed) > CHECK_VELOCITY)
+		check_fail("Epoch %ld has heading %.1f and velocity %.2f, expected %.1f and %.2f",
+				   index, fix->heading, fix->velocity, epoch->course, option_speed);
+}
+
+/* Every damaged sentence has to be rejected and may cost at most the fix or
+ * the date of its epoch, and heading and speed of two epochs until a missing
+ * VTG is noticed. Only the very first fix may lack heading and speed otherwise, it
+ * is emitted before the parser learned that VTG comes last. */
+static int check_parser_fixes(void)
+{
+	struct nmea_parser parser;
+	unsigned int damaged, missing = 0;
+	int n;
+
+	check_epochs = g_new0(struct check_epoch, option_check);
+	check_start = CHECK_START;
+	check_parser = &parser;
+	nmea_parser_init(&parser, check_fix_cb, NULL);
+
+	for (n = 0; n < option_check; n++)
+		write_epoch(-1, (double) n / option_rate);
+
+	damaged = option_corrupt > 0 ? sentences / option_corrupt : 0;
+	for (n = 0; n < option_check; n++)
+		if (check_epochs[n].fixes == 0)
+			missing++;
+
+	if (parser.bad_checksums != damaged)
+		check_fail("%u damaged sentences but %u bad checksums", damaged, parser.bad_checksums);
+	if (missing > damaged)
+		check_fail("%u of %d epochs without a fix", missing, option_check);
+	if (check_undated > damaged)
+		check_fail("%u fixes without a date", check_undated);
+	if (check_no_motion > 1 + 2 * damaged)
+		check_fail("%u fixes without heading and speed", check_no_motion);
+
+	printf("%d epochs, %u fixes, %u bad checksums, %u failures\n", option_check,
+		   option_check - missing, parser.bad_checksums, check_failures);
+	g_free(check_epochs);
+
+	return check_failures ? 1 : 0;
+}
+
+int main(int argc, char **argv)
+{
+	GOptionContext *context;
+	GError *err = NULL;
+	FILE *log = NULL;
+	char line[256];
+	double elapsed = 0;
+	size_t length;
+	int fd;
+
+	context = g_option_context_new(NULL);
+	g_option_context_add_main_entries(context, options, NULL);
+	if (!g_option_context_parse(context, &argc, &argv, &err)) {
+		g_printerr("%s\n", err->message);
+		g_error_free(err);
+		exit(1);
+	}
+	g_option_context_free(context);
+
+	if (option_rate < 1)
+		option_rate = 1;
+
+	if (option_check > 0)
+		return check_parser_fixes();
+
+	if (option_log && !(log = fopen(option_log, "r"))) {
+		g_printerr("Failed to open %s: %s\n", option_log, strerror(errno));
+		exit(1);
+	}
+
+	fd = posix_openpt(O_RDWR | O_NOCTTY);
+	if (fd < 0 || grantpt(fd) < 0 || unlockpt(fd) < 0) {
+		g_printerr("Failed to create a pty: %s\n", strerror(errno));
+		exit(1);
+	}
+
+	printf("%s\n", ptsname(fd));
+	fflush(stdout);
+
+	for (;;) {
+		if (log) {
+			if (!fgets(line, sizeof(line), log)) {
+				rewind(log);
+				continue;
+			}
+
+			/* Sentences of the log are written again with a fresh checksum */
+			length = strcspn(line, "*\r\n");
+			line[length] = '\0';
+			if (line[0] == '$')
+				write_sentence(fd, line + 1);
+		}
+		else {
+			write_epoch(fd, elapsed);
+		}
+
+		elapsed += 1.0 / option_rate;
+		g_usleep(G_USEC_PER_SEC / option_rate);
+	}
+
+	return 0;
+}
+
+// vim:ts=4:sw=4:noexpandtab
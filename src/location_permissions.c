@@ -0,0 +1,185 @@
+/* @@@LICENSE
+*
+* Copyright (c) 2026 LuneOS Project
+*
+* This file is part of location-service.
+*
+* location-service is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* location-service is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with location-service.  If not, see <http://www.gnu.org/licenses/>.
+*
+* LICENSE@@@ */
+
+#include "location_permissions.h"
+#include "location_state.h"
+
+#define LOCATION_PERMISSIONS_FILE	"permissions"
+#define LOCATION_PERMISSIONS_GROUP	"decisions"
+
+struct location_permissions {
+	GHashTable *decisions;
+	bool dirty;
+	guint flush_timeout;
+};
+
+/* Only these decisions survive a restart, ALLOWED is for this run only */
+static const char *permission_names[] = {
+	[LOCATION_PERMISSION_ALLOWED_ALWAYS] = "always",
+	[LOCATION_PERMISSION_DENIED] = "denied",
+	[LOCATION_PERMISSION_BLACKLISTED] = "blacklisted",
+};
+
+static bool permission_is_persistent(LocationPermission permission)
+{
+	return permission == LOCATION_PERMISSION_ALLOWED_ALWAYS ||
+		permission == LOCATION_PERMISSION_DENIED ||
+		permission == LOCATION_PERMISSION_BLACKLISTED;
+}
+
+static LocationPermission permission_from_name(const char *name)
+{
+	int permission;
+
+	for (permission = 0; permission < G_N_ELEMENTS(permission_names); permission++) {
+		if (permission_names[permission] && !g_strcmp0(permission_names[permission], name))
+			return permission;
+	}
+
+	return LOCATION_PERMISSION_UNDECIDED;
+}
+
+static void permissions_load(struct location_permissions *permissions)
+{
+	GKeyFile *keyfile;
+	gchar **app_ids;
+	gchar *name;
+	gsize n, length = 0;
+	LocationPermission permission;
+
+	keyfile = location_state_load(LOCATION_PERMISSIONS_FILE);
+
+	app_ids = g_key_file_get_keys(keyfile, LOCATION_PERMISSIONS_GROUP, &length, NULL);
+	for (n = 0; app_ids && n < length; n++) {
+		name = g_key_file_get_string(keyfile, LOCATION_PERMISSIONS_GROUP, app_ids[n], NULL);
+		permission = permission_from_name(name);
+		if (permission != LOCATION_PERMISSION_UNDECIDED)
+			g_hash_table_replace(permissions->decisions, g_strdup(app_ids[n]),
+			                     GINT_TO_POINTER(permission));
+		g_free(name);
+	}
+	g_strfreev(app_ids);
+
+	g_key_file_free(keyfile);
+}
+
+static void permissions_save(struct location_permissions *permissions)
+{
+	GKeyFile *keyfile;
+	GHashTableIter iter;
+	gpointer key, value;
+
+	keyfile = g_key_file_new();
+
+	g_hash_table_iter_init(&iter, permissions->decisions);
+	while (g_hash_table_iter_next(&iter, &key, &value)) {
+		if (permission_is_persistent(GPOINTER_TO_INT(value)))
+			g_key_file_set_string(keyfile, LOCATION_PERMISSIONS_GROUP, key,
+			                      permission_names[GPOINTER_TO_INT(value)]);
+	}
+
+	if (location_state_save(LOCATION_PERMISSIONS_FILE, keyfile))
+		permissions->dirty = false;
+
+	g_key_file_free(keyfile);
+}
+
+static gboolean permissions_flush_timeout_cb(gpointer user_data)
+{
+	struct location_permissions *permissions = user_data;
+
+	permissions->flush_timeout = 0;
+	permissions_save(permissions);
+
+	return FALSE;
+}
+
+struct location_permissions *location_permissions_new(void)
+{
+	struct location_permissions *permissions;
+
+	permissions = g_new0(struct location_permissions, 1);
+	permissions->decisions = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+
+	permissions_load(permissions);
+
+	return permissions;
+}
+
+void location_permissions_free(struct location_permissions *permissions)
+{
+	if (!permissions)
+		return;
+
+	location_permissions_flush(permissions);
+	g_hash_table_destroy(permissions->decisions);
+	g_free(permissions);
+}
+
+void location_permissions_flush(struct location_permissions *permissions)
+{
+	if (permissions->flush_timeout) {
+		g_source_remove(permissions->flush_timeout);
+		permissions->flush_timeout = 0;
+	}
+
+	if (permissions->dirty)
+		permissions_save(permissions);
+}
+
+LocationPermission location_permissions_lookup(struct location_permissions *permissions, const char *app_id)
+{
+	if (!app_id)
+		return LOCATION_PERMISSION_UNDECIDED;
+
+	return GPOINTER_TO_INT(g_hash_table_lookup(permissions->decisions, app_id));
+}
+
+bool location_permissions_set(struct location_permissions *permissions, const char *app_id,
+                              LocationPermission permission)
+{
+	LocationPermission old_permission;
+
+	/* App ids end up as key file keys */
+	if (!app_id || app_id[0] == '\0' || strpbrk(app_id, "=[]#\n\r"))
+		return false;
+
+	old_permission = location_permissions_lookup(permissions, app_id);
+	if (old_permission == permission)
+		return true;
+
+	if (permission == LOCATION_PERMISSION_UNDECIDED)
+		g_hash_table_remove(permissions->decisions, app_id);
+	else
+		g_hash_table_replace(permissions->decisions, g_strdup(app_id), GINT_TO_POINTER(permission));
+
+	if (!permission_is_persistent(old_permission) && !permission_is_persistent(permission))
+		return true;
+
+	permissions->dirty = true;
+	if (!permissions->flush_timeout)
+		permissions->flush_timeout = g_timeout_add_seconds(LOCATION_PERMISSIONS_FLUSH_DELAY,
+		                                                   permissions_flush_timeout_cb, permissions);
+
+	return true;
+}
+
+// vim:ts=4:sw=4:noexpandtab
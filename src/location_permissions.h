@@ -0,0 +1,52 @@
+/* @@@LICENSE
+*
+* Copyright (c) 2026 LuneOS Project
+*
+* This file is part of location-service.
+*
+* location-service is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* location-service is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with location-service.  If not, see <http://www.gnu.org/licenses/>.
+*
+* LICENSE@@@ */
+
+#ifndef LOCATION_PERMISSIONS_H_
+#define LOCATION_PERMISSIONS_H_
+
+#include <stdbool.h>
+#include <glib.h>
+
+/* Seconds a changed decision may stay in memory before it is written */
+#define LOCATION_PERMISSIONS_FLUSH_DELAY	2
+
+typedef enum {
+	LOCATION_PERMISSION_UNDECIDED = 0,
+	/* Allowed until the service restarts */
+	LOCATION_PERMISSION_ALLOWED,
+	LOCATION_PERMISSION_ALLOWED_ALWAYS,
+	LOCATION_PERMISSION_DENIED,
+	LOCATION_PERMISSION_BLACKLISTED,
+} LocationPermission;
+
+struct location_permissions;
+
+struct location_permissions *location_permissions_new(void);
+void location_permissions_free(struct location_permissions *permissions);
+void location_permissions_flush(struct location_permissions *permissions);
+
+LocationPermission location_permissions_lookup(struct location_permissions *permissions, const char *app_id);
+bool location_permissions_set(struct location_permissions *permissions, const char *app_id,
+                              LocationPermission permission);
+
+#endif
+
+// vim:ts=4:sw=4:noexpandtab
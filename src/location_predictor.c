@@ -0,0 +1,163 @@
+/* @@@LICENSE
+*
+* Copyright (c) 2026 LuneOS Project
+*
+* This file is part of location-service.
+*
+* location-service is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* location-service is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with location-service.  If not, see <http://www.gnu.org/licenses/>.
+*
+* LICENSE@@@ */
+
+
+#include <math.h>
+#include <string.h>
+
+#include "location_predictor.h"
+
+#define METERS_PER_DEGREE	111320.0
+
+void location_predictor_reset(struct location_predictor *predictor)
+{
+	memset(predictor, 0, sizeof(*predictor));
+}
+
+/* Newest entry last */
+void location_predictor_add(struct location_predictor *predictor, const struct location_fix *fix, gint64 time)
+{
+	if (predictor->count == G_N_ELEMENTS(predictor->entries)) {
+		memmove(&predictor->entries[0], &predictor->entries[1],
+		        sizeof(predictor->entries) - sizeof(predictor->entries[0]));
+		predictor->count--;
+	}
+
+	predictor->entries[predictor->count].fix = *fix;
+	predictor->entries[predictor->count].time = time;
+	predictor->count++;
+}
+
+/* Velocity in meters per second east and north from a to b */
+static bool segment_velocity(const struct location_predictor_entry *a, const struct location_predictor_entry *b,
+                             double *east, double *north)
+{
+	double dt = (b->time - a->time) / (double) G_USEC_PER_SEC;
+
+	if (dt <= 0)
+		return false;
+
+	*east = (b->fix.longitude - a->fix.longitude) * cos(b->fix.latitude * M_PI / 180) * METERS_PER_DEGREE / dt;
+	*north = (b->fix.latitude - a->fix.latitude) * METERS_PER_DEGREE / dt;
+
+	return true;
+}
+
+static void move(struct location_fix *fix, double east, double north, double seconds)
+{
+	fix->latitude += north * seconds / METERS_PER_DEGREE;
+	fix->longitude += east * seconds / (METERS_PER_DEGREE * MAX(cos(fix->latitude * M_PI / 180), 0.01));
+	if (fix->longitude > 180)
+		fix->longitude -= 360;
+	else if (fix->longitude < -180)
+		fix->longitude += 360;
+}
+
+static void set_motion(struct location_fix *fix, double east, double north)
+{
+	fix->velocity = sqrt(east * east + north * north);
+	fix->heading = fmod(atan2(east, north) * 180 / M_PI + 360, 360);
+}
+
+static bool extrapolate(struct location_predictor *predictor, gint64 time, struct location_fix *fix)
+{
+	const struct location_predictor_entry *last = &predictor->entries[predictor->count - 1];
+	double east, north, previous_east, previous_north, seconds;
+
+	if (time - last->time > LOCATION_PREDICTOR_HORIZON ||
+		!segment_velocity(&predictor->entries[predictor->count - 2], last, &east, &north))
+		return false;
+
+	/* Averaging with the segment before damps the noise of single fixes */
+	if (predictor->count == 3 &&
+		segment_velocity(&predictor->entries[0], &predictor->entries[1], &previous_east, &previous_north)) {
+		east = (east * 2 + previous_east) / 3;
+		north = (north * 2 + previous_north) / 3;
+	}
+
+	seconds = MAX(time - last->time, 0) / (double) G_USEC_PER_SEC;
+	*fix = last->fix;
+	move(fix, east, north, seconds);
+	set_motion(fix, east, north);
+	fix->timestamp = last->fix.timestamp + seconds;
+
+	return true;
+}
+
+static bool interpolate(struct location_predictor *predictor, gint64 time, struct location_fix *fix)
+{
+	const struct location_predictor_entry *last = &predictor->entries[predictor->count - 1];
+	const struct location_predictor_entry *previous = &predictor->entries[predictor->count - 2];
+	gint64 interval = last->time - previous->time;
+	double east, north, ratio;
+
+	if (interval <= 0 || time - last->time > interval)
+		return false;
+
+	ratio = CLAMP((time - interval - previous->time) / (double) interval, 0, 1);
+	if (!segment_velocity(previous, last, &east, &north))
+		return false;
+
+	*fix = previous->fix;
+	move(fix, east, north, ratio * interval / G_USEC_PER_SEC);
+	set_motion(fix, east, north);
+	fix->horiz_accuracy = MAX(previous->fix.horiz_accuracy, last->fix.horiz_accuracy);
+	fix->timestamp = previous->fix.timestamp + ratio * (last->fix.timestamp - previous->fix.timestamp);
+
+	return true;
+}
+
+/* Returns false when there is nothing sensible to estimate: fewer than two
+ * fixes or too long since the last one */
+bool location_predictor_estimate(struct location_predictor *predictor, enum location_prediction_mode mode,
+                                 gint64 time, struct location_fix *fix)
+{
+	if (predictor->count < 2)
+		return false;
+
+	if (mode == LOCATION_PREDICTION_INTERPOLATE)
+		return interpolate(predictor, time, fix);
+
+	return extrapolate(predictor, time, fix);
+}
+
+/* Time up to which location_predictor_estimate() has an estimate, 0 when
+ * it has none at all */
+gint64 location_predictor_valid_until(const struct location_predictor *predictor,
+                                      enum location_prediction_mode mode)
+{
+	const struct location_predictor_entry *last, *previous;
+
+	if (predictor->count < 2)
+		return 0;
+
+	last = &predictor->entries[predictor->count - 1];
+	previous = &predictor->entries[predictor->count - 2];
+	if (last->time <= previous->time)
+		return 0;
+
+	if (mode == LOCATION_PREDICTION_INTERPOLATE)
+		return last->time + (last->time - previous->time);
+
+	return last->time + LOCATION_PREDICTOR_HORIZON;
+}
+
+// vim:ts=4:sw=4:noexpandtab
@@ -0,0 +1,65 @@
+/* @@@LICENSE
+*
+* Copyright (c) 2026 LuneOS Project
+*
+* This file is part of location-service.
+*
+* location-service is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* location-service is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with location-service.  If not, see <http://www.gnu.org/licenses/>.
+*
+* LICENSE@@@ */
+
+
+#ifndef LOCATION_PREDICTOR_H_
+#define LOCATION_PREDICTOR_H_
+
+#include <stdbool.h>
+#include <glib.h>
+
+#include "location_common.h"
+
+/* Estimates positions between and after real fixes from the last three
+ * fixes of the session. Times are monotonic, in microseconds. */
+
+/* Extrapolation ends this long after the latest fix, no estimate is
+ * better than one drifting away while the fixes stopped */
+#define LOCATION_PREDICTOR_HORIZON		3000000
+
+enum location_prediction_mode {
+	/* Ahead of the latest fix along the current velocity */
+	LOCATION_PREDICTION_EXTRAPOLATE,
+	/* One fix interval behind, between the last two fixes, which never
+	 * overshoots */
+	LOCATION_PREDICTION_INTERPOLATE,
+};
+
+struct location_predictor_entry {
+	struct location_fix fix;
+	gint64 time;
+};
+
+struct location_predictor {
+	struct location_predictor_entry entries[3];
+	guint count;
+};
+
+void location_predictor_reset(struct location_predictor *predictor);
+void location_predictor_add(struct location_predictor *predictor, const struct location_fix *fix, gint64 time);
+bool location_predictor_estimate(struct location_predictor *predictor, enum location_prediction_mode mode,
+                                 gint64 time, struct location_fix *fix);
+gint64 location_predictor_valid_until(const struct location_predictor *predictor,
+                                      enum location_prediction_mode mode);
+
+#endif
+
+// vim:ts=4:sw=4:noexpandtab
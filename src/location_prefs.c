@@ -0,0 +1,250 @@
+/* @@@LICENSE
+*
+* Copyright (c) 2026 LuneOS Project
+*
+* This file is part of location-service.
+*
+* location-service is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* location-service is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with location-service.  If not, see <http://www.gnu.org/licenses/>.
+*
+* LICENSE@@@ */
+
+#include "location_prefs.h"
+#include "location_state.h"
+
+#define LOCATION_PREFS_FILE		"preferences"
+#define LOCATION_PREFS_GROUP	"preferences"
+#define LOCATION_PREFS_WEB_GROUP	"webSettings"
+
+static const struct {
+	const char *key;
+	bool default_value;
+} pref_info[LOCATION_PREF_COUNT] = {
+	[LOCATION_PREF_USE_GPS] = { "useGps", true },
+	[LOCATION_PREF_AUTO_LOCATE] = { "autoLocate", true },
+	[LOCATION_PREF_USE_GOOGLE] = { "useGoogle", true },
+	[LOCATION_PREF_GEOTAG_PHOTOS] = { "geotagPhotos", true },
+	[LOCATION_PREF_USE_BACKGROUND_DATA_COLLECTION] = { "useBackgroundDataCollection", false },
+	[LOCATION_PREF_TERMS_ACCEPTED] = { "termsOfUseAccepted", false },
+};
+
+struct location_prefs {
+	bool values[LOCATION_PREF_COUNT];
+	GHashTable *web_settings;
+	bool dirty;
+	guint flush_timeout;
+	location_prefs_changed_func changed_cb;
+	void *user_data;
+};
+
+static void prefs_load(struct location_prefs *prefs)
+{
+	GKeyFile *keyfile;
+	GError *error = NULL;
+	gchar **domains;
+	gsize n, length = 0;
+	bool value;
+	int pref;
+
+	keyfile = location_state_load(LOCATION_PREFS_FILE);
+
+	for (pref = 0; pref < LOCATION_PREF_COUNT; pref++) {
+		value = g_key_file_get_boolean(keyfile, LOCATION_PREFS_GROUP, pref_info[pref].key, &error);
+		if (error) {
+			g_clear_error(&error);
+			value = pref_info[pref].default_value;
+		}
+		prefs->values[pref] = value;
+	}
+
+	domains = g_key_file_get_keys(keyfile, LOCATION_PREFS_WEB_GROUP, &length, NULL);
+	for (n = 0; domains && n < length; n++) {
+		value = g_key_file_get_boolean(keyfile, LOCATION_PREFS_WEB_GROUP, domains[n], NULL);
+		g_hash_table_replace(prefs->web_settings, g_strdup(domains[n]), GINT_TO_POINTER(value));
+	}
+	g_strfreev(domains);
+
+	g_key_file_free(keyfile);
+}
+
+static void prefs_save(struct location_prefs *prefs)
+{
+	GKeyFile *keyfile;
+	GHashTableIter iter;
+	gpointer key, value;
+	int pref;
+
+	keyfile = g_key_file_new();
+
+	for (pref = 0; pref < LOCATION_PREF_COUNT; pref++)
+		g_key_file_set_boolean(keyfile, LOCATION_PREFS_GROUP, pref_info[pref].key, prefs->values[pref]);
+
+	g_hash_table_iter_init(&iter, prefs->web_settings);
+	while (g_hash_table_iter_next(&iter, &key, &value))
+		g_key_file_set_boolean(keyfile, LOCATION_PREFS_WEB_GROUP, key, GPOINTER_TO_INT(value));
+
+	if (location_state_save(LOCATION_PREFS_FILE, keyfile))
+		prefs->dirty = false;
+
+	g_key_file_free(keyfile);
+}
+
+static gboolean prefs_flush_timeout_cb(gpointer user_data)
+{
+	struct location_prefs *prefs = user_data;
+
+	prefs->flush_timeout = 0;
+	prefs_save(prefs);
+
+	return FALSE;
+}
+
+/* All writes within LOCATION_PREFS_FLUSH_DELAY end up in one save */
+static void prefs_changed(struct location_prefs *prefs, int pref)
+{
+	prefs->dirty = true;
+	if (!prefs->flush_timeout)
+		prefs->flush_timeout = g_timeout_add_seconds(LOCATION_PREFS_FLUSH_DELAY,
+		                                             prefs_flush_timeout_cb, prefs);
+
+	if (prefs->changed_cb)
+		prefs->changed_cb(pref, prefs->user_data);
+}
+
+struct location_prefs *location_prefs_new(location_prefs_changed_func changed_cb, void *user_data)
+{
+	struct location_prefs *prefs;
+
+	prefs = g_new0(struct location_prefs, 1);
+	prefs->web_settings = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+	prefs->changed_cb = changed_cb;
+	prefs->user_data = user_data;
+
+	prefs_load(prefs);
+
+	return prefs;
+}
+
+void location_prefs_free(struct location_prefs *prefs)
+{
+	if (!prefs)
+		return;
+
+	location_prefs_flush(prefs);
+	g_hash_table_destroy(prefs->web_settings);
+	g_free(prefs);
+}
+
+void location_prefs_flush(struct location_prefs *prefs)
+{
+	if (prefs->flush_timeout) {
+		g_source_remove(prefs->flush_timeout);
+		prefs->flush_timeout = 0;
+	}
+
+	if (prefs->dirty)
+		prefs_save(prefs);
+}
+
+const char *location_prefs_get_key(enum location_pref pref)
+{
+	return pref_info[pref].key;
+}
+
+int location_prefs_lookup_key(const char *key)
+{
+	int pref;
+
+	for (pref = 0; pref < LOCATION_PREF_COUNT; pref++) {
+		if (!g_strcmp0(pref_info[pref].key, key))
+			return pref;
+	}
+
+	return -1;
+}
+
+bool location_prefs_get(struct location_prefs *prefs, enum location_pref pref)
+{
+	return prefs->values[pref];
+}
+
+void location_prefs_set(struct location_prefs *prefs, enum location_pref pref, bool value)
+{
+	if (prefs->values[pref] == value)
+		return;
+
+	prefs->values[pref] = value;
+	prefs_changed(prefs, pref);
+}
+
+static bool domain_is_valid(const char *domain)
+{
+	return domain && domain[0] != '\0' && !strpbrk(domain, "=[]#\n\r");
+}
+
+bool location_prefs_set_web_setting(struct location_prefs *prefs, const char *domain, bool allowed)
+{
+	gpointer old_value;
+
+	if (!domain_is_valid(domain))
+		return false;
+
+	if (g_hash_table_lookup_extended(prefs->web_settings, domain, NULL, &old_value) &&
+		GPOINTER_TO_INT(old_value) == allowed)
+		return true;
+
+	g_hash_table_replace(prefs->web_settings, g_strdup(domain), GINT_TO_POINTER(allowed));
+	prefs_changed(prefs, LOCATION_PREF_WEB_SETTINGS);
+
+	return true;
+}
+
+void location_prefs_clear_web_setting(struct location_prefs *prefs, const char *domain)
+{
+	if (domain) {
+		if (!g_hash_table_remove(prefs->web_settings, domain))
+			return;
+	}
+	else {
+		if (g_hash_table_size(prefs->web_settings) == 0)
+			return;
+		g_hash_table_remove_all(prefs->web_settings);
+	}
+
+	prefs_changed(prefs, LOCATION_PREF_WEB_SETTINGS);
+}
+
+jvalue_ref location_prefs_to_json(struct location_prefs *prefs)
+{
+	jvalue_ref prefs_obj = NULL;
+	jvalue_ref web_obj = NULL;
+	GHashTableIter iter;
+	gpointer key, value;
+	int pref;
+
+	prefs_obj = jobject_create();
+
+	for (pref = 0; pref < LOCATION_PREF_COUNT; pref++)
+		jobject_put(prefs_obj, jstring_create(pref_info[pref].key),
+		            jboolean_create(prefs->values[pref]));
+
+	web_obj = jobject_create();
+	g_hash_table_iter_init(&iter, prefs->web_settings);
+	while (g_hash_table_iter_next(&iter, &key, &value))
+		jobject_put(web_obj, jstring_create(key), jboolean_create(GPOINTER_TO_INT(value)));
+	jobject_put(prefs_obj, J_CSTR_TO_JVAL("webSettings"), web_obj);
+
+	return prefs_obj;
+}
+
+// vim:ts=4:sw=4:noexpandtab
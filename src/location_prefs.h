@@ -0,0 +1,66 @@
+/* @@@LICENSE
+*
+* Copyright (c) 2026 LuneOS Project
+*
+* This file is part of location-service.
+*
+* location-service is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* location-service is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with location-service.  If not, see <http://www.gnu.org/licenses/>.
+*
+* LICENSE@@@ */
+
+#ifndef LOCATION_PREFS_H_
+#define LOCATION_PREFS_H_
+
+#include <stdbool.h>
+#include <glib.h>
+#include <pbnjson.h>
+
+/* Seconds a changed preference may stay in memory before it is written */
+#define LOCATION_PREFS_FLUSH_DELAY	2
+
+enum location_pref {
+	LOCATION_PREF_USE_GPS = 0,
+	LOCATION_PREF_AUTO_LOCATE,
+	LOCATION_PREF_USE_GOOGLE,
+	LOCATION_PREF_GEOTAG_PHOTOS,
+	LOCATION_PREF_USE_BACKGROUND_DATA_COLLECTION,
+	LOCATION_PREF_TERMS_ACCEPTED,
+	LOCATION_PREF_COUNT
+};
+
+/* Pseudo preference passed to the change callback for web settings */
+#define LOCATION_PREF_WEB_SETTINGS	LOCATION_PREF_COUNT
+
+struct location_prefs;
+
+typedef void (*location_prefs_changed_func)(int pref, void *user_data);
+
+struct location_prefs *location_prefs_new(location_prefs_changed_func changed_cb, void *user_data);
+void location_prefs_free(struct location_prefs *prefs);
+void location_prefs_flush(struct location_prefs *prefs);
+
+const char *location_prefs_get_key(enum location_pref pref);
+int location_prefs_lookup_key(const char *key);
+
+bool location_prefs_get(struct location_prefs *prefs, enum location_pref pref);
+void location_prefs_set(struct location_prefs *prefs, enum location_pref pref, bool value);
+
+bool location_prefs_set_web_setting(struct location_prefs *prefs, const char *domain, bool allowed);
+void location_prefs_clear_web_setting(struct location_prefs *prefs, const char *domain);
+
+jvalue_ref location_prefs_to_json(struct location_prefs *prefs);
+
+#endif
+
+// vim:ts=4:sw=4:noexpandtab
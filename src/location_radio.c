@@ -0,0 +1,484 @@
+/* @@@LICENSE
+*
+* Copyright (c) 2026 LuneOS Project
+*
+* This file is part of location-service.
+*
+* location-service is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* location-service is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with location-service.  If not, see <http://www.gnu.org/licenses/>.
+*
+* LICENSE@@@ */
+
+
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <glib-unix.h>
+
+#include "location_radio.h"
+
+#define EARTH_RADIUS			6371000.0
+/* Matches further than this beyond both ranges from the strongest match
+ * are taken for moved access points */
+#define RADIO_OUTLIER_MARGIN	1000.0
+/* Signal assumed for transmitters reported without one, in dBm */
+#define RADIO_DEFAULT_SIGNAL	-80
+/* A single access point is too easily one which moved */
+#define RADIO_MIN_WIFI_MATCHES	2
+#define RADIO_MAX_LINE			128
+/* Seconds to wait before reopening a FIFO or socket whose writer went away,
+ * doubled after every failed attempt up to RADIO_REOPEN_MAX_DELAY */
+#define RADIO_REOPEN_DELAY		1
+#define RADIO_REOPEN_MAX_DELAY	64
+
+struct radio_match {
+	const struct location_radio_entry *entry;
+	double weight;
+	bool wifi;
+};
+
+struct location_radio {
+	void *mapping;
+	size_t size;
+	const uint64_t *keys;
+	const struct location_radio_entry *entries;
+	uint32_t num_entries;
+
+	/* Scans being read, see location_radio_watch() */
+	char *source;
+	int fd;
+	bool inherited;
+	bool reopen;
+	bool open_failed;
+	guint watch;
+	guint reopen_timeout;
+	guint reopen_delay;
+	char buffer[RADIO_MAX_LINE * 4];
+	size_t length;
+	struct location_radio_observation observations[LOCATION_RADIO_MAX_OBSERVATIONS];
+	unsigned int num_observations;
+	location_radio_fix_func fix_cb;
+	void *user_data;
+};
+
+/* Checks the whole map once so lookups can trust it */
+static bool radio_map_valid(struct location_radio *radio)
+{
+	const struct location_radio_entry *entry;
+	uint32_t n;
+
+	for (n = 0; n < radio->num_entries; n++) {
+		entry = &radio->entries[n];
+		if ((n > 0 && radio->keys[n] <= radio->keys[n - 1]) ||
+			!(entry->latitude >= -90 && entry->latitude <= 90) ||
+			!(entry->longitude >= -180 && entry->longitude <= 180) ||
+			!(entry->range > 0))
+			return false;
+	}
+
+	return true;
+}
+
+struct location_radio *location_radio_new(const char *path)
+{
+	struct location_radio *radio = NULL;
+	const struct location_radio_header *header;
+	struct stat st;
+	void *mapping;
+	int fd;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		g_warning("Failed to open radio map %s: %s", path, strerror(errno));
+		return NULL;
+	}
+
+	if (fstat(fd, &st) < 0 || st.st_size < (off_t) sizeof(struct location_radio_header))
+		goto invalid;
+
+	mapping = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	if (mapping == MAP_FAILED) {
+		g_warning("Failed to map radio map %s: %s", path, strerror(errno));
+		goto out;
+	}
+
+	header = mapping;
+	if (memcmp(header->magic, LOCATION_RADIO_MAGIC, sizeof(header->magic)) ||
+		header->version != LOCATION_RADIO_VERSION ||
+		(uint64_t) st.st_size != sizeof(*header) +
+		(sizeof(uint64_t) + sizeof(struct location_radio_entry)) * (uint64_t) header->num_entries) {
+		munmap(mapping, st.st_size);
+		goto invalid;
+	}
+
+	radio = g_new0(struct location_radio, 1);
+	radio->mapping = mapping;
+	radio->size = st.st_size;
+	radio->num_entries = header->num_entries;
+	radio->keys = (const uint64_t *) (header + 1);
+	radio->entries = (const struct location_radio_entry *) (radio->keys + header->num_entries);
+	radio->fd = -1;
+
+	if (!radio_map_valid(radio)) {
+		location_radio_free(radio);
+		radio = NULL;
+		goto invalid;
+	}
+
+	goto out;
+
+invalid:
+	g_warning("Radio map %s is invalid", path);
+out:
+	close(fd);
+	return radio;
+}
+
+static void radio_close(struct location_radio *radio)
+{
+	if (radio->watch) {
+		g_source_remove(radio->watch);
+		radio->watch = 0;
+	}
+
+	if (radio->fd >= 0 && !radio->inherited)
+		close(radio->fd);
+	radio->fd = -1;
+}
+
+void location_radio_free(struct location_radio *radio)
+{
+	if (!radio)
+		return;
+
+	if (radio->reopen_timeout)
+		g_source_remove(radio->reopen_timeout);
+	radio_close(radio);
+	munmap(radio->mapping, radio->size);
+	g_free(radio->source);
+	g_free(radio);
+}
+
+static const struct location_radio_entry *radio_find(struct location_radio *radio, uint64_t key)
+{
+	uint32_t low = 0, high = radio->num_entries, middle;
+
+	while (low < high) {
+		middle = low + (high - low) / 2;
+		if (radio->keys[middle] < key)
+			low = middle + 1;
+		else
+			high = middle;
+	}
+
+	if (low < radio->num_entries && radio->keys[low] == key)
+		return &radio->entries[low];
+
+	return NULL;
+}
+
+/* Meters north and east of the origin, good enough over the few kilometers
+ * transmitters of one scan are apart */
+static void radio_offset(const struct location_radio_entry *origin, double latitude, double longitude,
+                         double *north, double *east)
+{
+	double delta = longitude - origin->longitude;
+
+	if (delta > 180)
+		delta -= 360;
+	else if (delta < -180)
+		delta += 360;
+
+	*north = (latitude - origin->latitude) * M_PI / 180 * EARTH_RADIUS;
+	*east = delta * M_PI / 180 * EARTH_RADIUS * cos(origin->latitude * M_PI / 180);
+}
+
+/* The weighted centroid of the transmitters heard. Stronger signals and
+ * smaller ranges weigh more; Wi-Fi is used alone once enough access points
+ * are known, otherwise the cells are. */
+bool location_radio_locate(struct location_radio *radio, const struct location_radio_observation *observations,
+                           unsigned int count, struct location_fix *fix, GClueAccuracyLevel *level)
+{
+	struct radio_match matches[LOCATION_RADIO_MAX_OBSERVATIONS];
+	const struct location_radio_entry *entry, *anchor = NULL;
+	double north, east, sum_weight = 0, sum_north = 0, sum_east = 0, sum_spread = 0;
+	double anchor_weight = 0, signal;
+	unsigned int n, num_matches = 0, num_wifi = 0;
+	bool use_wifi;
+
+	for (n = 0; n < count && num_matches < G_N_ELEMENTS(matches); n++) {
+		entry = radio_find(radio, observations[n].key);
+		if (!entry)
+			continue;
+
+		signal = observations[n].signal ? observations[n].signal : RADIO_DEFAULT_SIGNAL;
+		matches[num_matches].entry = entry;
+		matches[num_matches].weight = pow(10, signal / 20) / (entry->range * entry->range);
+		matches[num_matches].wifi = observations[n].key < (UINT64_C(1) << 48);
+		num_wifi += matches[num_matches].wifi;
+		num_matches++;
+	}
+
+	use_wifi = num_wifi >= RADIO_MIN_WIFI_MATCHES;
+	for (n = 0; n < num_matches; n++) {
+		if (matches[n].wifi == use_wifi && matches[n].weight > anchor_weight) {
+			anchor = matches[n].entry;
+			anchor_weight = matches[n].weight;
+		}
+	}
+	if (!anchor)
+		return false;
+
+	for (n = 0; n < num_matches; n++) {
+		entry = matches[n].entry;
+		if (matches[n].wifi != use_wifi)
+			continue;
+
+		radio_offset(anchor, entry->latitude, entry->longitude, &north, &east);
+		if (sqrt(north * north + east * east) > anchor->range + entry->range + RADIO_OUTLIER_MARGIN) {
+			matches[n].weight = 0;
+			continue;
+		}
+
+		sum_weight += matches[n].weight;
+		sum_north += matches[n].weight * north;
+		sum_east += matches[n].weight * east;
+	}
+
+	north = sum_north / sum_weight;
+	east = sum_east / sum_weight;
+
+	/* How far the transmitters reach around the centroid */
+	for (n = 0; n < num_matches; n++) {
+		double d_north, d_east;
+
+		entry = matches[n].entry;
+		if (matches[n].wifi != use_wifi || matches[n].weight == 0)
+			continue;
+
+		radio_offset(anchor, entry->latitude, entry->longitude, &d_north, &d_east);
+		d_north -= north;
+		d_east -= east;
+		sum_spread += matches[n].weight *
+			(d_north * d_north + d_east * d_east + entry->range * entry->range);
+	}
+
+	fix->latitude = anchor->latitude + north / EARTH_RADIUS * 180 / M_PI;
+	fix->longitude = anchor->longitude + east / (EARTH_RADIUS * cos(anchor->latitude * M_PI / 180)) * 180 / M_PI;
+	if (fix->longitude > 180)
+		fix->longitude -= 360;
+	else if (fix->longitude < -180)
+		fix->longitude += 360;
+	fix->horiz_accuracy = sqrt(sum_spread / sum_weight);
+	fix->altitude = -1;
+	fix->vert_accuracy = -1;
+	fix->heading = -1;
+	fix->velocity = -1;
+	fix->timestamp = g_get_real_time() / (double) G_USEC_PER_SEC;
+	fix->description = use_wifi ? "WiFi" : "3GPP";
+
+	if (fix->horiz_accuracy <= location_accuracy_bound(GCLUE_ACCURACY_LEVEL_NEIGHBORHOOD))
+		*level = GCLUE_ACCURACY_LEVEL_NEIGHBORHOOD;
+	else if (fix->horiz_accuracy <= location_accuracy_bound(GCLUE_ACCURACY_LEVEL_CITY))
+		*level = GCLUE_ACCURACY_LEVEL_CITY;
+	else
+		*level = GCLUE_ACCURACY_LEVEL_COUNTRY;
+
+	return true;
+}
+
+/* "wifi BSSID [SIGNAL]" or "cell MCC MNC LAC CID [SIGNAL]" adds a
+ * transmitter to the scan, an empty line ends it */
+static void radio_parse_line(struct location_radio *radio, const char *line)
+{
+	struct location_radio_observation *observation;
+	struct location_fix fix;
+	GClueAccuracyLevel level;
+	unsigned int mcc, mnc, lac, cid;
+	char bssid[18];
+	int signal = 0;
+
+	if (line[0] == '\0') {
+		if (radio->num_observations > 0 &&
+			location_radio_locate(radio, radio->observations, radio->num_observations, &fix, &level))
+			radio->fix_cb(level, &fix, radio->user_data);
+		radio->num_observations = 0;
+		return;
+	}
+
+	if (radio->num_observations == G_N_ELEMENTS(radio->observations))
+		return;
+
+	observation = &radio->observations[radio->num_observations];
+	if (sscanf(line, "wifi %17s %d", bssid, &signal) >= 1 &&
+		location_radio_key_from_bssid(bssid, &observation->key))
+		;
+	else if (sscanf(line, "cell %u %u %u %u %d", &mcc, &mnc, &lac, &cid, &signal) >= 4 &&
+	         location_radio_key_from_cell(mcc, mnc, lac, cid, &observation->key))
+		;
+	else
+		return;
+
+	observation->signal = signal;
+	radio->num_observations++;
+}
+
+static bool radio_open(struct location_radio *radio);
+
+static gboolean radio_reopen_cb(gpointer user_data)
+{
+	struct location_radio *radio = user_data;
+
+	radio->reopen_timeout = 0;
+	if (radio_open(radio))
+		return FALSE;
+
+	radio->reopen_delay = MIN(radio->reopen_delay * 2, RADIO_REOPEN_MAX_DELAY);
+	radio->reopen_timeout = g_timeout_add_seconds(radio->reopen_delay, radio_reopen_cb, radio);
+
+	return FALSE;
+}
+
+static gboolean radio_read_cb(gint fd, GIOCondition condition, gpointer user_data)
+{
+	struct location_radio *radio = user_data;
+	char *start, *end, *newline;
+	ssize_t length;
+
+	for (;;) {
+		/* Whatever filled the buffer without a line break is no scan */
+		if (radio->length == sizeof(radio->buffer))
+			radio->length = 0;
+
+		length = read(fd, radio->buffer + radio->length, sizeof(radio->buffer) - radio->length);
+		if (length <= 0)
+			break;
+
+		start = radio->buffer;
+		end = radio->buffer + radio->length + length;
+		while ((newline = memchr(start, '\n', end - start))) {
+			*newline = '\0';
+			if (newline > start && newline[-1] == '\r')
+				newline[-1] = '\0';
+			radio_parse_line(radio, start);
+			start = newline + 1;
+		}
+
+		radio->length = end - start;
+		memmove(radio->buffer, start, radio->length);
+	}
+
+	if (length < 0 && (errno == EAGAIN || errno == EINTR))
+		return TRUE;
+
+	/* End of a file ends its last line and scan as well */
+	if (radio->length > 0) {
+		radio->buffer[MIN(radio->length, sizeof(radio->buffer) - 1)] = '\0';
+		radio_parse_line(radio, radio->buffer);
+	}
+	radio_parse_line(radio, "");
+	radio->watch = 0;
+	radio_close(radio);
+	if (radio->reopen) {
+		radio->reopen_delay = RADIO_REOPEN_DELAY;
+		radio->reopen_timeout = g_timeout_add_seconds(radio->reopen_delay, radio_reopen_cb, radio);
+	}
+
+	return FALSE;
+}
+
+static int radio_connect(const char *path)
+{
+	struct sockaddr_un address;
+	int fd;
+
+	if (strlen(path) >= sizeof(address.sun_path))
+		return -1;
+
+	fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd < 0)
+		return -1;
+
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	strcpy(address.sun_path, path);
+	if (connect(fd, (struct sockaddr *) &address, sizeof(address)) < 0) {
+		close(fd);
+		return -1;
+	}
+
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+	return fd;
+}
+
+static bool radio_open(struct location_radio *radio)
+{
+	struct stat st;
+
+	if (g_str_has_prefix(radio->source, "fd:")) {
+		radio->fd = atoi(radio->source + 3);
+		radio->inherited = true;
+		fcntl(radio->fd, F_SETFL, fcntl(radio->fd, F_GETFL) | O_NONBLOCK);
+	}
+	else if (stat(radio->source, &st) == 0 && S_ISSOCK(st.st_mode)) {
+		radio->fd = radio_connect(radio->source);
+		radio->reopen = true;
+	}
+	else {
+		radio->fd = open(radio->source, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+		radio->reopen = radio->fd >= 0 && fstat(radio->fd, &st) == 0 && S_ISFIFO(st.st_mode);
+	}
+
+	/* Only changes are logged, not every retry */
+	if (radio->fd < 0) {
+		if (!radio->open_failed)
+			g_warning("Failed to open radio scans %s: %s", radio->source, strerror(errno));
+		radio->open_failed = true;
+		return false;
+	}
+
+	if (radio->open_failed)
+		g_message("Opened radio scans %s again", radio->source);
+	radio->open_failed = false;
+
+	radio->length = 0;
+	radio->num_observations = 0;
+	radio->watch = g_unix_fd_add(radio->fd, G_IO_IN | G_IO_HUP | G_IO_ERR, radio_read_cb, radio);
+
+	return true;
+}
+
+/* Reads scans from source, a file, FIFO or listening unix socket or, as
+ * "fd:N", the already open file descriptor N, and reports a fix for every
+ * scan which could be located. A FIFO or socket is reopened whenever its
+ * writer goes away. */
+bool location_radio_watch(struct location_radio *radio, const char *source, location_radio_fix_func fix_cb,
+                          void *user_data)
+{
+	radio->source = g_strdup(source);
+	radio->fix_cb = fix_cb;
+	radio->user_data = user_data;
+
+	return radio_open(radio);
+}
+
+// vim:ts=4:sw=4:noexpandtab
@@ -0,0 +1,115 @@
+/* @@@LICENSE
+*
+* Copyright (c) 2026 LuneOS Project
+*
+* This file is part of location-service.
+*
+* location-service is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* location-service is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with location-service.  If not, see <http://www.gnu.org/licenses/>.
+*
+* LICENSE@@@ */
+
+
+#ifndef LOCATION_RADIO_H_
+#define LOCATION_RADIO_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "location_common.h"
+
+/* Offline positioning from the Wi-Fi access points and cells in range,
+ * looked up in a radio map built by location-radiodb and mapped read-only
+ * by the service.
+ *
+ * Every transmitter has a 64 bit key. A Wi-Fi key is the BSSID, a cell key
+ * packs MCC (10 bits), MNC (10 bits), LAC/TAC (16 bits) and cell id (28
+ * bits) from the top down. Valid MCCs start at 200, so cell keys never
+ * collide with the 48 bit BSSIDs.
+ *
+ * After the header, all in host byte order:
+ *
+ *   uint64_t keys[num_entries]         ascending
+ *   struct location_radio_entry entries[num_entries] */
+
+#define LOCATION_RADIO_DB			"/usr/share/location-service/radio.db"
+#define LOCATION_RADIO_MAGIC		"LSRADIO"
+#define LOCATION_RADIO_VERSION		1
+
+/* The most transmitters taken from a single scan */
+#define LOCATION_RADIO_MAX_OBSERVATIONS	64
+
+struct location_radio_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t num_entries;
+};
+
+/* Estimated position of a transmitter and the radius in meters it was seen
+ * in */
+struct location_radio_entry {
+	float latitude;
+	float longitude;
+	float range;
+};
+
+struct location_radio_observation {
+	uint64_t key;
+	/* dBm, 0 when unknown */
+	int signal;
+};
+
+typedef void (*location_radio_fix_func)(GClueAccuracyLevel level, const struct location_fix *fix,
+                                        void *user_data);
+
+struct location_radio;
+
+/* Shared with location-radiodb, which doesn't link the service code */
+static inline bool location_radio_key_from_bssid(const char *bssid, uint64_t *key)
+{
+	unsigned int octets[6];
+	int n;
+
+	if (sscanf(bssid, "%2x:%2x:%2x:%2x:%2x:%2x%n", &octets[0], &octets[1], &octets[2],
+	           &octets[3], &octets[4], &octets[5], &n) != 6 || bssid[n] != '\0')
+		return false;
+
+	*key = 0;
+	for (n = 0; n < 6; n++)
+		*key = *key << 8 | octets[n];
+
+	return true;
+}
+
+static inline bool location_radio_key_from_cell(unsigned int mcc, unsigned int mnc, unsigned int lac,
+                                                unsigned int cid, uint64_t *key)
+{
+	if (mcc < 200 || mcc > 999 || mnc > 999 || lac > 0xffff || cid > 0xfffffff)
+		return false;
+
+	*key = (uint64_t) mcc << 54 | (uint64_t) mnc << 44 | (uint64_t) lac << 28 | cid;
+
+	return true;
+}
+
+struct location_radio *location_radio_new(const char *path);
+void location_radio_free(struct location_radio *radio);
+bool location_radio_locate(struct location_radio *radio, const struct location_radio_observation *observations,
+                           unsigned int count, struct location_fix *fix, GClueAccuracyLevel *level);
+bool location_radio_watch(struct location_radio *radio, const char *source, location_radio_fix_func fix_cb,
+                          void *user_data);
+
+#endif
+
+// vim:ts=4:sw=4:noexpandtab
@@ -0,0 +1,215 @@
+/* @@@LICENSE
+*
+* Copyright (c) 2026 LuneOS Project
+*
+* This file is part of location-service.
+*
+* location-service is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* location-service is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with location-service.  If not, see <http://www.gnu.org/licenses/>.
+*
+* LICENSE@@@ */
+
+
+/* Builds the radio map of location_radio.h from CSV exports of cell and
+ * Wi-Fi observations. Cell rows use the OpenCellID and Mozilla Location
+ * Service layout
+ *
+ *   radio,mcc,net,area,cell,unit,lon,lat,range,...
+ *
+ * and Wi-Fi rows are
+ *
+ *   wifi,bssid,lon,lat,range
+ *
+ * Header lines and rows which don't parse are skipped. A transmitter found
+ * more than once keeps the entry with the smallest range. */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+
+#include "location_radio.h"
+
+/* Ranges assumed when the export has none, in meters */
+#define DEFAULT_WIFI_RANGE	100
+#define DEFAULT_CELL_RANGE	3000
+#define MAX_LINE			1024
+
+struct radio_record {
+	uint64_t key;
+	struct location_radio_entry entry;
+};
+
+static GArray *records;
+
+static gint record_compare(gconstpointer a, gconstpointer b)
+{
+	const struct radio_record *first = a, *second = b;
+
+	if (first->key != second->key)
+		return first->key < second->key ? -1 : 1;
+	if (first->entry.range != second->entry.range)
+		return first->entry.range < second->entry.range ? -1 : 1;
+	return 0;
+}
+
+static gboolean parse_position(char **fields, struct location_radio_entry *entry, float default_range)
+{
+	char *end;
+
+	entry->longitude = g_ascii_strtod(fields[0], &end);
+	if (end == fields[0] || *end != '\0' || entry->longitude < -180 || entry->longitude > 180)
+		return FALSE;
+	entry->latitude = g_ascii_strtod(fields[1], &end);
+	if (end == fields[1] || *end != '\0' || entry->latitude < -90 || entry->latitude > 90)
+		return FALSE;
+	entry->range = g_ascii_strtod(fields[2], &end);
+	if (!(entry->range > 0))
+		entry->range = default_range;
+
+	return TRUE;
+}
+
+static gboolean parse_row(char *line)
+{
+	struct radio_record record;
+	char **fields;
+	gboolean valid = FALSE;
+	guint count;
+
+	g_strchomp(line);
+	fields = g_strsplit(line, ",", 0);
+	count = g_strv_length(fields);
+
+	if (count >= 5 && !g_ascii_strcasecmp(fields[0], "wifi"))
+		valid = location_radio_key_from_bssid(fields[1], &record.key) &&
+		        parse_position(&fields[2], &record.entry, DEFAULT_WIFI_RANGE);
+	else if (count >= 9)
+		valid = location_radio_key_from_cell(strtoul(fields[1], NULL, 10), strtoul(fields[2], NULL, 10),
+		                                     strtoul(fields[3], NULL, 10), strtoul(fields[4], NULL, 10),
+		                                     &record.key) &&
+		        parse_position(&fields[6], &record.entry, DEFAULT_CELL_RANGE);
+
+	if (valid)
+		g_array_append_val(records, record);
+
+	g_strfreev(fields);
+
+	return valid;
+}
+
+static gboolean read_rows(const char *path)
+{
+	char line[MAX_LINE];
+	guint skipped = 0;
+	FILE *f;
+
+	f = fopen(path, "r");
+	if (!f) {
+		g_printerr("Failed to open %s: %s\n", path, strerror(errno));
+		return FALSE;
+	}
+
+	while (fgets(line, sizeof(line), f)) {
+		if (!parse_row(line))
+			skipped++;
+	}
+
+	fclose(f);
+
+	if (skipped)
+		g_printerr("Skipped %u rows of %s\n", skipped, path);
+
+	return TRUE;
+}
+
+static gboolean write_map(const char *path)
+{
+	struct location_radio_header header;
+	const struct radio_record *record;
+	uint64_t *keys;
+	struct location_radio_entry *entries;
+	guint n, count = 0;
+	gboolean ret;
+	FILE *f;
+
+	/* Sorting by range as well puts the best of equal keys first */
+	g_array_sort(records, record_compare);
+
+	keys = g_new(uint64_t, records->len);
+	entries = g_new(struct location_radio_entry, records->len);
+	for (n = 0; n < records->len; n++) {
+		record = &g_array_index(records, struct radio_record, n);
+		if (count > 0 && keys[count - 1] == record->key)
+			continue;
+		keys[count] = record->key;
+		entries[count] = record->entry;
+		count++;
+	}
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, LOCATION_RADIO_MAGIC, sizeof(header.magic));
+	header.version = LOCATION_RADIO_VERSION;
+	header.num_entries = count;
+
+	f = fopen(path, "wb");
+	if (!f) {
+		g_printerr("Failed to create %s: %s\n", path, strerror(errno));
+		ret = FALSE;
+		goto out;
+	}
+
+	fwrite(&header, sizeof(header), 1, f);
+	fwrite(keys, sizeof(uint64_t), count, f);
+	fwrite(entries, sizeof(struct location_radio_entry), count, f);
+
+	ret = !ferror(f);
+	if (fclose(f) != 0 || !ret) {
+		g_printerr("Failed to write %s\n", path);
+		ret = FALSE;
+		goto out;
+	}
+
+	printf("%u transmitters\n", count);
+
+out:
+	g_free(keys);
+	g_free(entries);
+
+	return ret;
+}
+
+int main(int argc, char **argv)
+{
+	int n;
+
+	if (argc < 3) {
+		g_printerr("Usage: %s INPUT.csv... OUTPUT\n", argv[0]);
+		exit(1);
+	}
+
+	records = g_array_new(FALSE, FALSE, sizeof(struct radio_record));
+
+	for (n = 1; n < argc - 1; n++) {
+		if (!read_rows(argv[n]))
+			exit(1);
+	}
+
+	if (!write_map(argv[argc - 1]))
+		exit(1);
+
+	return 0;
+}
+
+// vim:ts=4:sw=4:noexpandtab
@@ -0,0 +1,437 @@
+/* @@@LICENSE
+*
+* Copyright (c) 2026 LuneOS Project
+*
+* This file is part of location-service.
+*
+* location-service is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* location-service is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with location-service.  If not, see <http://www.gnu.org/licenses/>.
+*
+* LICENSE@@@ */
+
+
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "location_ranking.h"
+
+/* Mean earth radius in meters */
+#define EARTH_RADIUS	6371008.8
+/* Points whose dot products are computed in one go before the scalar top-k
+ * selection looks at them */
+#define RANK_BLOCK		512
+#define DATASET_HEADER	16
+
+struct location_points {
+	int refcount;
+	guint count;
+	const double *x;
+	const double *y;
+	const double *z;
+	double *storage;
+	void *mapping;
+	size_t mapping_size;
+	time_t mtime;
+};
+
+struct location_ranking {
+	GHashTable *datasets;
+};
+
+struct rank_entry {
+	double key;
+	guint index;
+};
+
+struct location_rank_query {
+	struct location_points *points;
+	guint k;
+	guint n;
+	struct rank_entry *heap;
+	guint heap_size;
+	struct rank_entry *results;
+	double *block;
+	bool valid;
+	double ref[3];
+	double gap;
+};
+
+static void unit_vector(double latitude, double longitude, double *v)
+{
+	double lat = latitude * M_PI / 180, lon = longitude * M_PI / 180;
+
+	v[0] = cos(lat) * cos(lon);
+	v[1] = cos(lat) * sin(lon);
+	v[2] = sin(lat);
+}
+
+/* Great circle distance, atan2 keeps it exact for close points where acos
+ * of the dot product would not */
+static double distance(const double *a, const double *b)
+{
+	double cx = a[1] * b[2] - a[2] * b[1];
+	double cy = a[2] * b[0] - a[0] * b[2];
+	double cz = a[0] * b[1] - a[1] * b[0];
+	double dot = a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+
+	return EARTH_RADIUS * atan2(sqrt(cx * cx + cy * cy + cz * cz), dot);
+}
+
+static double point_distance(struct location_points *points, guint index, const double *ref)
+{
+	double v[3] = { points->x[index], points->y[index], points->z[index] };
+
+	return distance(v, ref);
+}
+
+struct location_points *location_points_new_from_json(jvalue_ref points_obj)
+{
+	struct location_points *points;
+	jvalue_ref point_obj, value_obj;
+	double latitude, longitude, v[3];
+	double *x, *y, *z;
+	ssize_t count, n;
+
+	if (!jis_array(points_obj))
+		return NULL;
+
+	count = jarray_size(points_obj);
+	if (count <= 0 || count > LOCATION_RANKING_MAX_POINTS)
+		return NULL;
+
+	points = g_new0(struct location_points, 1);
+	points->refcount = 1;
+	points->count = count;
+	points->storage = g_new(double, 3 * count);
+	x = points->storage;
+	y = x + count;
+	z = y + count;
+	points->x = x;
+	points->y = y;
+	points->z = z;
+
+	for (n = 0; n < count; n++) {
+		point_obj = jarray_get(points_obj, n);
+
+		if (!jobject_get_exists(point_obj, J_CSTR_TO_BUF("latitude"), &value_obj) ||
+			!jis_number(value_obj))
+			goto error;
+		jnumber_get_f64(value_obj, &latitude);
+
+		if (!jobject_get_exists(point_obj, J_CSTR_TO_BUF("longitude"), &value_obj) ||
+			!jis_number(value_obj))
+			goto error;
+		jnumber_get_f64(value_obj, &longitude);
+
+		unit_vector(latitude, longitude, v);
+		x[n] = v[0];
+		y[n] = v[1];
+		z[n] = v[2];
+	}
+
+	return points;
+
+error:
+	location_points_unref(points);
+	return NULL;
+}
+
+static struct location_points *points_map(const char *path)
+{
+	struct location_points *points = NULL;
+	const uint32_t *header;
+	struct stat st;
+	void *mapping;
+	guint count;
+	int fd;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return NULL;
+
+	if (fstat(fd, &st) < 0 || st.st_size < DATASET_HEADER)
+		goto out;
+
+	mapping = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	if (mapping == MAP_FAILED) {
+		g_warning("Failed to map dataset %s: %s", path, strerror(errno));
+		goto out;
+	}
+
+	header = (const uint32_t *) ((const char *) mapping + 8);
+	count = header[1];
+	if (memcmp(mapping, LOCATION_RANKING_DATASET_MAGIC, 8) ||
+		header[0] != LOCATION_RANKING_DATASET_VERSION ||
+		count == 0 || (size_t) st.st_size != DATASET_HEADER + 3 * sizeof(double) * (size_t) count) {
+		g_warning("Dataset %s is invalid", path);
+		munmap(mapping, st.st_size);
+		goto out;
+	}
+
+	points = g_new0(struct location_points, 1);
+	points->refcount = 1;
+	points->count = count;
+	points->mapping = mapping;
+	points->mapping_size = st.st_size;
+	points->mtime = st.st_mtime;
+	points->x = (const double *) ((const char *) mapping + DATASET_HEADER);
+	points->y = points->x + count;
+	points->z = points->y + count;
+
+out:
+	close(fd);
+	return points;
+}
+
+struct location_points *location_points_ref(struct location_points *points)
+{
+	points->refcount++;
+	return points;
+}
+
+void location_points_unref(struct location_points *points)
+{
+	if (!points || --points->refcount > 0)
+		return;
+
+	if (points->mapping)
+		munmap(points->mapping, points->mapping_size);
+	g_free(points->storage);
+	g_free(points);
+}
+
+guint location_points_count(struct location_points *points)
+{
+	return points->count;
+}
+
+struct location_ranking *location_ranking_new(void)
+{
+	struct location_ranking *ranking;
+
+	ranking = g_new0(struct location_ranking, 1);
+	ranking->datasets = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+	                                          (GDestroyNotify) location_points_unref);
+
+	return ranking;
+}
+
+void location_ranking_free(struct location_ranking *ranking)
+{
+	if (!ranking)
+		return;
+
+	g_hash_table_destroy(ranking->datasets);
+	g_free(ranking);
+}
+
+/* Returns a new reference to the dataset, mapped on first use and again
+ * when the file was replaced */
+struct location_points *location_ranking_get_dataset(struct location_ranking *ranking, const char *name)
+{
+	struct location_points *points;
+	struct stat st;
+	char *path;
+
+	if (!name || name[0] == '\0' || name[0] == '.' || strchr(name, '/'))
+		return NULL;
+
+	path = g_strdup_printf("%s/%s.points", LOCATION_RANKING_DATASET_DIR, name);
+
+	points = g_hash_table_lookup(ranking->datasets, name);
+	if (points && (stat(path, &st) < 0 || st.st_mtime != points->mtime)) {
+		g_hash_table_remove(ranking->datasets, name);
+		points = NULL;
+	}
+
+	if (!points) {
+		points = points_map(path);
+		if (points)
+			g_hash_table_insert(ranking->datasets, g_strdup(name), points);
+	}
+
+	g_free(path);
+
+	return points ? location_points_ref(points) : NULL;
+}
+
+struct location_rank_query *location_rank_query_new(struct location_points *points, guint k)
+{
+	struct location_rank_query *query;
+
+	k = CLAMP(k, 1, LOCATION_RANKING_MAX_COUNT);
+
+	query = g_new0(struct location_rank_query, 1);
+	query->points = location_points_ref(points);
+	query->k = k;
+	/* One more than asked for to know how far the set is from changing */
+	query->heap = g_new(struct rank_entry, k + 1);
+	query->results = g_new(struct rank_entry, k + 1);
+	query->block = g_new(double, RANK_BLOCK);
+
+	return query;
+}
+
+void location_rank_query_free(struct location_rank_query *query)
+{
+	if (!query)
+		return;
+
+	location_points_unref(query->points);
+	g_free(query->heap);
+	g_free(query->results);
+	g_free(query->block);
+	g_free(query);
+}
+
+/* Plain loop over the arrays without any branches, compilers turn it into
+ * SIMD code */
+static void dot_block(const double *restrict x, const double *restrict y, const double *restrict z,
+                      guint n, double rx, double ry, double rz, double *restrict out)
+{
+	guint i;
+
+	for (i = 0; i < n; i++)
+		out[i] = x[i] * rx + y[i] * ry + z[i] * rz;
+}
+
+/* Min-heap on the dot product, the root is the farthest of the nearest */
+static void heap_sift_down(struct rank_entry *heap, guint size, guint i)
+{
+	struct rank_entry entry = heap[i];
+	guint child;
+
+	while ((child = 2 * i + 1) < size) {
+		if (child + 1 < size && heap[child + 1].key < heap[child].key)
+			child++;
+		if (heap[child].key >= entry.key)
+			break;
+		heap[i] = heap[child];
+		i = child;
+	}
+	heap[i] = entry;
+}
+
+static void heap_push(struct rank_entry *heap, guint size, double key, guint index)
+{
+	guint i = size, parent;
+
+	while (i > 0) {
+		parent = (i - 1) / 2;
+		if (heap[parent].key <= key)
+			break;
+		heap[i] = heap[parent];
+		i = parent;
+	}
+	heap[i].key = key;
+	heap[i].index = index;
+}
+
+static int compare_key(const void *a, const void *b)
+{
+	double ka = ((const struct rank_entry *) a)->key;
+	double kb = ((const struct rank_entry *) b)->key;
+
+	return ka < kb ? -1 : ka > kb;
+}
+
+static void rank_all(struct location_rank_query *query, const double *ref)
+{
+	struct location_points *points = query->points;
+	guint capacity = query->k + 1;
+	double threshold = -INFINITY;
+	guint start, n, i;
+
+	query->heap_size = 0;
+
+	for (start = 0; start < points->count; start += RANK_BLOCK) {
+		n = MIN(RANK_BLOCK, points->count - start);
+		dot_block(points->x + start, points->y + start, points->z + start,
+		          n, ref[0], ref[1], ref[2], query->block);
+
+		for (i = 0; i < n; i++) {
+			if (query->block[i] <= threshold)
+				continue;
+
+			if (query->heap_size < capacity) {
+				heap_push(query->heap, query->heap_size++, query->block[i], start + i);
+				if (query->heap_size == capacity)
+					threshold = query->heap[0].key;
+			}
+			else {
+				query->heap[0].key = query->block[i];
+				query->heap[0].index = start + i;
+				heap_sift_down(query->heap, capacity, 0);
+				threshold = query->heap[0].key;
+			}
+		}
+	}
+
+	/* Exact distances for the few survivors, nearest first */
+	for (i = 0; i < query->heap_size; i++) {
+		query->results[i].index = query->heap[i].index;
+		query->results[i].key = point_distance(points, query->heap[i].index, ref);
+	}
+	qsort(query->results, query->heap_size, sizeof(struct rank_entry), compare_key);
+
+	query->n = MIN(query->k, query->heap_size);
+	query->gap = query->heap_size > query->k ?
+		query->results[query->k].key - query->results[query->k - 1].key : INFINITY;
+	memcpy(query->ref, ref, sizeof(query->ref));
+	query->valid = true;
+}
+
+/* Returns the number of results. A point of the set moves at most as far as
+ * the reference, so the set can't change while twice the distance moved
+ * stays below the gap between the k-th and the next point. */
+guint location_rank_query_run(struct location_rank_query *query, double latitude, double longitude)
+{
+	double ref[3];
+	guint i;
+
+	unit_vector(latitude, longitude, ref);
+
+	if (query->valid && 2 * distance(query->ref, ref) < query->gap) {
+		for (i = 0; i < query->n; i++)
+			query->results[i].key = point_distance(query->points, query->results[i].index, ref);
+		qsort(query->results, query->n, sizeof(struct rank_entry), compare_key);
+		return query->n;
+	}
+
+	rank_all(query, ref);
+	return query->n;
+}
+
+void location_rank_query_to_reply(struct location_rank_query *query, jvalue_ref reply_obj)
+{
+	jvalue_ref results_obj, result_obj;
+	guint i;
+
+	results_obj = jarray_create(NULL);
+	for (i = 0; i < query->n; i++) {
+		result_obj = jobject_create();
+		jobject_put(result_obj, J_CSTR_TO_JVAL("index"), jnumber_create_i32(query->results[i].index));
+		jobject_put(result_obj, J_CSTR_TO_JVAL("distance"), jnumber_create_f64(query->results[i].key));
+		jarray_append(results_obj, result_obj);
+	}
+
+	jobject_put(reply_obj, J_CSTR_TO_JVAL("results"), results_obj);
+}
+
+// vim:ts=4:sw=4:noexpandtab
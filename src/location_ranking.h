@@ -0,0 +1,76 @@
+/* @@@LICENSE
+*
+* Copyright (c) 2026 LuneOS Project
+*
+* This file is part of location-service.
+*
+* location-service is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* location-service is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with location-service.  If not, see <http://www.gnu.org/licenses/>.
+*
+* LICENSE@@@ */
+
+#ifndef LOCATION_RANKING_H_
+#define LOCATION_RANKING_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <glib.h>
+#include <pbnjson.h>
+
+#include "location_state.h"
+
+/* Named point sets live in LOCATION_RANKING_DATASET_DIR/NAME.points:
+ *
+ *   char magic[8]    "LSPOINTS"
+ *   uint32_t version 1
+ *   uint32_t count
+ *   double x[count], y[count], z[count]
+ *
+ * in host byte order, where (x, y, z) is the unit vector of a point:
+ * (cos lat cos lon, cos lat sin lon, sin lat). Files are mapped, not
+ * read, and shared by all requests using them. */
+#define LOCATION_RANKING_DATASET_DIR		LOCATION_SERVICE_STATE_DIR "/datasets"
+#define LOCATION_RANKING_DATASET_MAGIC		"LSPOINTS"
+#define LOCATION_RANKING_DATASET_VERSION	1
+
+#define LOCATION_RANKING_MAX_POINTS		100000
+#define LOCATION_RANKING_MAX_COUNT		1000
+
+/* Points as a structure of arrays so the distance kernel can be
+ * vectorized */
+struct location_points;
+
+struct location_points *location_points_new_from_json(jvalue_ref points_obj);
+struct location_points *location_points_ref(struct location_points *points);
+void location_points_unref(struct location_points *points);
+guint location_points_count(struct location_points *points);
+
+struct location_ranking;
+
+struct location_ranking *location_ranking_new(void);
+void location_ranking_free(struct location_ranking *ranking);
+struct location_points *location_ranking_get_dataset(struct location_ranking *ranking, const char *name);
+
+/* The k points nearest to a reference. Querying again keeps the previous
+ * result when the reference didn't move far enough to change the set of
+ * nearest points, then only their distances are computed again. */
+struct location_rank_query;
+
+struct location_rank_query *location_rank_query_new(struct location_points *points, guint k);
+void location_rank_query_free(struct location_rank_query *query);
+guint location_rank_query_run(struct location_rank_query *query, double latitude, double longitude);
+void location_rank_query_to_reply(struct location_rank_query *query, jvalue_ref reply_obj);
+
+#endif
+
+// vim:ts=4:sw=4:noexpandtab
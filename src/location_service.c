@@ -20,10 +20,24 @@
 *
 * LICENSE@@@ */
 
+#include <signal.h>
+#include <string.h>
 #include <luna-service2/lunaservice.h>
 
 #include "location_service.h"
 #include "location_common.h"
+#include "location_cache.h"
+#include "location_prefs.h"
+#include "location_permissions.h"
+#include "location_trace.h"
+#include "location_shm.h"
+#include "location_admission.h"
+#include "location_ranking.h"
+#include "location_timezone.h"
+#include "location_watchdog.h"
+#include "location_history.h"
+#include "location_visits.h"
+#include "location_usage.h"
 #include "luna_service_utils.h"
 #include <glib.h>
 #include "utils.h"
@@ -36,6 +50,56 @@ extern GMainLoop *event_loop;
 #define GCLUE_ACCURACY_LEVEL_DEFAULT GCLUE_ACCURACY_LEVEL_NEIGHBORHOOD
 #define GCLUE_ACCURACY_LEVEL_LOW GCLUE_ACCURACY_LEVEL_CITY
 
+/* A subscriber whose deliveries failed this many times in a row only gets
+ * the latest fix every COALESCE_INTERVAL seconds, until this many coalesced
+ * deliveries in a row succeeded */
+#define SUBSCRIBER_MAX_FAILURES 3
+#define SUBSCRIBER_RECOVER_DELIVERIES 5
+#define COALESCE_INTERVAL 1
+
+/* Largest batchSize of a tracking subscriber, and the maxLatency in
+ * milliseconds of one which didn't give any */
+#define BATCH_MAX_SIZE 1000
+#define BATCH_DEFAULT_LATENCY 60000
+
+/* Lowest and highest rate in Hz of predicted positions a tracking
+ * subscriber can ask for, slower rates get one every ten seconds */
+#define PREDICTION_MIN_RATE 0.1
+#define PREDICTION_MAX_RATE 60
+
+/* Seconds a one-shot request waits for a fix from a non-GeoClue provider,
+ * same as the default timeout of location-getposition */
+#define POSITION_WAITER_TIMEOUT 30
+
+/* Maximum age in seconds of a cached fix sent to a new tracking subscriber
+ * when the session has no fix of its own yet */
+#define TRACKING_INITIAL_MAX_AGE 300
+
+/* Seconds the session's last fix answers getCurrentPosition as if it was
+ * new, about what starting a GeoClue client for a new fix takes. The
+ * session's own thresholds come from other subscribers and may be far
+ * longer. */
+#define SESSION_FIX_MAX_AGE 5
+
+/* Seconds a fix from the offline radio map answers getCurrentPosition as if
+ * it was new, scans aren't much more frequent */
+#define RADIO_FIX_MAX_AGE 30
+
+/* What getTimeZone subscribers need from the tracking session, zones don't
+ * change within a kilometer or five minutes */
+#define TIMEZONE_TIME_THRESHOLD 300
+#define TIMEZONE_DISTANCE_THRESHOLD 1000
+
+/* Most points a getHistory reply carries */
+#define HISTORY_MAX_POINTS 4096
+
+/* What getVisits subscribers need from the tracking session while moving
+ * and, much less, while staying inside a visit */
+#define VISIT_LEVEL GCLUE_ACCURACY_LEVEL_STREET
+#define VISIT_TIME_THRESHOLD 30
+#define VISIT_STATIONARY_LEVEL GCLUE_ACCURACY_LEVEL_NEIGHBORHOOD
+#define VISIT_STATIONARY_TIME_THRESHOLD 120
+
 typedef enum {
 	PALM_ACCURACY_LEVEL_HIGH = 1,
 	PALM_ACCURACY_LEVEL_DEFAULT = 2,
@@ -51,17 +115,9 @@ typedef enum {
 	CODE_PermissionDenied = 6,
 	CODE_Has_Pending_Message = 7,
 	CODE_Blacklisted = 8,
+	CODE_Budget_Exceeded = 9,
 } errorCode;
 
-static void
-on_client_signal (GDBusProxy *client,
-                  gchar      *sender_name,
-                  gchar      *signal_name,
-                  GVariant   *parameters,
-                  gpointer    user_data);
-
-bool create_subscribed_client(struct location_service *service);
-
 void luna_service_message_reply_custom_error_code(LSHandle *handle, LSMessage *message, const int error_code)
 {
 	bool ret;
@@ -84,27 +140,336 @@ void luna_service_message_reply_custom_error_code(LSHandle *handle, LSMessage *m
 
 static bool cbGetCurrentPosition(LSHandle *handle, LSMessage *message, void *user_data);
 static bool cbStartTracking(LSHandle *handle, LSMessage *message, void *user_data);
+static bool cbPreference(LSHandle *handle, LSMessage *message, void *user_data);
+static bool cbGetLocationServicePrefs(LSHandle *handle, LSMessage *message, void *user_data);
+static bool cbSetLocationServicePrefs(LSHandle *handle, LSMessage *message, void *user_data);
+static bool cbSetWebSetting(LSHandle *handle, LSMessage *message, void *user_data);
+static bool cbClearWebSetting(LSHandle *handle, LSMessage *message, void *user_data);
+static bool cbLocationRequestDecision(LSHandle *handle, LSMessage *message, void *user_data);
+static bool cbGetSharedMemory(LSHandle *handle, LSMessage *message, void *user_data);
+static bool cbRankByDistance(LSHandle *handle, LSMessage *message, void *user_data);
+static bool cbGetTimeZone(LSHandle *handle, LSMessage *message, void *user_data);
+static bool cbGetStatus(LSHandle *handle, LSMessage *message, void *user_data);
+static bool cbGetHistory(LSHandle *handle, LSMessage *message, void *user_data);
+static bool cbGetVisits(LSHandle *handle, LSMessage *message, void *user_data);
+static bool cbGetUsage(LSHandle *handle, LSMessage *message, void *user_data);
+static bool cbSetUsageBudget(LSHandle *handle, LSMessage *message, void *user_data);
+
+/* A startTracking subscription, what it asked for and how delivering fixes
+ * to it went. Intervals are in milliseconds, a prediction interval of 0
+ * means no predicted positions. */
+struct tracking_subscriber {
+	LSHandle *handle;
+	LSMessage *message;
+	char *token;
+	GClueAccuracyLevel level;
+	guint interval;
+	guint distance;
+	struct tracking_batch *batch;
+	guint prediction_interval;
+	enum location_prediction_mode prediction_mode;
+	gint64 last_predicted;
+	gint64 last_sent;
+	guint failures;
+	bool coalescing;
+	guint recovered;
+	bool has_latest;
+	struct location_fix latest;
+	guint dropped;
+	struct location_usage_app *usage_app;
+	GClueAccuracyLevel usage_level;
+};
+
+/* Tracking subscribers asking for the same batchSize, maxLatency (in
+ * milliseconds) and minimumInterval share the buffered fixes and the
+ * payload they are sent as */
+struct tracking_batch {
+	guint size;
+	guint max_latency;
+	guint interval;
+	GArray *fixes;
+	gint64 last_added;
+	guint timeout;
+	GList *subscribers;
+};
+
+/* A rankByDistance subscription, ranked again on every fix */
+struct rank_subscriber {
+	LSHandle *handle;
+	LSMessage *message;
+	char *token;
+	struct location_rank_query *query;
+};
+
+/* A getTimeZone subscription and the zone it was last told about */
+struct timezone_subscriber {
+	LSHandle *handle;
+	LSMessage *message;
+	char *token;
+	const char *zone;
+};
+
+/* A getVisits subscription */
+struct visit_subscriber {
+	LSHandle *handle;
+	LSMessage *message;
+	char *token;
+};
+
+/* A getHistory subscription, sent every point its simplifier commits */
+struct history_subscriber {
+	LSHandle *handle;
+	LSMessage *message;
+	char *token;
+	/* Points are only sent while the app holds a session, NULL for
+	 * privileged callers */
+	char *app_id;
+	struct location_simplifier simplifier;
+};
+
+/* A pending getCurrentPosition. While pending it is registered as a
+ * subscription under key so we learn when the caller goes away. */
+struct position_request {
+	struct location_service *service;
+	GClueAccuracyLevel accuracy_level;
+	struct luna_service_req_data *req;
+	guint timeout;
+	char *key;
+	GPid pid;
+	gint exit_status;
+	guint out_watch;
+	bool cancelled;
+	bool reduce_precision;
+	struct location_usage_app *usage_app;
+};
 
 static LSMethod location_service_methods[]  = {
 	{ "getCurrentPosition", cbGetCurrentPosition },
 	{ "startTracking", cbStartTracking },
+	{ "getUseGps", cbPreference },
+	{ "setUseGps", cbPreference },
+	{ "getAutoLocate", cbPreference },
+	{ "setAutoLocate", cbPreference },
+	{ "setUseGoogle", cbPreference },
+	{ "getUseLocationServices", cbPreference },
+	{ "getGeotagPhotos", cbPreference },
+	{ "setGeotagPhotos", cbPreference },
+	{ "getUseBackgroundDataCollection", cbPreference },
+	{ "setUseBackgroundDataCollection", cbPreference },
+	{ "acceptTermsOfUse", cbPreference },
+	{ "rejectTermsOfUse", cbPreference },
+	{ "getLocationServicePrefs", cbGetLocationServicePrefs },
+	{ "setLocationServicePrefs", cbSetLocationServicePrefs },
+	{ "setWebSetting", cbSetWebSetting },
+	{ "clearWebSetting", cbClearWebSetting },
+	{ "acceptLocationRequest", cbLocationRequestDecision },
+	{ "acceptAlwaysLocationRequest", cbLocationRequestDecision },
+	{ "rejectLocationRequest", cbLocationRequestDecision },
+	{ "ignoreLocationRequest", cbLocationRequestDecision },
+	{ "getSharedMemory", cbGetSharedMemory },
+	{ "rankByDistance", cbRankByDistance },
+	{ "getTimeZone", cbGetTimeZone },
+	{ "getStatus", cbGetStatus },
+	{ "getHistory", cbGetHistory },
+	{ "getVisits", cbGetVisits },
+	{ "getUsage", cbGetUsage },
+	{ "setUsageBudget", cbSetUsageBudget },
 	{ NULL, NULL }
 };
 
+typedef enum {
+	PREF_METHOD_GET,
+	PREF_METHOD_SET,
+	PREF_METHOD_SET_TRUE,
+	PREF_METHOD_SET_FALSE,
+} PrefMethodType;
+
+/* Legacy preference methods: which preference they touch and the JSON key
+ * used for the value in the request or reply payload */
+static const struct pref_method {
+	const char *method;
+	enum location_pref pref;
+	const char *key;
+	PrefMethodType type;
+} pref_methods[] = {
+	{ "getUseGps", LOCATION_PREF_USE_GPS, "useGps", PREF_METHOD_GET },
+	{ "setUseGps", LOCATION_PREF_USE_GPS, "useGps", PREF_METHOD_SET },
+	{ "getAutoLocate", LOCATION_PREF_AUTO_LOCATE, "autoLocate", PREF_METHOD_GET },
+	{ "setAutoLocate", LOCATION_PREF_AUTO_LOCATE, "autoLocate", PREF_METHOD_SET },
+	{ "setUseGoogle", LOCATION_PREF_USE_GOOGLE, "useGoogle", PREF_METHOD_SET },
+	{ "getUseLocationServices", LOCATION_PREF_USE_GOOGLE, "useLocationServices", PREF_METHOD_GET },
+	{ "getGeotagPhotos", LOCATION_PREF_GEOTAG_PHOTOS, "geotagPhotos", PREF_METHOD_GET },
+	{ "setGeotagPhotos", LOCATION_PREF_GEOTAG_PHOTOS, "geotagPhotos", PREF_METHOD_SET },
+	{ "getUseBackgroundDataCollection", LOCATION_PREF_USE_BACKGROUND_DATA_COLLECTION,
+	  "useBackgroundDataCollection", PREF_METHOD_GET },
+	{ "setUseBackgroundDataCollection", LOCATION_PREF_USE_BACKGROUND_DATA_COLLECTION,
+	  "useBackgroundDataCollection", PREF_METHOD_SET },
+	{ "acceptTermsOfUse", LOCATION_PREF_TERMS_ACCEPTED, NULL, PREF_METHOD_SET_TRUE },
+	{ "rejectTermsOfUse", LOCATION_PREF_TERMS_ACCEPTED, NULL, PREF_METHOD_SET_FALSE },
+	{ NULL }
+};
+
+static void post_to_all_handles(struct location_service *service, const char *method, jvalue_ref reply_obj)
+{
+	LSHandle *handles[] = {
+		service->handle_ports1, service->handle_ports2,
+		service->handle_palm1, service->handle_palm2,
+		service->handle_webos1, service->handle_webos2,
+	};
+	int n;
+
+	for (n = 0; n < G_N_ELEMENTS(handles); n++) {
+		if (handles[n])
+			luna_service_post_subscription(handles[n], "/", method, reply_obj);
+	}
+}
+
+/* Replies with an error code and returns false if the caller isn't allowed
+ * to get positions. Only a hash lookup, nothing is sent to GeoClue. Apps
+ * without a decision are allowed. */
+static bool check_permission(struct location_service *service, LSHandle *handle, LSMessage *message)
+{
+	LocationPermission permission;
+	char *app_id;
+
+	app_id = luna_service_message_get_caller_id(message);
+	permission = location_permissions_lookup(service->permissions, app_id);
+	g_free(app_id);
+
+	switch (permission) {
+	case LOCATION_PERMISSION_DENIED:
+		luna_service_message_reply_custom_error_code(handle, message, CODE_PermissionDenied);
+		return false;
+	case LOCATION_PERMISSION_BLACKLISTED:
+		luna_service_message_reply_custom_error_code(handle, message, CODE_Blacklisted);
+		return false;
+	default:
+		return true;
+	}
+}
+
+/* Replies with an error code and returns false unless the caller is part
+ * of the system, for methods which act on behalf of other apps */
+static bool check_privileged(LSHandle *handle, LSMessage *message)
+{
+	if (luna_service_message_is_privileged(message))
+		return true;
+
+	luna_service_message_reply_custom_error_code(handle, message, CODE_PermissionDenied);
+	return false;
+}
+
+static bool location_services_enabled(struct location_service *service)
+{
+	return location_prefs_get(service->prefs, LOCATION_PREF_USE_GPS) ||
+		location_prefs_get(service->prefs, LOCATION_PREF_USE_GOOGLE);
+}
+
+/* Without GPS the best GeoClue can do is WiFi based positioning */
+static GClueAccuracyLevel effective_accuracy_level(struct location_service *service, GClueAccuracyLevel level)
+{
+	if (!location_prefs_get(service->prefs, LOCATION_PREF_USE_GPS) &&
+		level > GCLUE_ACCURACY_LEVEL_STREET)
+		return GCLUE_ACCURACY_LEVEL_STREET;
+
+	return level;
+}
+
+static void start_one_shot(struct location_service *service, struct luna_service_req_data *req);
+
+/* A one-shot request holds a session from when its helper runs or it
+ * starts waiting for the tracking session until it is freed */
+static void one_shot_usage_start(struct location_service *service, struct position_request *position_req)
+{
+	char *app_id;
+
+	app_id = luna_service_message_get_caller_id(position_req->req->message);
+	position_req->usage_app = location_usage_lookup(service->usage, app_id);
+	location_usage_start(position_req->usage_app, position_req->accuracy_level);
+	g_free(app_id);
+}
+
+static void one_shot_usage_stop(struct position_request *position_req)
+{
+	if (position_req->usage_app)
+		location_usage_stop(position_req->usage_app, position_req->accuracy_level);
+	position_req->usage_app = NULL;
+}
+
+static void one_shot_track(struct position_request *position_req)
+{
+	struct luna_service_req_data *req = position_req->req;
+
+	position_req->key = g_strdup_printf("getCurrentPosition/%s", LSMessageGetUniqueToken(req->message));
+	if (!luna_service_subscription_add(req->handle, position_req->key, req->message)) {
+		g_free(position_req->key);
+		position_req->key = NULL;
+		return;
+	}
+
+	g_hash_table_insert(position_req->service->one_shots, position_req->key, position_req);
+}
+
+static void one_shot_untrack(struct position_request *position_req)
+{
+	struct luna_service_req_data *req = position_req->req;
+
+	if (!position_req->key)
+		return;
+
+	g_hash_table_remove(position_req->service->one_shots, position_req->key);
+	if (!position_req->cancelled)
+		luna_service_subscription_remove(req->handle, position_req->key, req->message);
+	g_free(position_req->key);
+	position_req->key = NULL;
+}
+
+/* Frees a one-shot request of the helper, req->user_data is its
+ * position_request */
+void location_service_one_shot_free(gpointer data)
+{
+	struct luna_service_req_data *req = data;
+
+	one_shot_usage_stop(req->user_data);
+	one_shot_untrack(req->user_data);
+	g_free(req->user_data);
+	luna_service_req_data_free(req);
+}
+
+/* Both the helper and its pipe are gone, the request can be freed and its
+ * slot goes to the next queued one */
+static void one_shot_helper_done(struct luna_service_req_data *req)
+{
+	struct position_request *position_req = req->user_data;
+	struct location_service *service = position_req->service;
+
+	if (req->subscribed) {
+		luna_service_message_reply_custom_error_code(req->handle, req->message, CODE_Unknown);
+		g_warning("location-getposition exited without reply: %d", position_req->exit_status);
+	}
+	location_service_one_shot_free(req);
+
+	req = location_admission_finish(service->admission);
+	if (req)
+		start_one_shot(service, req);
+}
+
 static void
 cb_child_watch( GPid  pid,
                 gint  status,
                 void *data )
 {
 	struct luna_service_req_data *req = data;
+	struct position_request *position_req = req->user_data;
 
-	if (req->subscribed) {
-		luna_service_message_reply_custom_error_code(req->handle, req->message, CODE_Unknown);
-		g_warning("location-getposition exited without reply: %d",status);
-	}
-	luna_service_req_data_free(req);
 	/* Close pid */
 	g_spawn_close_pid( pid );
+	position_req->pid = 0;
+	position_req->exit_status = status;
+
+	/* The reply may still wait in the pipe, cb_out_watch finishes then */
+	if (!position_req->out_watch)
+		one_shot_helper_done(req);
 }
 
 static gboolean
@@ -112,17 +477,53 @@ cb_out_watch( GIOChannel   *channel,
               GIOCondition  cond,
               void *data )
 {
-	gchar *string;
+	gchar *string = NULL;
 	gsize  size;
 	struct luna_service_req_data *req = data;
+	struct position_request *position_req = req->user_data;
+	jvalue_ref reply_obj = NULL;
+	struct location_fix fix;
+	guint fixes = 0;
+	GIOStatus status = G_IO_STATUS_EOF;
 
-	if( cond == G_IO_HUP )
+	if( cond & G_IO_IN )
+		status = g_io_channel_read_line( channel, &string, &size, NULL, NULL );
+
+	/* Read whatever is left before giving up on a hung up pipe */
+	if( status != G_IO_STATUS_NORMAL )
 	{
+		g_free( string );
+		if( status == G_IO_STATUS_AGAIN )
+			return( TRUE );
+
 		g_io_channel_unref( channel );
+		position_req->out_watch = 0;
+		if (!position_req->pid)
+			one_shot_helper_done(req);
 		return( FALSE );
 	}
 
-	g_io_channel_read_line( channel, &string, &size, NULL, NULL );
+	if (position_req->cancelled)
+		goto cleanup;
+
+	/* Remember the helper's fix so later requests can be served from it */
+	reply_obj = luna_service_message_parse_and_validate(string);
+	if (!jis_null(reply_obj)) {
+		if (location_fix_from_reply(reply_obj, &fix)) {
+			fixes = 1;
+			location_cache_update(position_req->service->cache, position_req->accuracy_level, &fix);
+			if (position_req->reduce_precision) {
+				location_fix_reduce_precision(&fix, position_req->accuracy_level);
+				j_release(&reply_obj);
+				reply_obj = jobject_create();
+				location_fix_to_reply(&fix, &reply_obj);
+				g_free(string);
+				string = g_strdup(jvalue_tostring_simple(reply_obj));
+			}
+		}
+		j_release(&reply_obj);
+	}
+
 	LSError lserror;
 	LSErrorInit(&lserror);
 
@@ -132,6 +533,8 @@ cb_out_watch( GIOChannel   *channel,
 		goto cleanup;
 	}
 	req->subscribed = false;
+	if (position_req->usage_app)
+		location_usage_delivered(position_req->usage_app, fixes, strlen(string));
 
 cleanup:
 	g_free( string );
@@ -139,7 +542,7 @@ cleanup:
 	return( TRUE );
 }
 
-void run_client(struct luna_service_req_data *req, GClueAccuracyLevel accuracy_level)
+static bool run_client(struct luna_service_req_data *req, GClueAccuracyLevel accuracy_level)
 {
 	GPid pid;
 	gchar *arg = g_strdup_printf("%d", accuracy_level);
@@ -155,320 +558,2410 @@ void run_client(struct luna_service_req_data *req, GClueAccuracyLevel accuracy_l
 	g_free(arg);
 	if (!ret)
 	{
-		g_error ("SPAWN FAILED");
-		luna_service_req_data_free(req);
-		return;
+		g_warning("Failed to spawn location-getposition");
+		return false;
 	}
 
 	/* Add watch function to catch termination of the process. This function
 	 * will clean any remnants of process. subscribed bool is used to know
 	 * whether error LS reply is needed in cb_out_watch callback. */
 	req->subscribed = true;
+	((struct position_request *) req->user_data)->pid = pid;
 	g_child_watch_add( pid, (GChildWatchFunc)cb_child_watch, req);
 
 	/* Create channels that will be used to read data from pipes. */
 	out_ch = g_io_channel_unix_new( out );
+	g_io_channel_set_close_on_unref( out_ch, TRUE );
 
 	/* Add watches to channels */
-	g_io_add_watch( out_ch, G_IO_IN | G_IO_HUP, (GIOFunc)cb_out_watch, req);
+	((struct position_request *) req->user_data)->out_watch =
+		g_io_add_watch( out_ch, G_IO_IN | G_IO_HUP | G_IO_ERR, (GIOFunc)cb_out_watch, req);
+
+	return true;
 }
 
-static bool cbGetCurrentPosition(LSHandle *handle, LSMessage *message, void *user_data)
+static void tracking_subscriber_free(struct tracking_subscriber *subscriber)
 {
-	jvalue_ref accuracy_obj = NULL;
-	jvalue_ref parsed_obj = NULL;
-	const char *payload = LSMessageGetPayload(message);
-	int palm_level = PALM_ACCURACY_LEVEL_DEFAULT;
-	GClueAccuracyLevel geoclue_level = GCLUE_ACCURACY_LEVEL_DEFAULT;
+	if (subscriber->usage_app)
+		location_usage_stop(subscriber->usage_app, subscriber->usage_level);
+	LSMessageUnref(subscriber->message);
+	g_free(subscriber->token);
+	g_free(subscriber);
+}
 
-	parsed_obj = luna_service_message_parse_and_validate(payload);
-	if (jis_null(parsed_obj)) {
-		luna_service_message_reply_error_bad_json(handle, message);
-		goto cleanup;
+/* Sends the buffered fixes as one "fixes" array to every subscriber of the
+ * batch */
+static void batch_flush(struct tracking_batch *batch)
+{
+	struct tracking_subscriber *subscriber;
+	jvalue_ref reply_obj, fixes_obj, fix_obj;
+	const char *payload;
+	GList *iter;
+	guint n;
+
+	if (batch->timeout) {
+		g_source_remove(batch->timeout);
+		batch->timeout = 0;
 	}
 
-	if (jobject_get_exists(parsed_obj, J_CSTR_TO_BUF("accuracy"), &accuracy_obj) &&
-		jis_number(accuracy_obj)) {
-		jnumber_get_i32(accuracy_obj, &palm_level);
+	if (batch->fixes->len == 0)
+		return;
+
+	fixes_obj = jarray_create(NULL);
+	for (n = 0; n < batch->fixes->len; n++) {
+		fix_obj = jobject_create();
+		location_fix_to_json(&g_array_index(batch->fixes, struct location_fix, n), fix_obj);
+		jarray_append(fixes_obj, fix_obj);
 	}
-	if (palm_level == PALM_ACCURACY_LEVEL_HIGH) geoclue_level = GCLUE_ACCURACY_LEVEL_HIGH;
-	if (palm_level == PALM_ACCURACY_LEVEL_LOW) geoclue_level = GCLUE_ACCURACY_LEVEL_LOW;
 
-	struct luna_service_req_data *req = luna_service_req_data_new(handle, message);
-	run_client(req, geoclue_level);
+	reply_obj = jobject_create();
+	jobject_put(reply_obj, J_CSTR_TO_JVAL("returnValue"), jboolean_create(true));
+	jobject_put(reply_obj, J_CSTR_TO_JVAL("errorCode"), jnumber_create_i32(0));
+	jobject_put(reply_obj, J_CSTR_TO_JVAL("fixes"), fixes_obj);
+	payload = jvalue_tostring_simple(reply_obj);
+
+	for (iter = batch->subscribers; iter; iter = iter->next) {
+		subscriber = iter->data;
+		if (luna_service_message_respond(subscriber->message, payload)) {
+			subscriber->last_sent = g_get_monotonic_time();
+			location_usage_delivered(subscriber->usage_app, batch->fixes->len, strlen(payload));
+		}
+		else
+			g_warning("Failed to deliver a batch of %u fixes to %s", batch->fixes->len, subscriber->token);
+	}
 
-cleanup:
-	if (!jis_null(parsed_obj))
-		j_release(&parsed_obj);
+	j_release(&reply_obj);
+	g_array_set_size(batch->fixes, 0);
+}
 
-	return true;
+static gboolean batch_timeout_cb(gpointer user_data)
+{
+	struct tracking_batch *batch = user_data;
+
+	batch->timeout = 0;
+	batch_flush(batch);
+
+	return FALSE;
 }
 
-static void service_free(struct location_service *service)
+/* Buffers the fix once for the whole batch. The latency budget starts with
+ * the first fix of a batch. */
+static void batch_add(struct tracking_batch *batch, const struct location_fix *fix, gint64 now)
+{
+	if (batch->last_added && now - batch->last_added < (gint64) batch->interval * 1000)
+		return;
+
+	g_array_append_vals(batch->fixes, fix, 1);
+	batch->last_added = now;
+
+	if (batch->fixes->len >= batch->size)
+		batch_flush(batch);
+	else if (!batch->timeout)
+		batch->timeout = g_timeout_add(batch->max_latency, batch_timeout_cb, batch);
+}
+
+static void batch_free(struct tracking_batch *batch)
 {
-	if (service->manager)
-		g_object_unref(service->manager);
-	if (service->client_props)
-		g_object_unref(service->client_props);
-	if (service->subscribed_client)
-		g_object_unref(service->subscribed_client);
-	service->manager = NULL;
-	service->client_props = NULL;
-	service->subscribed_client = NULL;
-	service->num_clients_ports1 = 0;
-	service->num_clients_ports2 = 0;
-	service->num_clients_palm1 = 0;
-	service->num_clients_palm2 = 0;
-	service->num_clients_webos1 = 0;
-	service->num_clients_webos2 = 0;
+	if (batch->timeout)
+		g_source_remove(batch->timeout);
+	g_array_free(batch->fixes, TRUE);
+	g_list_free(batch->subscribers);
+	g_free(batch);
+}
+
+static void batch_join(struct location_service *service, struct tracking_subscriber *subscriber,
+                       guint size, guint max_latency)
+{
+	struct tracking_batch *batch;
+	GList *iter;
+
+	for (iter = service->tracking_batches; iter; iter = iter->next) {
+		batch = iter->data;
+		if (batch->size == size && batch->max_latency == max_latency &&
+			batch->interval == subscriber->interval)
+			break;
+	}
 
+	if (!iter) {
+		batch = g_new0(struct tracking_batch, 1);
+		batch->size = size;
+		batch->max_latency = max_latency;
+		batch->interval = subscriber->interval;
+		batch->fixes = g_array_sized_new(FALSE, FALSE, sizeof(struct location_fix), size);
+		service->tracking_batches = g_list_append(service->tracking_batches, batch);
+	}
+
+	batch->subscribers = g_list_append(batch->subscribers, subscriber);
+	subscriber->batch = batch;
 }
 
-static void cancel_func(LSHandle* sh, LSMessage* msg, struct location_service *service)
+/* The last subscriber of a batch still gets what was buffered */
+static void batch_leave(struct location_service *service, struct tracking_subscriber *subscriber)
+{
+	struct tracking_batch *batch = subscriber->batch;
+
+	if (!batch)
+		return;
+
+	subscriber->batch = NULL;
+	batch->subscribers = g_list_remove(batch->subscribers, subscriber);
+	if (batch->subscribers)
+		return;
+
+	batch_flush(batch);
+	service->tracking_batches = g_list_remove(service->tracking_batches, batch);
+	batch_free(batch);
+}
+
+static void visit_subscriber_free(struct visit_subscriber *subscriber)
+{
+	LSMessageUnref(subscriber->message);
+	g_free(subscriber->token);
+	g_free(subscriber);
+}
+
+static void timezone_subscriber_free(struct timezone_subscriber *subscriber)
+{
+	LSMessageUnref(subscriber->message);
+	g_free(subscriber->token);
+	g_free(subscriber);
+}
+
+/* Runs an admitted one-shot request. When the helper can't be spawned the
+ * request fails and the slot goes to the next queued one. */
+static void start_one_shot(struct location_service *service, struct luna_service_req_data *req)
 {
-	if (!g_strcmp0(LSHandleGetName(sh), LSHandleGetName(service->handle_ports1))) service->num_clients_ports1--;
-	if (!g_strcmp0(LSHandleGetName(sh), LSHandleGetName(service->handle_ports2))) service->num_clients_ports2--;
-	if (!g_strcmp0(LSHandleGetName(sh), LSHandleGetName(service->handle_palm1))) service->num_clients_palm1--;
-	if (!g_strcmp0(LSHandleGetName(sh), LSHandleGetName(service->handle_palm2))) service->num_clients_palm2--;    
-	if (!g_strcmp0(LSHandleGetName(sh), LSHandleGetName(service->handle_webos1))) service->num_clients_webos1--;
-	if (!g_strcmp0(LSHandleGetName(sh), LSHandleGetName(service->handle_webos2))) service->num_clients_webos2--;
-	if ((service->num_clients_ports1 + service->num_clients_ports2 + service->num_clients_palm1 + service->num_clients_palm2 + service->num_clients_webos1 + service->num_clients_webos2) <= 0) {
-		GError *error = NULL;
-		GVariant *results = g_dbus_proxy_call_sync(service->subscribed_client,
-		                   "Stop",
-		                   NULL,
-		                   G_DBUS_CALL_FLAGS_NONE,
-		                   -1,
-		                   NULL,
-		                   &error);
-		if (results == NULL) {
-			g_critical("Failed to stop GeoClue2 client: %s", error->message);
-			g_error_free(error);
+	struct position_request *position_req;
+
+	while (req) {
+		position_req = req->user_data;
+		if (run_client(req, position_req->accuracy_level)) {
+			one_shot_usage_start(service, position_req);
+			return;
 		}
-		else
-			g_variant_unref(results);
-		service_free(service);
+
+		luna_service_message_reply_custom_error_code(req->handle, req->message, CODE_Unknown);
+		location_service_one_shot_free(req);
+		req = location_admission_finish(service->admission);
 	}
 }
 
-static bool cbStartTracking(LSHandle *handle, LSMessage *message, void *user_data)
+static int num_tracking_clients(struct location_service *service)
 {
-	struct location_service *service = user_data;
+	return g_list_length(service->tracking_subscribers) + g_list_length(service->timezone_subscribers) +
+	       g_list_length(service->visit_subscribers) + service->num_shm_readers;
+}
 
-	bool subscribed = luna_service_check_for_subscription_and_process(handle, message);
-	if (!subscribed) goto reply;
+/* Accuracy is the best, thresholds the smallest any subscriber asked for.
+ * Shared memory readers want every fix, time zone subscribers only city
+ * level fixes now and then, visit subscribers street level fixes unless a
+ * visit is going on. */
+static void compute_demand(struct location_service *service, struct location_demand *demand)
+{
+	struct tracking_subscriber *subscriber;
+	GList *iter;
+
+	demand->level = GCLUE_ACCURACY_LEVEL_COUNTRY;
+	demand->time_threshold = G_MAXUINT;
+	demand->distance_threshold = G_MAXUINT;
+
+	if (service->num_shm_readers > 0 ||
+		(!service->tracking_subscribers && !service->timezone_subscribers && !service->visit_subscribers)) {
+		demand->level = GCLUE_ACCURACY_LEVEL_DEFAULT;
+		demand->time_threshold = 0;
+		demand->distance_threshold = 0;
+	}
 
-	bool is_ports1 = !g_strcmp0(LSHandleGetName(handle), LSHandleGetName(service->handle_ports1));
-	bool is_ports2 = !g_strcmp0(LSHandleGetName(handle), LSHandleGetName(service->handle_ports2));
-	bool is_palm1 = !g_strcmp0(LSHandleGetName(handle), LSHandleGetName(service->handle_palm1));
-	bool is_palm2 = !g_strcmp0(LSHandleGetName(handle), LSHandleGetName(service->handle_palm2));
-	bool is_webos1 = !g_strcmp0(LSHandleGetName(handle), LSHandleGetName(service->handle_webos1));
-	bool is_webos2 = !g_strcmp0(LSHandleGetName(handle), LSHandleGetName(service->handle_webos2));
+	for (iter = service->tracking_subscribers; iter; iter = iter->next) {
+		subscriber = iter->data;
+		demand->level = MAX(demand->level, subscriber->level);
+		demand->time_threshold = MIN(demand->time_threshold, subscriber->interval / 1000);
+		demand->distance_threshold = MIN(demand->distance_threshold, subscriber->distance);
+	}
 
-	if (service->subscribed_client) {
-		if (is_ports1) service->num_clients_ports1++;
-		if (is_ports2) service->num_clients_ports2++;
-		if (is_palm1) service->num_clients_palm1++;
-		if (is_palm2) service->num_clients_palm2++;
-		if (is_webos1) service->num_clients_webos1++;
-		if (is_webos2) service->num_clients_webos2++;
-		goto reply;
+	if (service->timezone_subscribers) {
+		demand->level = MAX(demand->level, GCLUE_ACCURACY_LEVEL_CITY);
+		demand->time_threshold = MIN(demand->time_threshold, TIMEZONE_TIME_THRESHOLD);
+		demand->distance_threshold = MIN(demand->distance_threshold, TIMEZONE_DISTANCE_THRESHOLD);
 	}
 
-	if (!create_subscribed_client(service)) {
-		luna_service_message_reply_custom_error_code(handle, message, CODE_Unknown);
-		service_free(service);
-		return true;
+	if (service->visit_subscribers && service->visits.in_visit) {
+		demand->level = MAX(demand->level, VISIT_STATIONARY_LEVEL);
+		demand->time_threshold = MIN(demand->time_threshold, VISIT_STATIONARY_TIME_THRESHOLD);
+		demand->distance_threshold = 0;
 	}
-	GError *error = NULL;
-	GVariant *results = g_dbus_proxy_call_sync(service->subscribed_client,
-	                   "Start",
-	                   NULL,
-	                   G_DBUS_CALL_FLAGS_NONE,
-	                   -1,
-	                   NULL,
-	                   &error);
-	if (results == NULL) {
-		g_critical("Failed to start GeoClue2 client: %s", error->message);
-		luna_service_message_reply_custom_error_code(handle, message, CODE_Unknown);
-		g_error_free(error);
-		service_free(service);
+	else if (service->visit_subscribers) {
+		demand->level = MAX(demand->level, VISIT_LEVEL);
+		demand->time_threshold = MIN(demand->time_threshold, VISIT_TIME_THRESHOLD);
+		demand->distance_threshold = 0;
+	}
+
+	demand->level = effective_accuracy_level(service, demand->level);
+}
+
+/* Recomputes the demand after the subscribers or the preferences changed
+ * and hands it to the running provider */
+static void update_demand(struct location_service *service)
+{
+	struct location_demand demand;
+
+	compute_demand(service, &demand);
+	if (!memcmp(&demand, &service->demand, sizeof(demand)))
+		return;
+
+	service->demand = demand;
+	if (service->tracking && service->provider->set_demand)
+		service->provider->set_demand(service->provider, service, &service->demand);
+}
+
+static void service_free(struct location_service *service)
+{
+	service->tracking = false;
+	service->degraded = false;
+	service->has_session_fix = false;
+	g_list_foreach(service->tracking_batches, (GFunc) batch_flush, NULL);
+	g_list_free_full(service->tracking_batches, (GDestroyNotify) batch_free);
+	service->tracking_batches = NULL;
+	g_list_free_full(service->tracking_subscribers, (GDestroyNotify) tracking_subscriber_free);
+	service->tracking_subscribers = NULL;
+	g_list_free_full(service->timezone_subscribers, (GDestroyNotify) timezone_subscriber_free);
+	service->timezone_subscribers = NULL;
+	g_list_free_full(service->visit_subscribers, (GDestroyNotify) visit_subscriber_free);
+	service->visit_subscribers = NULL;
+	location_visit_detector_reset(&service->visits);
+	service->num_shm_readers = 0;
+	if (service->coalesce_timeout) {
+		g_source_remove(service->coalesce_timeout);
+		service->coalesce_timeout = 0;
+	}
+	if (service->prediction_timeout) {
+		g_source_remove(service->prediction_timeout);
+		service->prediction_timeout = 0;
+		service->prediction_interval = 0;
+	}
+	if (service->budget_timeout) {
+		g_source_remove(service->budget_timeout);
+		service->budget_timeout = 0;
+	}
+	location_predictor_reset(&service->predictor);
+	service->starting = false;
+	g_list_free_full(service->pending_starts, (GDestroyNotify) luna_service_req_data_free);
+	service->pending_starts = NULL;
+}
+
+static bool session_start(struct location_service *service)
+{
+	if (service->tracking)
 		return true;
+
+	compute_demand(service, &service->demand);
+	service->starting = service->provider->async;
+	if (!service->provider->start(service->provider, service)) {
+		g_warning("Failed to start %s location provider", service->provider->name);
+		service_free(service);
+		return false;
 	}
-	if (is_ports1) service->num_clients_ports1++;
-	if (is_ports2) service->num_clients_ports2++;
-	if (is_palm1) service->num_clients_palm1++;
-	if (is_palm2) service->num_clients_palm2++;
-	if (is_webos1) service->num_clients_webos1++;
-	if (is_webos2) service->num_clients_webos2++;
 
-	g_variant_unref(results);
-reply:
-	luna_service_message_reply_success(handle, message);
+	service->tracking = true;
 	return true;
 }
 
-static void
-on_client_signal (GDBusProxy *client,
-                  gchar      *sender_name,
-                  gchar      *signal_name,
-                  GVariant   *parameters,
-                  gpointer    user_data)
+/* Stops the tracking session once neither subscribers nor pending one-shot
+ * requests need it anymore */
+static void session_release(struct location_service *service)
 {
-	char *location_path;
-	struct location_service *service = user_data;
-
-	if (g_strcmp0 (signal_name, "LocationUpdated") != 0)
+	if (!service->tracking || num_tracking_clients(service) > 0 || service->position_waiters)
 		return;
 
-	g_assert (g_variant_n_children (parameters) > 1);
-	g_variant_get_child (parameters, 1, "&o", &location_path);
-	GError *error = NULL;
-
-	GDBusProxy *location = g_dbus_proxy_new_for_bus_sync (G_BUS_TYPE_SYSTEM,
-	                          G_DBUS_PROXY_FLAGS_NONE,
-	                          NULL,
-	                          "org.freedesktop.GeoClue2",
-	                          location_path,
-	                          "org.freedesktop.GeoClue2.Location",
-	                          NULL,
-	                          &error);
-	if (error != NULL) {
-		g_critical ("Failed to connect to GeoClue2 service: %s", error->message);
-		g_error_free(error);
+	service->provider->stop(service->provider, service);
+	service_free(service);
+}
+
+static void position_waiter_free(struct position_request *position_req)
+{
+	if (position_req->timeout)
+		g_source_remove(position_req->timeout);
+	one_shot_usage_stop(position_req);
+	one_shot_untrack(position_req);
+	luna_service_req_data_free(position_req->req);
+	g_free(position_req);
+}
+
+static gboolean position_waiter_timeout_cb(gpointer user_data)
+{
+	struct position_request *position_req = user_data;
+	struct location_service *service = position_req->service;
+
+	position_req->timeout = 0;
+	luna_service_message_reply_custom_error_code(position_req->req->handle,
+	                                             position_req->req->message, CODE_Timeout);
+
+	service->position_waiters = g_list_remove(service->position_waiters, position_req);
+	position_waiter_free(position_req);
+	session_release(service);
+
+	return FALSE;
+}
+
+static void add_position_waiter(struct location_service *service, struct position_request *position_req,
+                                struct luna_service_req_data *req)
+{
+	position_req->req = req;
+
+	if (!session_start(service)) {
+		luna_service_message_reply_custom_error_code(req->handle, req->message, CODE_Position_Unavailable);
+		position_waiter_free(position_req);
 		return;
 	}
 
+	position_req->timeout = g_timeout_add_seconds(POSITION_WAITER_TIMEOUT,
+	                                              position_waiter_timeout_cb, position_req);
+	service->position_waiters = g_list_append(service->position_waiters, position_req);
+	one_shot_track(position_req);
+	one_shot_usage_start(service, position_req);
+}
+
+/* Returns the size of the payload sent, 0 when it couldn't be */
+static gsize reply_with_fix(LSHandle *handle, LSMessage *message, const struct location_fix *fix,
+                            GClueAccuracyLevel level, bool reduce_precision)
+{
+	struct location_fix reduced = *fix;
 	jvalue_ref reply_obj = NULL;
+	gsize size = 0;
+
+	if (reduce_precision)
+		location_fix_reduce_precision(&reduced, level);
+
 	reply_obj = jobject_create();
-	location_to_reply(location, &reply_obj);
-	g_object_unref (location);
-	if (service->num_clients_ports1)
-		luna_service_post_subscription(service->handle_ports1, "/", "startTracking", reply_obj);
-	if (service->num_clients_ports2)
-		luna_service_post_subscription(service->handle_ports2, "/", "startTracking", reply_obj);
-	if (service->num_clients_palm1)
-		luna_service_post_subscription(service->handle_palm1, "/", "startTracking", reply_obj);
-	if (service->num_clients_palm2)
-		luna_service_post_subscription(service->handle_palm2, "/", "startTracking", reply_obj);
-	if (service->num_clients_webos1)
-		luna_service_post_subscription(service->handle_webos1, "/", "startTracking", reply_obj);
-	if (service->num_clients_webos2)
-		luna_service_post_subscription(service->handle_webos2, "/", "startTracking", reply_obj);
+	location_fix_to_reply(&reduced, &reply_obj);
+	if (luna_service_message_validate_and_send(handle, message, reply_obj))
+		size = strlen(jvalue_tostring_simple(reply_obj));
+	j_release(&reply_obj);
 
-	if (!jis_null(reply_obj))
-		j_release(&reply_obj);
+	return size;
 }
 
-bool create_subscribed_client(struct location_service *service)
-{
-	GVariant *results = NULL;
-	const char *client_path;
-	GError *error = NULL;
-	GDBusProxy *manager = g_dbus_proxy_new_for_bus_sync (G_BUS_TYPE_SYSTEM,
-	                          G_DBUS_PROXY_FLAGS_NONE,
-	                          NULL,
-	                          "org.freedesktop.GeoClue2",
-	                          "/org/freedesktop/GeoClue2/Manager",
-	                          "org.freedesktop.GeoClue2.Manager",
-	                          NULL,
-	                          &error);
-	if (error != NULL) {
-		g_critical ("Failed to connect to GeoClue2 service: %s", error->message);
-		goto error;
+/* Answers a request which may not start a session with any fix we still
+ * have, or the error code when there is none */
+static void reply_with_last_fix(struct location_service *service, LSHandle *handle, LSMessage *message,
+                                GClueAccuracyLevel level, bool reduce_precision,
+                                struct location_usage_app *usage_app, int error_code)
+{
+	const struct location_fix *fix;
+	gsize size;
+
+	fix = location_cache_best(service->cache, level, G_MAXDOUBLE);
+	if (fix) {
+		size = reply_with_fix(handle, message, fix, level, reduce_precision);
+		if (size)
+			location_usage_delivered(usage_app, 1, size);
 	}
+	else
+		luna_service_message_reply_custom_error_code(handle, message, error_code);
+}
 
-	results = g_dbus_proxy_call_sync (manager,
-	                   "GetClient",
-	                   NULL,
-	                   G_DBUS_CALL_FLAGS_NONE,
-	                   -1,
-	                   NULL,
-	                   &error);
-
-	if (results == NULL) {
-		g_critical ("Failed to connect to GeoClue2 service: %s", error->message);
-		goto error;
+static void answer_position_waiters(struct location_service *service, const struct location_fix *fix,
+                                    jvalue_ref reply_obj)
+{
+	GList *waiters = service->position_waiters;
+	GList *iter;
+	gsize size;
+
+	service->position_waiters = NULL;
+
+	for (iter = waiters; iter; iter = iter->next) {
+		struct position_request *position_req = iter->data;
+		if (position_req->reduce_precision)
+			size = reply_with_fix(position_req->req->handle, position_req->req->message, fix,
+			                      position_req->accuracy_level, true);
+		else if (luna_service_message_validate_and_send(position_req->req->handle,
+		                                                position_req->req->message, reply_obj))
+			size = strlen(jvalue_tostring_simple(reply_obj));
+		else
+			size = 0;
+		if (size)
+			location_usage_delivered(position_req->usage_app, 1, size);
+		position_waiter_free(position_req);
 	}
 
-	g_assert (g_variant_n_children (results) > 0);
-	g_variant_get_child (results, 0, "&o", &client_path);
+	g_list_free(waiters);
+}
 
-	GDBusProxy *client_props = g_dbus_proxy_new_for_bus_sync (G_BUS_TYPE_SYSTEM,
-	                          G_DBUS_PROXY_FLAGS_NONE,
-	                          NULL,
-	                          "org.freedesktop.GeoClue2",
-	                          client_path,
-	                          "org.freedesktop.DBus.Properties",
-	                          NULL,
-	                          &error);
+static GClueAccuracyLevel accuracy_from_palm(int palm_level)
+{
+	if (palm_level == PALM_ACCURACY_LEVEL_HIGH)
+		return GCLUE_ACCURACY_LEVEL_HIGH;
+	if (palm_level == PALM_ACCURACY_LEVEL_LOW)
+		return GCLUE_ACCURACY_LEVEL_LOW;
 
-	g_variant_unref (results);
-	if (error != NULL) {
-		g_critical ("Failed to connect to GeoClue2 service: %s", error->message);
-		goto error;
-	}
+	return GCLUE_ACCURACY_LEVEL_DEFAULT;
+}
 
-	GVariant *desktop_id = g_variant_new ("s", "location-service");
+/* The last fix of the session stands in for a new one as long as the
+ * session would not have delivered a newer one yet, or when it is within
+ * the maximumAge the caller accepts */
+static bool session_fix_current(struct location_service *service, double max_age)
+{
+	double age = (g_get_monotonic_time() - service->session_fix_time) / (double) G_USEC_PER_SEC;
 
-	results = g_dbus_proxy_call_sync (client_props,
-	                   "Set",
-	                   g_variant_new ("(ssv)",
-	                                  "org.freedesktop.GeoClue2.Client",
-	                                  "DesktopId",
-	                                  desktop_id),
-	                   G_DBUS_CALL_FLAGS_NONE,
-	                   -1,
-	                   NULL,
-	                   &error);
+	return age <= MAX(max_age, SESSION_FIX_MAX_AGE);
+}
 
-	if (results == NULL) {
-		g_critical ("Failed to start GeoClue2 client: %s", error->message);
-		goto error;
+static bool cbGetCurrentPosition(LSHandle *handle, LSMessage *message, void *user_data)
+{
+	struct location_service *service = user_data;
+	jvalue_ref accuracy_obj = NULL;
+	jvalue_ref max_age_obj = NULL;
+	jvalue_ref parsed_obj = NULL;
+	const char *payload = LSMessageGetPayload(message);
+	int palm_level = PALM_ACCURACY_LEVEL_DEFAULT;
+	double max_age = 0;
+	GClueAccuracyLevel geoclue_level = GCLUE_ACCURACY_LEVEL_DEFAULT;
+	const struct location_fix *cached_fix;
+	struct position_request *position_req;
+	struct location_usage_app *usage_app;
+	bool reduce_precision;
+	LocationAdmission admission;
+	char *app_id;
+	gsize size;
+
+	if (!check_permission(service, handle, message))
+		return true;
+
+	app_id = luna_service_message_get_caller_id(message);
+	usage_app = location_usage_lookup(service->usage, app_id);
+	location_usage_one_shot(usage_app);
+
+	parsed_obj = luna_service_message_parse_and_validate(payload);
+	if (jis_null(parsed_obj)) {
+		luna_service_message_reply_error_bad_json(handle, message);
+		goto cleanup;
 	}
-	g_variant_unref (results);
 
-	GVariant *level = g_variant_new ("u", GCLUE_ACCURACY_LEVEL_DEFAULT);
+	if (jobject_get_exists(parsed_obj, J_CSTR_TO_BUF("accuracy"), &accuracy_obj) &&
+		jis_number(accuracy_obj)) {
+		jnumber_get_i32(accuracy_obj, &palm_level);
+	}
+	geoclue_level = accuracy_from_palm(palm_level);
 
-	results = g_dbus_proxy_call_sync (client_props,
-	                   "Set",
-	                   g_variant_new ("(ssv)",
-	                                  "org.freedesktop.GeoClue2.Client",
-	                                  "RequestedAccuracyLevel",
-	                                  level),
-	                   G_DBUS_CALL_FLAGS_NONE,
-	                   -1,
-	                   NULL,
-	                   &error);
+	if (!location_services_enabled(service)) {
+		luna_service_message_reply_custom_error_code(handle, message, CODE_LocationServiceOFF);
+		goto cleanup;
+	}
+	geoclue_level = effective_accuracy_level(service, geoclue_level);
 
-	if (results == NULL) {
-		g_critical ("Failed to start GeoClue2 client: %s", error->message);
-		goto error;
+	/* maximumAge is in seconds, the default of 0 always asks for a new fix */
+	if (jobject_get_exists(parsed_obj, J_CSTR_TO_BUF("maximumAge"), &max_age_obj) &&
+		jis_number(max_age_obj)) {
+		jnumber_get_f64(max_age_obj, &max_age);
 	}
-	g_variant_unref (results);
-
-	GDBusProxy *client = g_dbus_proxy_new_for_bus_sync (G_BUS_TYPE_SYSTEM,
-	                          G_DBUS_PROXY_FLAGS_NONE,
-	                          NULL,
-	                          "org.freedesktop.GeoClue2",
-	                          g_dbus_proxy_get_object_path (client_props),
-	                          "org.freedesktop.GeoClue2.Client",
-	                          NULL,
-	                          &error);
-	if (error != NULL) {
-		g_critical ("Failed to connect to GeoClue2 service: %s", error->message);
-		goto error;
+
+	reduce_precision = luna_service_message_get_boolean(parsed_obj, "reducePrecision", false);
+
+	/* A running session is as current as a new fix would be, any fix good
+	 * enough for the request is served without a session of its own */
+	cached_fix = NULL;
+	if (service->tracking && !service->starting && !service->degraded && service->has_session_fix &&
+		session_fix_current(service, max_age) &&
+		location_fix_satisfies(&service->session_fix, service->session_level, geoclue_level))
+		cached_fix = &service->session_fix;
+	else if (service->has_radio_fix &&
+	         g_get_real_time() / (double) G_USEC_PER_SEC - service->radio_fix.timestamp <= RADIO_FIX_MAX_AGE &&
+	         location_fix_satisfies(&service->radio_fix, service->radio_level, geoclue_level))
+		cached_fix = &service->radio_fix;
+	else if (max_age > 0)
+		cached_fix = location_cache_best(service->cache, geoclue_level, max_age);
+
+	if (cached_fix) {
+		if (service->provider->one_shot_helper || !service->tracking)
+			service->avoided_sessions++;
+		size = reply_with_fix(handle, message, cached_fix, geoclue_level, reduce_precision);
+		if (size)
+			location_usage_delivered(usage_app, 1, size);
+		goto cleanup;
 	}
 
-	service->manager = manager;
-	service->client_props = client_props;
-	service->subscribed_client = client;
-	g_signal_connect (client, "g-signal",
-	                  G_CALLBACK (on_client_signal), service);
-	return true;
-error:
-	g_error_free (error);
-	return false;
+	if (location_usage_over_budget(usage_app)) {
+		reply_with_last_fix(service, handle, message, geoclue_level, reduce_precision,
+		                    usage_app, CODE_Budget_Exceeded);
+		goto cleanup;
+	}
+
+	struct luna_service_req_data *req = luna_service_req_data_new(handle, message);
+	position_req = g_new0(struct position_request, 1);
+	position_req->service = service;
+	position_req->accuracy_level = geoclue_level;
+	position_req->reduce_precision = reduce_precision;
+	position_req->req = req;
+
+	/* Other providers don't have a helper, the request is answered with the
+	 * next fix of the tracking session */
+	if (!service->provider->one_shot_helper) {
+		add_position_waiter(service, position_req, req);
+		goto cleanup;
+	}
+
+	req->user_data = position_req;
+	admission = location_admission_request(service->admission, app_id, req);
+
+	switch (admission) {
+	case LOCATION_ADMISSION_RUN:
+		one_shot_track(position_req);
+		start_one_shot(service, req);
+		break;
+	case LOCATION_ADMISSION_QUEUED:
+		one_shot_track(position_req);
+		break;
+	case LOCATION_ADMISSION_REJECTED:
+		/* Over the caller's limit, any fix we still have beats none */
+		reply_with_last_fix(service, handle, message, geoclue_level, reduce_precision,
+		                    usage_app, CODE_Has_Pending_Message);
+		location_service_one_shot_free(req);
+		break;
+	}
+
+cleanup:
+	g_free(app_id);
+	if (!jis_null(parsed_obj))
+		j_release(&parsed_obj);
+
+	return true;
+}
+
+/* The caller of a pending getCurrentPosition went away: waiters are dropped,
+ * queued requests leave the queue and running helpers are terminated, which
+ * stops their GeoClue client */
+static void abort_one_shot(struct location_service *service, struct position_request *position_req)
+{
+	struct luna_service_req_data *req = position_req->req;
+
+	position_req->cancelled = true;
+
+	if (g_list_find(service->position_waiters, position_req)) {
+		service->position_waiters = g_list_remove(service->position_waiters, position_req);
+		position_waiter_free(position_req);
+		session_release(service);
+	}
+	else if (position_req->pid || position_req->out_watch) {
+		/* The helper's watches free the request once it and its pipe are
+		 * gone, an exited helper's pid may already belong to another
+		 * process */
+		req->subscribed = false;
+		one_shot_untrack(position_req);
+		if (position_req->pid)
+			kill(position_req->pid, SIGTERM);
+	}
+	else if (location_admission_remove(service->admission, req)) {
+		location_service_one_shot_free(req);
+	}
+}
+
+static void cancel_one_shot(struct location_service *service, LSMessage *msg)
+{
+	struct position_request *position_req;
+	char *key;
+
+	key = g_strdup_printf("getCurrentPosition/%s", LSMessageGetUniqueToken(msg));
+	position_req = g_hash_table_lookup(service->one_shots, key);
+	g_free(key);
+	if (position_req)
+		abort_one_shot(service, position_req);
+}
+
+/* The master switch went off: pending one-shots, tracking, time zone and
+ * visit subscribers get errorCode 5 and the session ends, so nothing keeps
+ * locating the device */
+static void end_all_sessions(struct location_service *service)
+{
+	struct position_request *position_req;
+	struct tracking_subscriber *subscriber;
+	struct timezone_subscriber *timezone_subscriber;
+	struct visit_subscriber *visit_subscriber;
+	GList *one_shots, *iter;
+
+	one_shots = g_hash_table_get_values(service->one_shots);
+	for (iter = one_shots; iter; iter = iter->next) {
+		position_req = iter->data;
+		luna_service_message_reply_custom_error_code(position_req->req->handle, position_req->req->message,
+		                                             CODE_LocationServiceOFF);
+		/* Still subscribed, unlike a caller which went away */
+		one_shot_untrack(position_req);
+		abort_one_shot(service, position_req);
+	}
+	g_list_free(one_shots);
+
+	if (!service->tracking)
+		return;
+
+	g_list_foreach(service->tracking_batches, (GFunc) batch_flush, NULL);
+	for (iter = service->tracking_subscribers; iter; iter = iter->next) {
+		subscriber = iter->data;
+		luna_service_message_reply_custom_error_code(subscriber->handle, subscriber->message,
+		                                             CODE_LocationServiceOFF);
+	}
+	for (iter = service->timezone_subscribers; iter; iter = iter->next) {
+		timezone_subscriber = iter->data;
+		luna_service_message_reply_custom_error_code(timezone_subscriber->handle, timezone_subscriber->message,
+		                                             CODE_LocationServiceOFF);
+	}
+	for (iter = service->visit_subscribers; iter; iter = iter->next) {
+		visit_subscriber = iter->data;
+		luna_service_message_reply_custom_error_code(visit_subscriber->handle, visit_subscriber->message,
+		                                             CODE_LocationServiceOFF);
+	}
+
+	service->provider->stop(service->provider, service);
+	service_free(service);
+}
+
+static void rank_subscriber_free(struct rank_subscriber *subscriber)
+{
+	LSMessageUnref(subscriber->message);
+	location_rank_query_free(subscriber->query);
+	g_free(subscriber->token);
+	g_free(subscriber);
+}
+
+static void remove_rank_subscriber(struct location_service *service, LSHandle *handle, LSMessage *message)
+{
+	struct rank_subscriber *subscriber;
+	GList *iter;
+
+	for (iter = service->rank_subscribers; iter; iter = iter->next) {
+		subscriber = iter->data;
+		if (subscriber->handle == handle &&
+			!g_strcmp0(subscriber->token, LSMessageGetUniqueToken(message))) {
+			service->rank_subscribers = g_list_delete_link(service->rank_subscribers, iter);
+			rank_subscriber_free(subscriber);
+			break;
+		}
+	}
+}
+
+static void history_subscriber_free(struct history_subscriber *subscriber)
+{
+	LSMessageUnref(subscriber->message);
+	g_free(subscriber->app_id);
+	g_free(subscriber->token);
+	g_free(subscriber);
+}
+
+static void remove_history_subscriber(struct location_service *service, LSHandle *handle, LSMessage *message)
+{
+	struct history_subscriber *subscriber;
+	GList *iter;
+
+	for (iter = service->history_subscribers; iter; iter = iter->next) {
+		subscriber = iter->data;
+		if (subscriber->handle == handle &&
+			!g_strcmp0(subscriber->token, LSMessageGetUniqueToken(message))) {
+			service->history_subscribers = g_list_delete_link(service->history_subscribers, iter);
+			history_subscriber_free(subscriber);
+			break;
+		}
+	}
+}
+
+static void remove_visit_subscriber(struct location_service *service, LSHandle *handle, LSMessage *message)
+{
+	struct visit_subscriber *subscriber;
+	GList *iter;
+
+	for (iter = service->visit_subscribers; iter; iter = iter->next) {
+		subscriber = iter->data;
+		if (subscriber->handle == handle &&
+			!g_strcmp0(subscriber->token, LSMessageGetUniqueToken(message))) {
+			service->visit_subscribers = g_list_delete_link(service->visit_subscribers, iter);
+			visit_subscriber_free(subscriber);
+			break;
+		}
+	}
+
+	/* The next subscriber starts afresh, not from a stale candidate or
+	 * visit; the caller updates the demand */
+	if (!service->visit_subscribers)
+		location_visit_detector_reset(&service->visits);
+}
+
+/* Drops every subscriber on exit, before the handles are unregistered.
+ * Ranking and history subscribers don't depend on the session and aren't
+ * freed by service_free(). */
+void location_service_free_subscribers(struct location_service *service)
+{
+	service_free(service);
+	g_list_free_full(service->rank_subscribers, (GDestroyNotify) rank_subscriber_free);
+	service->rank_subscribers = NULL;
+	g_list_free_full(service->history_subscribers, (GDestroyNotify) history_subscriber_free);
+	service->history_subscribers = NULL;
+}
+
+static void remove_timezone_subscriber(struct location_service *service, LSHandle *handle, LSMessage *message)
+{
+	struct timezone_subscriber *subscriber;
+	GList *iter;
+
+	for (iter = service->timezone_subscribers; iter; iter = iter->next) {
+		subscriber = iter->data;
+		if (subscriber->handle == handle &&
+			!g_strcmp0(subscriber->token, LSMessageGetUniqueToken(message))) {
+			service->timezone_subscribers = g_list_delete_link(service->timezone_subscribers, iter);
+			timezone_subscriber_free(subscriber);
+			break;
+		}
+	}
+}
+
+/* Whether the predictor still has an estimate at time for any subscriber
+ * which wants predicted positions */
+static bool prediction_possible(struct location_service *service, gint64 time)
+{
+	struct tracking_subscriber *subscriber;
+	GList *iter;
+
+	for (iter = service->tracking_subscribers; iter; iter = iter->next) {
+		subscriber = iter->data;
+		if (subscriber->prediction_interval &&
+			location_predictor_valid_until(&service->predictor, subscriber->prediction_mode) > time)
+			return true;
+	}
+
+	return false;
+}
+
+/* Sends predicted positions to every subscriber whose own rate is due.
+ * Estimates are computed once per tick for all of them. The timer stops
+ * once no estimate is left, the next fix arms it again. */
+static gboolean prediction_cb(gpointer user_data)
+{
+	struct location_service *service = user_data;
+	struct tracking_subscriber *subscriber;
+	struct location_fix estimates[2];
+	bool computed[2] = { false, false }, valid[2] = { false, false };
+	jvalue_ref replies[2] = { NULL, NULL };
+	gint64 now = g_get_monotonic_time();
+	gint64 slack = (gint64) service->prediction_interval * 1000 / 2;
+	enum location_prediction_mode mode;
+	GList *iter;
+
+	for (iter = service->tracking_subscribers; iter; iter = iter->next) {
+		subscriber = iter->data;
+		if (!subscriber->prediction_interval || subscriber->coalescing || subscriber->batch ||
+			now - subscriber->last_predicted < (gint64) subscriber->prediction_interval * 1000 - slack)
+			continue;
+
+		mode = subscriber->prediction_mode;
+		if (!computed[mode]) {
+			computed[mode] = true;
+			valid[mode] = location_predictor_estimate(&service->predictor, mode, now, &estimates[mode]);
+			if (valid[mode]) {
+				replies[mode] = jobject_create();
+				location_fix_to_reply(&estimates[mode], &replies[mode]);
+				jobject_put(replies[mode], J_CSTR_TO_JVAL("predicted"), jboolean_create(true));
+			}
+		}
+		if (!valid[mode])
+			continue;
+
+		/* Predicted positions cost payload, not fixes */
+		subscriber->last_predicted = now;
+		if (luna_service_message_respond(subscriber->message, jvalue_tostring_simple(replies[mode])))
+			location_usage_delivered(subscriber->usage_app, 0, strlen(jvalue_tostring_simple(replies[mode])));
+	}
+
+	/* Shared memory readers get the extrapolated positions as well, flagged
+	 * so they can tell them from fixes */
+	if (service->shm && valid[LOCATION_PREDICTION_EXTRAPOLATE])
+		location_shm_append(service->shm, service->session_level, LOCATION_SHM_FLAG_PREDICTED,
+		                    &estimates[LOCATION_PREDICTION_EXTRAPOLATE]);
+
+	for (mode = 0; mode < G_N_ELEMENTS(replies); mode++) {
+		if (replies[mode])
+			j_release(&replies[mode]);
+	}
+
+	if (prediction_possible(service, now))
+		return TRUE;
+
+	service->prediction_timeout = 0;
+	service->prediction_interval = 0;
+	return FALSE;
+}
+
+/* One timer at the highest rate any subscriber asked for serves all of
+ * them, as long as there is anything to estimate */
+static void update_prediction_timer(struct location_service *service)
+{
+	struct tracking_subscriber *subscriber;
+	guint interval = 0;
+	GList *iter;
+
+	for (iter = service->tracking_subscribers; iter; iter = iter->next) {
+		subscriber = iter->data;
+		if (subscriber->prediction_interval &&
+			(!interval || subscriber->prediction_interval < interval))
+			interval = subscriber->prediction_interval;
+	}
+
+	if (interval && !prediction_possible(service, g_get_monotonic_time()))
+		interval = 0;
+
+	if (interval == service->prediction_interval)
+		return;
+
+	if (service->prediction_timeout)
+		g_source_remove(service->prediction_timeout);
+	service->prediction_timeout = interval ? g_timeout_add(interval, prediction_cb, service) : 0;
+	service->prediction_interval = interval;
+}
+
+static void cancel_subscription(LSHandle* sh, LSMessage* msg, struct location_service *service);
+static void update_budget_timer(struct location_service *service);
+
+static void cancel_func(LSHandle* sh, LSMessage* msg, struct location_service *service)
+{
+	const char *previous;
+
+	previous = location_watchdog_set_activity(service->watchdog, "subscription cancel");
+	cancel_subscription(sh, msg, service);
+	location_watchdog_set_activity(service->watchdog, previous);
+}
+
+static void cancel_subscription(LSHandle* sh, LSMessage* msg, struct location_service *service)
+{
+	struct tracking_subscriber *subscriber;
+	GList *iter;
+
+	if (!g_strcmp0(LSMessageGetMethod(msg), "getCurrentPosition")) {
+		cancel_one_shot(service, msg);
+		return;
+	}
+
+	if (!g_strcmp0(LSMessageGetMethod(msg), "getSharedMemory")) {
+		if (service->num_shm_readers > 0)
+			service->num_shm_readers--;
+		update_demand(service);
+		session_release(service);
+		return;
+	}
+
+	if (!g_strcmp0(LSMessageGetMethod(msg), "getTimeZone")) {
+		remove_timezone_subscriber(service, sh, msg);
+		update_demand(service);
+		session_release(service);
+		return;
+	}
+
+	if (!g_strcmp0(LSMessageGetMethod(msg), "rankByDistance")) {
+		remove_rank_subscriber(service, sh, msg);
+		return;
+	}
+
+	if (!g_strcmp0(LSMessageGetMethod(msg), "getVisits")) {
+		remove_visit_subscriber(service, sh, msg);
+		update_demand(service);
+		session_release(service);
+		return;
+	}
+
+	if (!g_strcmp0(LSMessageGetMethod(msg), "getHistory")) {
+		remove_history_subscriber(service, sh, msg);
+		return;
+	}
+
+	if (g_strcmp0(LSMessageGetMethod(msg), "startTracking"))
+		return;
+
+	for (iter = service->tracking_subscribers; iter; iter = iter->next) {
+		subscriber = iter->data;
+		if (subscriber->handle == sh &&
+			!g_strcmp0(subscriber->token, LSMessageGetUniqueToken(msg))) {
+			service->tracking_subscribers = g_list_delete_link(service->tracking_subscribers, iter);
+			batch_leave(service, subscriber);
+			tracking_subscriber_free(subscriber);
+			break;
+		}
+	}
+
+	update_prediction_timer(service);
+	update_budget_timer(service);
+	update_demand(service);
+	session_release(service);
+}
+
+/* The first payload of a new tracking subscriber: the latest fix of the
+ * session when it is accurate enough, otherwise the freshest cached one
+ * which is, so joining a session doesn't mean waiting for the next fix */
+static void reply_tracking_started(struct location_service *service, struct tracking_subscriber *subscriber)
+{
+	GClueAccuracyLevel level = effective_accuracy_level(service, subscriber->level);
+	const struct location_fix *fix;
+	jvalue_ref reply_obj = NULL;
+
+	if (service->has_session_fix && service->session_level >= level)
+		fix = &service->session_fix;
+	else
+		fix = location_cache_best(service->cache, level, TRACKING_INITIAL_MAX_AGE);
+
+	if (!fix) {
+		luna_service_message_reply_success(subscriber->handle, subscriber->message);
+		return;
+	}
+
+	reply_obj = jobject_create();
+	location_fix_to_reply(fix, &reply_obj);
+	if (luna_service_message_validate_and_send(subscriber->handle, subscriber->message, reply_obj))
+		location_usage_delivered(subscriber->usage_app, 1, strlen(jvalue_tostring_simple(reply_obj)));
+	j_release(&reply_obj);
+
+	subscriber->last_sent = g_get_monotonic_time();
+}
+
+static struct tracking_subscriber *find_tracking_subscriber(struct location_service *service, LSMessage *message)
+{
+	struct tracking_subscriber *subscriber;
+	GList *iter;
+
+	for (iter = service->tracking_subscribers; iter; iter = iter->next) {
+		subscriber = iter->data;
+		if (subscriber->message == message)
+			return subscriber;
+	}
+
+	return NULL;
+}
+
+static guint get_threshold(jvalue_ref parsed_obj, const char *name, int scale)
+{
+	jvalue_ref value_obj = NULL;
+	double value = 0;
+
+	if (jobject_get_exists(parsed_obj, j_cstr_to_buffer(name), &value_obj) &&
+		jis_number(value_obj))
+		jnumber_get_f64(value_obj, &value);
+
+	if (value <= 0)
+		return 0;
+
+	return (guint) MIN(value / scale, G_MAXUINT);
+}
+
+/* Optional parameters are "accuracy" (1 high to 3 low), "minimumInterval"
+ * in milliseconds and "minimumDistance" in meters between two fixes the
+ * subscriber needs. */
+static bool cbStartTracking(LSHandle *handle, LSMessage *message, void *user_data)
+{
+	struct location_service *service = user_data;
+	struct tracking_subscriber *subscriber;
+	jvalue_ref accuracy_obj = NULL;
+	jvalue_ref parsed_obj = NULL;
+	jvalue_ref value_obj = NULL;
+	int palm_level = PALM_ACCURACY_LEVEL_DEFAULT;
+	double prediction_rate = 0;
+	char *prediction_mode;
+	struct location_usage_app *usage_app;
+	guint batch_size, max_latency;
+	bool subscribed;
+	char *app_id;
+
+	if (!check_permission(service, handle, message))
+		return true;
+
+	if (!location_services_enabled(service)) {
+		luna_service_message_reply_custom_error_code(handle, message, CODE_LocationServiceOFF);
+		return true;
+	}
+
+	app_id = luna_service_message_get_caller_id(message);
+	usage_app = location_usage_lookup(service->usage, app_id);
+	g_free(app_id);
+	if (location_usage_over_budget(usage_app)) {
+		luna_service_message_reply_custom_error_code(handle, message, CODE_Budget_Exceeded);
+		return true;
+	}
+
+	parsed_obj = luna_service_message_parse_and_validate(LSMessageGetPayload(message));
+	if (jis_null(parsed_obj)) {
+		luna_service_message_reply_error_bad_json(handle, message);
+		goto cleanup;
+	}
+
+	subscribed = luna_service_check_for_subscription_and_process(handle, message);
+	if (!subscribed) {
+		luna_service_message_reply_success(handle, message);
+		goto cleanup;
+	}
+
+	if (jobject_get_exists(parsed_obj, J_CSTR_TO_BUF("accuracy"), &accuracy_obj) &&
+		jis_number(accuracy_obj))
+		jnumber_get_i32(accuracy_obj, &palm_level);
+
+	subscriber = g_new0(struct tracking_subscriber, 1);
+	subscriber->handle = handle;
+	subscriber->token = g_strdup(LSMessageGetUniqueToken(message));
+	subscriber->level = accuracy_from_palm(palm_level);
+	subscriber->message = message;
+	LSMessageRef(message);
+	subscriber->interval = get_threshold(parsed_obj, "minimumInterval", 1);
+	subscriber->distance = get_threshold(parsed_obj, "minimumDistance", 1);
+	if (jobject_get_exists(parsed_obj, J_CSTR_TO_BUF("predictionRate"), &value_obj) &&
+		jis_number(value_obj)) {
+		jnumber_get_f64(value_obj, &prediction_rate);
+		if (prediction_rate > 0)
+			subscriber->prediction_interval = 1000 / CLAMP(prediction_rate, PREDICTION_MIN_RATE,
+			                                               PREDICTION_MAX_RATE);
+	}
+	prediction_mode = luna_service_message_get_string(parsed_obj, "predictionMode", NULL);
+	if (!g_strcmp0(prediction_mode, "interpolate"))
+		subscriber->prediction_mode = LOCATION_PREDICTION_INTERPOLATE;
+	g_free(prediction_mode);
+	batch_size = get_threshold(parsed_obj, "batchSize", 1);
+	max_latency = get_threshold(parsed_obj, "maxLatency", 1);
+	if (batch_size > 1)
+		batch_join(service, subscriber, MIN(batch_size, BATCH_MAX_SIZE),
+		           max_latency ? max_latency : BATCH_DEFAULT_LATENCY);
+	subscriber->usage_app = usage_app;
+	subscriber->usage_level = effective_accuracy_level(service, subscriber->level);
+	location_usage_start(usage_app, subscriber->usage_level);
+	service->tracking_subscribers = g_list_append(service->tracking_subscribers, subscriber);
+
+	if (!session_start(service)) {
+		luna_service_message_reply_custom_error_code(handle, message, CODE_Unknown);
+		goto cleanup;
+	}
+	update_demand(service);
+	update_prediction_timer(service);
+	update_budget_timer(service);
+
+	/* Answered once the provider reports whether it could start */
+	if (service->starting) {
+		service->pending_starts = g_list_append(service->pending_starts,
+		                                        luna_service_req_data_new(handle, message));
+		goto cleanup;
+	}
+
+	reply_tracking_started(service, subscriber);
+
+cleanup:
+	if (!jis_null(parsed_obj))
+		j_release(&parsed_obj);
+
+	return true;
+}
+
+/* Sends payload to a subscriber. Responding only queues the message on
+ * our connection to the hub, luna-service2 tells neither how far a client
+ * is behind nor blocks when it stops reading, so only deliveries which
+ * fail outright show a subscriber doesn't keep up. */
+static bool subscriber_send(struct tracking_subscriber *subscriber, const char *payload, gsize payload_size)
+{
+	if (!luna_service_message_respond(subscriber->message, payload))
+		return false;
+
+	location_usage_delivered(subscriber->usage_app, 1, payload_size);
+
+	return true;
+}
+
+/* Sends the latest fix with the number of fixes it replaced to every
+ * coalescing subscriber */
+static gboolean coalesce_cb(gpointer user_data)
+{
+	struct location_service *service = user_data;
+	struct tracking_subscriber *subscriber;
+	jvalue_ref reply_obj = NULL;
+	bool coalescing = false;
+	const char *payload;
+	GList *iter;
+
+	for (iter = service->tracking_subscribers; iter; iter = iter->next) {
+		subscriber = iter->data;
+		if (!subscriber->coalescing)
+			continue;
+
+		if (subscriber->has_latest) {
+			reply_obj = jobject_create();
+			location_fix_to_reply(&subscriber->latest, &reply_obj);
+			jobject_put(reply_obj, J_CSTR_TO_JVAL("droppedUpdates"), jnumber_create_i32(subscriber->dropped));
+			payload = jvalue_tostring_simple(reply_obj);
+
+			if (subscriber_send(subscriber, payload, strlen(payload))) {
+				subscriber->has_latest = false;
+				subscriber->dropped = 0;
+				subscriber->last_sent = g_get_monotonic_time();
+				subscriber->recovered++;
+			}
+			else
+				subscriber->recovered = 0;
+
+			j_release(&reply_obj);
+		}
+
+		if (subscriber->recovered >= SUBSCRIBER_RECOVER_DELIVERIES) {
+			subscriber->coalescing = false;
+			subscriber->failures = 0;
+			subscriber->recovered = 0;
+		}
+		else
+			coalescing = true;
+	}
+
+	if (!coalescing)
+		service->coalesce_timeout = 0;
+
+	return coalescing;
+}
+
+/* Every subscriber gets its own copy of the fix so one which doesn't keep up
+ * can be switched to coalescing without slowing down the others */
+static void deliver_to_subscribers(struct location_service *service, const struct location_fix *fix,
+                                   jvalue_ref reply_obj)
+{
+	struct tracking_subscriber *subscriber;
+	const char *payload = NULL;
+	gsize payload_size = 0;
+	gint64 now = g_get_monotonic_time();
+	GList *iter;
+
+	for (iter = service->tracking_batches; iter; iter = iter->next)
+		batch_add(iter->data, fix, now);
+
+	for (iter = service->tracking_subscribers; iter; iter = iter->next) {
+		subscriber = iter->data;
+
+		if (subscriber->batch)
+			continue;
+
+		if (subscriber->coalescing) {
+			if (subscriber->has_latest)
+				subscriber->dropped++;
+			subscriber->latest = *fix;
+			subscriber->has_latest = true;
+			continue;
+		}
+
+		if (subscriber->last_sent &&
+			now - subscriber->last_sent < (gint64) subscriber->interval * 1000)
+			continue;
+
+		if (!payload) {
+			payload = jvalue_tostring_simple(reply_obj);
+			payload_size = strlen(payload);
+		}
+
+		if (subscriber_send(subscriber, payload, payload_size)) {
+			subscriber->failures = 0;
+			subscriber->last_sent = now;
+			continue;
+		}
+
+		if (++subscriber->failures < SUBSCRIBER_MAX_FAILURES)
+			continue;
+
+		g_warning("Subscriber %s doesn't keep up, only sending the latest fix", subscriber->token);
+		subscriber->coalescing = true;
+		subscriber->latest = *fix;
+		subscriber->has_latest = true;
+		if (!service->coalesce_timeout)
+			service->coalesce_timeout = g_timeout_add_seconds(COALESCE_INTERVAL, coalesce_cb, service);
+	}
+}
+
+void location_service_provider_started(struct location_service *service, bool success)
+{
+	struct tracking_subscriber *subscriber;
+	struct luna_service_req_data *req;
+	GList *pending;
+
+	pending = service->pending_starts;
+	service->pending_starts = NULL;
+	service->starting = false;
+
+	if (!success)
+		g_warning("Failed to start %s location provider", service->provider->name);
+
+	for (GList *iter = pending; iter; iter = iter->next) {
+		req = iter->data;
+		subscriber = success ? find_tracking_subscriber(service, req->message) : NULL;
+		if (subscriber)
+			reply_tracking_started(service, subscriber);
+		else if (success)
+			luna_service_message_reply_success(req->handle, req->message);
+		else
+			luna_service_message_reply_custom_error_code(req->handle, req->message, CODE_Unknown);
+	}
+	g_list_free_full(pending, (GDestroyNotify) luna_service_req_data_free);
+
+	if (!success) {
+		service->provider->stop(service->provider, service);
+		service_free(service);
+	}
+}
+
+static jvalue_ref rank_reply(struct location_rank_query *query, double latitude, double longitude)
+{
+	jvalue_ref reply_obj;
+
+	location_rank_query_run(query, latitude, longitude);
+
+	reply_obj = jobject_create();
+	jobject_put(reply_obj, J_CSTR_TO_JVAL("returnValue"), jboolean_create(true));
+	jobject_put(reply_obj, J_CSTR_TO_JVAL("latitude"), jnumber_create_f64(latitude));
+	jobject_put(reply_obj, J_CSTR_TO_JVAL("longitude"), jnumber_create_f64(longitude));
+	location_rank_query_to_reply(query, reply_obj);
+
+	return reply_obj;
+}
+
+/* Rank subscribers follow the fixes of the session but don't keep it
+ * running themselves */
+static void rank_for_subscribers(struct location_service *service, const struct location_fix *fix)
+{
+	struct rank_subscriber *subscriber;
+	jvalue_ref reply_obj;
+	GList *iter;
+
+	for (iter = service->rank_subscribers; iter; iter = iter->next) {
+		subscriber = iter->data;
+		reply_obj = rank_reply(subscriber->query, fix->latitude, fix->longitude);
+		luna_service_message_respond(subscriber->message, jvalue_tostring_simple(reply_obj));
+		j_release(&reply_obj);
+	}
+}
+
+static jvalue_ref history_points_to_json(const struct location_history_point *points, guint count)
+{
+	jvalue_ref points_obj = jarray_create(NULL);
+	jvalue_ref point_obj;
+	guint n;
+
+	for (n = 0; n < count; n++) {
+		point_obj = jobject_create();
+		jobject_put(point_obj, J_CSTR_TO_JVAL("latitude"), jnumber_create_f64(points[n].latitude));
+		jobject_put(point_obj, J_CSTR_TO_JVAL("longitude"), jnumber_create_f64(points[n].longitude));
+		jobject_put(point_obj, J_CSTR_TO_JVAL("timestamp"), jnumber_create_f64(points[n].timestamp));
+		jobject_put(point_obj, J_CSTR_TO_JVAL("horizAccuracy"), jnumber_create_f64(points[n].horiz_accuracy));
+		jarray_append(points_obj, point_obj);
+	}
+
+	return points_obj;
+}
+
+/* History subscribers follow the fixes of the session but don't keep it
+ * running themselves. Only points which are part of the simplified track
+ * are sent. */
+static void simplify_for_subscribers(struct location_service *service, const struct location_fix *fix)
+{
+	struct history_subscriber *subscriber;
+	struct location_history_point point, committed;
+	jvalue_ref reply_obj;
+	double since;
+	GList *iter;
+
+	location_history_point_from_fix(&point, fix);
+
+	for (iter = service->history_subscribers; iter; iter = iter->next) {
+		subscriber = iter->data;
+		if (subscriber->app_id && !location_usage_session_since(service->usage, subscriber->app_id, &since))
+			continue;
+		if (!location_simplifier_add(&subscriber->simplifier, &point, &committed))
+			continue;
+
+		reply_obj = jobject_create();
+		jobject_put(reply_obj, J_CSTR_TO_JVAL("returnValue"), jboolean_create(true));
+		jobject_put(reply_obj, J_CSTR_TO_JVAL("points"), history_points_to_json(&committed, 1));
+		luna_service_message_respond(subscriber->message, jvalue_tostring_simple(reply_obj));
+		j_release(&reply_obj);
+	}
+}
+
+static jvalue_ref visit_to_json(const struct location_visit *visit)
+{
+	jvalue_ref visit_obj = jobject_create();
+
+	jobject_put(visit_obj, J_CSTR_TO_JVAL("latitude"), jnumber_create_f64(visit->latitude));
+	jobject_put(visit_obj, J_CSTR_TO_JVAL("longitude"), jnumber_create_f64(visit->longitude));
+	jobject_put(visit_obj, J_CSTR_TO_JVAL("radius"), jnumber_create_f64(visit->radius));
+	jobject_put(visit_obj, J_CSTR_TO_JVAL("arrival"), jnumber_create_f64(visit->arrival));
+	jobject_put(visit_obj, J_CSTR_TO_JVAL("duration"), jnumber_create_f64(visit->departure - visit->arrival));
+
+	return visit_obj;
+}
+
+/* Runs the visit detector while anyone listens and tells them when a visit
+ * starts or ends. The demand follows whether a visit is going on. */
+static void detect_visits(struct location_service *service, const struct location_fix *fix)
+{
+	struct visit_subscriber *subscriber;
+	enum location_visit_event event;
+	jvalue_ref reply_obj, visit_obj;
+	struct location_visit visit;
+	const char *payload;
+	GList *iter;
+
+	if (!service->visit_subscribers)
+		return;
+
+	event = location_visit_detector_add(&service->visits, fix, &visit);
+	if (event == LOCATION_VISIT_NONE)
+		return;
+
+	visit_obj = visit_to_json(&visit);
+	if (event == LOCATION_VISIT_END)
+		jobject_put(visit_obj, J_CSTR_TO_JVAL("departure"), jnumber_create_f64(visit.departure));
+
+	reply_obj = jobject_create();
+	jobject_put(reply_obj, J_CSTR_TO_JVAL("returnValue"), jboolean_create(true));
+	jobject_put(reply_obj, J_CSTR_TO_JVAL("event"),
+	            jstring_create(event == LOCATION_VISIT_START ? "visitStart" : "visitEnd"));
+	jobject_put(reply_obj, J_CSTR_TO_JVAL("visit"), visit_obj);
+	payload = jvalue_tostring_simple(reply_obj);
+
+	for (iter = service->visit_subscribers; iter; iter = iter->next) {
+		subscriber = iter->data;
+		luna_service_message_respond(subscriber->message, payload);
+	}
+
+	j_release(&reply_obj);
+	update_demand(service);
+}
+
+static jvalue_ref timezone_reply(const char *zone, const struct location_fix *fix)
+{
+	jvalue_ref reply_obj;
+
+	reply_obj = jobject_create();
+	jobject_put(reply_obj, J_CSTR_TO_JVAL("returnValue"), jboolean_create(true));
+	jobject_put(reply_obj, J_CSTR_TO_JVAL("timeZone"), jstring_create(zone));
+	if (fix)
+		jobject_put(reply_obj, J_CSTR_TO_JVAL("timestamp"), jnumber_create_f64(fix->timestamp));
+
+	return reply_obj;
+}
+
+/* Only subscribers whose zone changed hear about the fix */
+static void notify_timezone_subscribers(struct location_service *service, const struct location_fix *fix)
+{
+	struct timezone_subscriber *subscriber;
+	jvalue_ref reply_obj = NULL;
+	const char *zone;
+	GList *iter;
+
+	if (!service->timezone_subscribers)
+		return;
+
+	zone = location_timezone_lookup(service->timezones, fix->latitude, fix->longitude);
+
+	for (iter = service->timezone_subscribers; iter; iter = iter->next) {
+		subscriber = iter->data;
+		if (!g_strcmp0(subscriber->zone, zone))
+			continue;
+
+		if (!reply_obj)
+			reply_obj = timezone_reply(zone, fix);
+		if (luna_service_message_respond(subscriber->message, jvalue_tostring_simple(reply_obj)))
+			subscriber->zone = zone;
+	}
+
+	if (reply_obj)
+		j_release(&reply_obj);
+}
+
+/* Subscriptions stay in place while the provider is degraded, subscribers
+ * get errorCode 2 and then fixes again once it recovered */
+void location_service_provider_degraded(struct location_service *service, bool degraded)
+{
+	struct tracking_subscriber *subscriber;
+	char *payload;
+	GList *iter;
+
+	if (service->degraded == degraded)
+		return;
+
+	service->degraded = degraded;
+	if (!degraded) {
+		g_message("%s location provider recovered", service->provider->name);
+		return;
+	}
+
+	g_warning("%s location provider degraded", service->provider->name);
+
+	payload = g_strdup_printf("{\"returnValue\":true, \"errorCode\":%d}", CODE_Position_Unavailable);
+	for (iter = service->tracking_subscribers; iter; iter = iter->next) {
+		subscriber = iter->data;
+		luna_service_message_respond(subscriber->message, payload);
+	}
+	g_free(payload);
+}
+
+/* Tracking subscribers of apps which used up their budget are told so and
+ * dropped, which may lower the demand or end the session */
+static void enforce_budgets(struct location_service *service)
+{
+	struct tracking_subscriber *subscriber;
+	GList *iter, *next;
+	bool removed = false;
+
+	for (iter = service->tracking_subscribers; iter; iter = next) {
+		next = iter->next;
+		subscriber = iter->data;
+		if (!location_usage_over_budget(subscriber->usage_app))
+			continue;
+
+		luna_service_message_reply_custom_error_code(subscriber->handle, subscriber->message,
+		                                             CODE_Budget_Exceeded);
+		service->tracking_subscribers = g_list_delete_link(service->tracking_subscribers, iter);
+		batch_leave(service, subscriber);
+		tracking_subscriber_free(subscriber);
+		removed = true;
+	}
+
+	if (!removed)
+		return;
+
+	update_prediction_timer(service);
+	update_budget_timer(service);
+	update_demand(service);
+	session_release(service);
+}
+
+static gboolean budget_cb(gpointer user_data)
+{
+	struct location_service *service = user_data;
+
+	service->budget_timeout = 0;
+	enforce_budgets(service);
+	update_budget_timer(service);
+
+	return FALSE;
+}
+
+/* One timer fires when the first app with a tracking subscriber and a
+ * budget has used it up. Session time only passes while an app holds a
+ * session, so it is rearmed whenever the subscribers or budgets change. */
+static void update_budget_timer(struct location_service *service)
+{
+	struct tracking_subscriber *subscriber;
+	gint64 left, soonest = -1;
+	GList *iter;
+
+	for (iter = service->tracking_subscribers; iter; iter = iter->next) {
+		subscriber = iter->data;
+		left = location_usage_budget_left(subscriber->usage_app);
+		if (left >= 0 && (soonest < 0 || left < soonest))
+			soonest = left;
+	}
+
+	if (service->budget_timeout)
+		g_source_remove(service->budget_timeout);
+	/* Rounded up so the budget is used up when the timer fires, a timer cut
+	 * short by the limit only rearms itself */
+	service->budget_timeout = soonest >= 0 ?
+		g_timeout_add(MIN((soonest + 999) / 1000, G_MAXUINT), budget_cb, service) : 0;
+}
+
+/* Every fix of the tracking session goes through here, whichever provider
+ * produced it */
+void location_service_handle_fix(struct location_service *service, GClueAccuracyLevel level,
+                                 const struct location_fix *fix)
+{
+	const char *previous;
+
+	/* Keeps the activity of a method call the fix may be delivered from */
+	previous = location_watchdog_set_activity(service->watchdog, "fix delivery");
+
+	location_cache_update(service->cache, level, fix);
+	service->session_fix = *fix;
+	service->session_fix_time = g_get_monotonic_time();
+	service->session_level = level;
+	service->has_session_fix = true;
+	location_predictor_add(&service->predictor, fix, g_get_monotonic_time());
+	update_prediction_timer(service);
+	location_history_append(service->history, fix);
+	if (service->trace_writer)
+		location_trace_writer_append(service->trace_writer, level, fix);
+	if (service->shm)
+		location_shm_append(service->shm, level, 0, fix);
+
+	jvalue_ref reply_obj = NULL;
+	reply_obj = jobject_create();
+	location_fix_to_reply(fix, &reply_obj);
+	enforce_budgets(service);
+	deliver_to_subscribers(service, fix, reply_obj);
+	rank_for_subscribers(service, fix);
+	notify_timezone_subscribers(service, fix);
+	simplify_for_subscribers(service, fix);
+	detect_visits(service, fix);
+
+	if (service->position_waiters) {
+		answer_position_waiters(service, fix, reply_obj);
+		session_release(service);
+	}
+
+	if (!jis_null(reply_obj))
+		j_release(&reply_obj);
+
+	location_watchdog_set_activity(service->watchdog, previous);
+}
+
+static const struct pref_method *find_pref_method(const char *name)
+{
+	const struct pref_method *method;
+
+	for (method = pref_methods; method->method; method++) {
+		if (!g_strcmp0(method->method, name))
+			return method;
+	}
+
+	return NULL;
+}
+
+static jvalue_ref pref_method_reply(struct location_service *service, const struct pref_method *method)
+{
+	jvalue_ref reply_obj = jobject_create();
+
+	jobject_put(reply_obj, J_CSTR_TO_JVAL("returnValue"), jboolean_create(true));
+	jobject_put(reply_obj, jstring_create(method->key),
+	            jboolean_create(location_prefs_get(service->prefs, method->pref)));
+
+	return reply_obj;
+}
+
+static jvalue_ref prefs_reply(struct location_service *service)
+{
+	jvalue_ref reply_obj = location_prefs_to_json(service->prefs);
+
+	jobject_put(reply_obj, J_CSTR_TO_JVAL("returnValue"), jboolean_create(true));
+
+	return reply_obj;
+}
+
+static bool cbPreference(LSHandle *handle, LSMessage *message, void *user_data)
+{
+	struct location_service *service = user_data;
+	const struct pref_method *method;
+	jvalue_ref parsed_obj = NULL;
+	jvalue_ref value_obj = NULL;
+	jvalue_ref reply_obj = NULL;
+	bool subscribed;
+	bool value = false;
+
+	method = find_pref_method(LSMessageGetMethod(message));
+	if (!method) {
+		luna_service_message_reply_error_not_implemented(handle, message);
+		return true;
+	}
+
+	/* Preferences apply to the whole device, apps may only read them */
+	if (method->type != PREF_METHOD_GET && !check_privileged(handle, message))
+		return true;
+
+	parsed_obj = luna_service_message_parse_and_validate(LSMessageGetPayload(message));
+	if (jis_null(parsed_obj)) {
+		luna_service_message_reply_error_bad_json(handle, message);
+		goto cleanup;
+	}
+
+	switch (method->type) {
+	case PREF_METHOD_GET:
+		subscribed = luna_service_check_for_subscription_and_process(handle, message);
+		reply_obj = pref_method_reply(service, method);
+		jobject_put(reply_obj, J_CSTR_TO_JVAL("subscribed"), jboolean_create(subscribed));
+		luna_service_message_validate_and_send(handle, message, reply_obj);
+		j_release(&reply_obj);
+		break;
+	case PREF_METHOD_SET:
+		if (!jobject_get_exists(parsed_obj, j_cstr_to_buffer(method->key), &value_obj) ||
+			!jis_boolean(value_obj)) {
+			luna_service_message_reply_error_invalid_params(handle, message);
+			break;
+		}
+		jboolean_get(value_obj, &value);
+		location_prefs_set(service->prefs, method->pref, value);
+		luna_service_message_reply_success(handle, message);
+		break;
+	case PREF_METHOD_SET_TRUE:
+	case PREF_METHOD_SET_FALSE:
+		location_prefs_set(service->prefs, method->pref, method->type == PREF_METHOD_SET_TRUE);
+		luna_service_message_reply_success(handle, message);
+		break;
+	}
+
+cleanup:
+	if (!jis_null(parsed_obj))
+		j_release(&parsed_obj);
+
+	return true;
+}
+
+static bool cbGetLocationServicePrefs(LSHandle *handle, LSMessage *message, void *user_data)
+{
+	struct location_service *service = user_data;
+	jvalue_ref reply_obj = NULL;
+	bool subscribed;
+
+	subscribed = luna_service_check_for_subscription_and_process(handle, message);
+
+	reply_obj = prefs_reply(service);
+	jobject_put(reply_obj, J_CSTR_TO_JVAL("subscribed"), jboolean_create(subscribed));
+	luna_service_message_validate_and_send(handle, message, reply_obj);
+	j_release(&reply_obj);
+
+	return true;
+}
+
+static bool cbSetLocationServicePrefs(LSHandle *handle, LSMessage *message, void *user_data)
+{
+	struct location_service *service = user_data;
+	jvalue_ref parsed_obj = NULL;
+	jvalue_ref value_obj = NULL;
+	bool found = false;
+	bool value;
+	int pref;
+
+	if (!check_privileged(handle, message))
+		return true;
+
+	parsed_obj = luna_service_message_parse_and_validate(LSMessageGetPayload(message));
+	if (jis_null(parsed_obj)) {
+		luna_service_message_reply_error_bad_json(handle, message);
+		goto cleanup;
+	}
+
+	for (pref = 0; pref < LOCATION_PREF_COUNT; pref++) {
+		if (!jobject_get_exists(parsed_obj, j_cstr_to_buffer(location_prefs_get_key(pref)), &value_obj) ||
+			!jis_boolean(value_obj))
+			continue;
+
+		jboolean_get(value_obj, &value);
+		location_prefs_set(service->prefs, pref, value);
+		found = true;
+	}
+
+	if (!found) {
+		luna_service_message_reply_error_invalid_params(handle, message);
+		goto cleanup;
+	}
+
+	luna_service_message_reply_success(handle, message);
+
+cleanup:
+	if (!jis_null(parsed_obj))
+		j_release(&parsed_obj);
+
+	return true;
+}
+
+static bool cbSetWebSetting(LSHandle *handle, LSMessage *message, void *user_data)
+{
+	struct location_service *service = user_data;
+	jvalue_ref parsed_obj = NULL;
+	jvalue_ref allowed_obj = NULL;
+	char *domain = NULL;
+	bool allowed;
+
+	if (!check_privileged(handle, message))
+		return true;
+
+	parsed_obj = luna_service_message_parse_and_validate(LSMessageGetPayload(message));
+	if (jis_null(parsed_obj)) {
+		luna_service_message_reply_error_bad_json(handle, message);
+		goto cleanup;
+	}
+
+	domain = luna_service_message_get_string(parsed_obj, "domain", NULL);
+	if (!jobject_get_exists(parsed_obj, J_CSTR_TO_BUF("allowed"), &allowed_obj) ||
+		!jis_boolean(allowed_obj)) {
+		luna_service_message_reply_error_invalid_params(handle, message);
+		goto cleanup;
+	}
+	jboolean_get(allowed_obj, &allowed);
+
+	if (!location_prefs_set_web_setting(service->prefs, domain, allowed)) {
+		luna_service_message_reply_error_invalid_params(handle, message);
+		goto cleanup;
+	}
+
+	luna_service_message_reply_success(handle, message);
+
+cleanup:
+	g_free(domain);
+	if (!jis_null(parsed_obj))
+		j_release(&parsed_obj);
+
+	return true;
+}
+
+static bool cbClearWebSetting(LSHandle *handle, LSMessage *message, void *user_data)
+{
+	struct location_service *service = user_data;
+	jvalue_ref parsed_obj = NULL;
+	char *domain = NULL;
+
+	if (!check_privileged(handle, message))
+		return true;
+
+	parsed_obj = luna_service_message_parse_and_validate(LSMessageGetPayload(message));
+	if (jis_null(parsed_obj)) {
+		luna_service_message_reply_error_bad_json(handle, message);
+		goto cleanup;
+	}
+
+	/* Without a domain all web settings are cleared */
+	domain = luna_service_message_get_string(parsed_obj, "domain", NULL);
+	location_prefs_clear_web_setting(service->prefs, domain);
+
+	luna_service_message_reply_success(handle, message);
+
+cleanup:
+	g_free(domain);
+	if (!jis_null(parsed_obj))
+		j_release(&parsed_obj);
+
+	return true;
+}
+
+static bool cbLocationRequestDecision(LSHandle *handle, LSMessage *message, void *user_data)
+{
+	struct location_service *service = user_data;
+	const char *method = LSMessageGetMethod(message);
+	LocationPermission permission = LOCATION_PERMISSION_UNDECIDED;
+	jvalue_ref parsed_obj = NULL;
+	char *app_id = NULL;
+
+	/* Decisions are the user's, taken through the system UI. An app must
+	 * not be able to accept for itself. */
+	if (!check_privileged(handle, message))
+		return true;
+
+	parsed_obj = luna_service_message_parse_and_validate(LSMessageGetPayload(message));
+	if (jis_null(parsed_obj)) {
+		luna_service_message_reply_error_bad_json(handle, message);
+		goto cleanup;
+	}
+
+	app_id = luna_service_message_get_string(parsed_obj, "appId", NULL);
+	if (!app_id) {
+		luna_service_message_reply_error_invalid_params(handle, message);
+		goto cleanup;
+	}
+
+	if (!g_strcmp0(method, "acceptLocationRequest"))
+		permission = LOCATION_PERMISSION_ALLOWED;
+	else if (!g_strcmp0(method, "acceptAlwaysLocationRequest"))
+		permission = LOCATION_PERMISSION_ALLOWED_ALWAYS;
+	else if (!g_strcmp0(method, "rejectLocationRequest"))
+		permission = luna_service_message_get_boolean(parsed_obj, "blacklist", false) ?
+			LOCATION_PERMISSION_BLACKLISTED : LOCATION_PERMISSION_DENIED;
+
+	if (!location_permissions_set(service->permissions, app_id, permission)) {
+		luna_service_message_reply_error_invalid_params(handle, message);
+		goto cleanup;
+	}
+
+	luna_service_message_reply_success(handle, message);
+
+cleanup:
+	g_free(app_id);
+	if (!jis_null(parsed_obj))
+		j_release(&parsed_obj);
+
+	return true;
+}
+
+/* Describes the shared memory segment, see location_shm.h. With subscribe
+ * the caller counts as a tracking client so the ring keeps being filled
+ * until the subscription is cancelled. */
+static bool cbGetSharedMemory(LSHandle *handle, LSMessage *message, void *user_data)
+{
+	struct location_service *service = user_data;
+	jvalue_ref reply_obj = NULL;
+	bool subscribed;
+
+	if (!service->shm) {
+		luna_service_message_reply_custom_error(handle, message, "Shared memory is not enabled");
+		return true;
+	}
+
+	/* Whoever reads the segment sees every fix, see location_shm.h */
+	if (!check_privileged(handle, message) || !check_permission(service, handle, message))
+		return true;
+
+	if (!location_services_enabled(service)) {
+		luna_service_message_reply_custom_error_code(handle, message, CODE_LocationServiceOFF);
+		return true;
+	}
+
+	subscribed = luna_service_check_for_subscription_and_process(handle, message);
+	if (subscribed) {
+		if (!session_start(service)) {
+			luna_service_message_reply_custom_error_code(handle, message, CODE_Unknown);
+			return true;
+		}
+		service->num_shm_readers++;
+	}
+
+	reply_obj = jobject_create();
+	jobject_put(reply_obj, J_CSTR_TO_JVAL("returnValue"), jboolean_create(true));
+	jobject_put(reply_obj, J_CSTR_TO_JVAL("name"), jstring_create(LOCATION_SHM_NAME));
+	jobject_put(reply_obj, J_CSTR_TO_JVAL("version"), jnumber_create_i32(LOCATION_SHM_VERSION));
+	jobject_put(reply_obj, J_CSTR_TO_JVAL("size"), jnumber_create_i32(LOCATION_SHM_SIZE));
+	jobject_put(reply_obj, J_CSTR_TO_JVAL("recordSize"), jnumber_create_i32(sizeof(struct location_shm_record)));
+	jobject_put(reply_obj, J_CSTR_TO_JVAL("capacity"), jnumber_create_i32(LOCATION_SHM_CAPACITY));
+	jobject_put(reply_obj, J_CSTR_TO_JVAL("wakeup"), jstring_create("futex"));
+	jobject_put(reply_obj, J_CSTR_TO_JVAL("subscribed"), jboolean_create(subscribed));
+	luna_service_message_validate_and_send(handle, message, reply_obj);
+	j_release(&reply_obj);
+
+	return true;
+}
+
+/* Ranks "points" ([{latitude, longitude}]) or the named "dataset" by
+ * distance from "latitude"/"longitude" and returns the indices of the
+ * nearest "count" ones. Without a reference the last known fix is used and
+ * with subscribe the ranking is updated with every new fix. */
+static bool cbRankByDistance(LSHandle *handle, LSMessage *message, void *user_data)
+{
+	struct location_service *service = user_data;
+	struct rank_subscriber *subscriber;
+	struct location_rank_query *query = NULL;
+	struct location_points *points = NULL;
+	const struct location_fix *fix;
+	jvalue_ref parsed_obj = NULL;
+	jvalue_ref value_obj = NULL;
+	jvalue_ref latitude_obj = NULL;
+	jvalue_ref longitude_obj = NULL;
+	jvalue_ref reply_obj = NULL;
+	double latitude, longitude;
+	char *name;
+	int count = 10;
+	bool has_reference;
+
+	parsed_obj = luna_service_message_parse_and_validate(LSMessageGetPayload(message));
+	if (jis_null(parsed_obj)) {
+		luna_service_message_reply_error_bad_json(handle, message);
+		goto cleanup;
+	}
+
+	if (jobject_get_exists(parsed_obj, J_CSTR_TO_BUF("points"), &value_obj)) {
+		points = location_points_new_from_json(value_obj);
+		if (!points) {
+			luna_service_message_reply_custom_error(handle, message, "Invalid points");
+			goto cleanup;
+		}
+	}
+	else if ((name = luna_service_message_get_string(parsed_obj, "dataset", NULL))) {
+		points = location_ranking_get_dataset(service->ranking, name);
+		g_free(name);
+		if (!points) {
+			luna_service_message_reply_custom_error(handle, message, "Unknown dataset");
+			goto cleanup;
+		}
+	}
+	else {
+		luna_service_message_reply_custom_error(handle, message, "Either points or dataset is required");
+		goto cleanup;
+	}
+
+	if (jobject_get_exists(parsed_obj, J_CSTR_TO_BUF("count"), &value_obj) &&
+		jis_number(value_obj))
+		jnumber_get_i32(value_obj, &count);
+	if (count <= 0 || count > LOCATION_RANKING_MAX_COUNT) {
+		luna_service_message_reply_custom_error(handle, message, "Invalid count");
+		goto cleanup;
+	}
+
+	has_reference = jobject_get_exists(parsed_obj, J_CSTR_TO_BUF("latitude"), &latitude_obj) &&
+	                jobject_get_exists(parsed_obj, J_CSTR_TO_BUF("longitude"), &longitude_obj) &&
+	                jis_number(latitude_obj) && jis_number(longitude_obj);
+	if (has_reference) {
+		jnumber_get_f64(latitude_obj, &latitude);
+		jnumber_get_f64(longitude_obj, &longitude);
+	}
+	else {
+		if (!check_permission(service, handle, message))
+			goto cleanup;
+
+		fix = location_cache_latest(service->cache);
+		if (!fix) {
+			luna_service_message_reply_custom_error_code(handle, message, CODE_Position_Unavailable);
+			goto cleanup;
+		}
+		latitude = fix->latitude;
+		longitude = fix->longitude;
+	}
+
+	query = location_rank_query_new(points, count);
+	reply_obj = rank_reply(query, latitude, longitude);
+
+	if (!has_reference && luna_service_check_for_subscription_and_process(handle, message)) {
+		jobject_put(reply_obj, J_CSTR_TO_JVAL("subscribed"), jboolean_create(true));
+
+		subscriber = g_new0(struct rank_subscriber, 1);
+		subscriber->handle = handle;
+		subscriber->message = message;
+		LSMessageRef(message);
+		subscriber->token = g_strdup(LSMessageGetUniqueToken(message));
+		subscriber->query = query;
+		query = NULL;
+		service->rank_subscribers = g_list_append(service->rank_subscribers, subscriber);
+	}
+
+	luna_service_message_validate_and_send(handle, message, reply_obj);
+
+cleanup:
+	location_rank_query_free(query);
+	location_points_unref(points);
+	if (!jis_null(reply_obj))
+		j_release(&reply_obj);
+	if (!jis_null(parsed_obj))
+		j_release(&parsed_obj);
+
+	return true;
+}
+
+static double get_number(jvalue_ref parsed_obj, const char *name, double default_value)
+{
+	jvalue_ref value_obj = NULL;
+	double value = default_value;
+
+	if (jobject_get_exists(parsed_obj, j_cstr_to_buffer(name), &value_obj) &&
+		jis_number(value_obj))
+		jnumber_get_f64(value_obj, &value);
+
+	return value;
+}
+
+/* Returns the fixes of the session between "since" and "until" (seconds
+ * since the epoch), simplified so the track stays within "tolerance"
+ * meters of every fix left out. With subscribe the caller then gets the
+ * further points of the simplified track as the session delivers fixes.
+ * Only privileged callers see the whole history, apps only what was
+ * recorded while they held a session themselves. */
+static bool cbGetHistory(LSHandle *handle, LSMessage *message, void *user_data)
+{
+	struct location_service *service = user_data;
+	struct history_subscriber *subscriber;
+	jvalue_ref parsed_obj = NULL;
+	jvalue_ref reply_obj = NULL;
+	double since, until, tolerance, session_since;
+	GArray *points = NULL;
+	char *app_id = NULL;
+	guint num_points;
+	bool subscribed = false, has_session = true, truncated;
+
+	if (!check_permission(service, handle, message))
+		return true;
+
+	parsed_obj = luna_service_message_parse_and_validate(LSMessageGetPayload(message));
+	if (jis_null(parsed_obj)) {
+		luna_service_message_reply_error_bad_json(handle, message);
+		goto cleanup;
+	}
+
+	since = get_number(parsed_obj, "since", 0);
+	until = get_number(parsed_obj, "until", G_MAXDOUBLE);
+	tolerance = get_number(parsed_obj, "tolerance", 0);
+	if (tolerance < 0 || since > until) {
+		luna_service_message_reply_error_invalid_params(handle, message);
+		goto cleanup;
+	}
+
+	if (!luna_service_message_is_privileged(message)) {
+		app_id = luna_service_message_get_caller_id(message);
+		has_session = location_usage_session_since(service->usage, app_id, &session_since);
+		since = has_session ? MAX(since, session_since) : G_MAXDOUBLE;
+	}
+
+	points = location_history_query(service->history, since, until, tolerance, &num_points);
+
+	/* The caller asks again from the last point for the rest */
+	truncated = points->len > HISTORY_MAX_POINTS;
+	if (truncated)
+		g_array_set_size(points, HISTORY_MAX_POINTS);
+
+	reply_obj = jobject_create();
+	jobject_put(reply_obj, J_CSTR_TO_JVAL("returnValue"), jboolean_create(true));
+	jobject_put(reply_obj, J_CSTR_TO_JVAL("points"),
+	            history_points_to_json((const struct location_history_point *) points->data, points->len));
+	jobject_put(reply_obj, J_CSTR_TO_JVAL("numFixes"), jnumber_create_i32(num_points));
+	jobject_put(reply_obj, J_CSTR_TO_JVAL("truncated"), jboolean_create(truncated));
+
+	/* Subscribing continues from the last point, which only works once the
+	 * caller has all of them, and needs a session of the app's own */
+	if (!truncated && has_session)
+		subscribed = luna_service_check_for_subscription_and_process(handle, message);
+	if (subscribed) {
+		subscriber = g_new0(struct history_subscriber, 1);
+		subscriber->handle = handle;
+		subscriber->message = message;
+		LSMessageRef(message);
+		subscriber->token = g_strdup(LSMessageGetUniqueToken(message));
+		subscriber->app_id = app_id;
+		app_id = NULL;
+		/* The track continues from the last point the caller has */
+		location_simplifier_init(&subscriber->simplifier, tolerance,
+		                         points->len ? &g_array_index(points, struct location_history_point,
+		                                                      points->len - 1) : NULL);
+		service->history_subscribers = g_list_append(service->history_subscribers, subscriber);
+	}
+	jobject_put(reply_obj, J_CSTR_TO_JVAL("subscribed"), jboolean_create(subscribed));
+
+	luna_service_message_validate_and_send(handle, message, reply_obj);
+
+cleanup:
+	g_free(app_id);
+	if (points)
+		g_array_free(points, TRUE);
+	if (!jis_null(reply_obj))
+		j_release(&reply_obj);
+	if (!jis_null(parsed_obj))
+		j_release(&parsed_obj);
+
+	return true;
+}
+
+/* Keeps the tracking session running to detect visits, the subscriber
+ * gets a "visitStart" or "visitEnd" event with the centroid, radius and
+ * duration of the visit. The first reply has the visit going on, if any. */
+static bool cbGetVisits(LSHandle *handle, LSMessage *message, void *user_data)
+{
+	struct location_service *service = user_data;
+	struct visit_subscriber *subscriber;
+	jvalue_ref reply_obj = NULL;
+
+	if (!check_permission(service, handle, message))
+		return true;
+
+	if (!location_services_enabled(service)) {
+		luna_service_message_reply_custom_error_code(handle, message, CODE_LocationServiceOFF);
+		return true;
+	}
+
+	if (!luna_service_check_for_subscription_and_process(handle, message)) {
+		luna_service_message_reply_custom_error(handle, message, "getVisits needs a subscription");
+		return true;
+	}
+
+	if (!session_start(service)) {
+		luna_service_message_reply_custom_error_code(handle, message, CODE_Unknown);
+		return true;
+	}
+
+	subscriber = g_new0(struct visit_subscriber, 1);
+	subscriber->handle = handle;
+	subscriber->message = message;
+	LSMessageRef(message);
+	subscriber->token = g_strdup(LSMessageGetUniqueToken(message));
+	service->visit_subscribers = g_list_append(service->visit_subscribers, subscriber);
+	update_demand(service);
+
+	reply_obj = jobject_create();
+	jobject_put(reply_obj, J_CSTR_TO_JVAL("returnValue"), jboolean_create(true));
+	jobject_put(reply_obj, J_CSTR_TO_JVAL("subscribed"), jboolean_create(true));
+	if (service->visits.in_visit)
+		jobject_put(reply_obj, J_CSTR_TO_JVAL("visit"), visit_to_json(&service->visits.visit));
+	luna_service_message_validate_and_send(handle, message, reply_obj);
+	j_release(&reply_obj);
+
+	return true;
+}
+
+/* Session time, fixes and bytes sent and one-shot requests of the caller,
+ * or of every app or only "appId" for privileged callers, since the
+ * service started or the app got its entry */
+static bool cbGetUsage(LSHandle *handle, LSMessage *message, void *user_data)
+{
+	struct location_service *service = user_data;
+	jvalue_ref parsed_obj = NULL;
+	jvalue_ref reply_obj = NULL;
+	char *app_id = NULL;
+
+	if (!check_permission(service, handle, message))
+		return true;
+
+	parsed_obj = luna_service_message_parse_and_validate(LSMessageGetPayload(message));
+	if (jis_null(parsed_obj)) {
+		luna_service_message_reply_error_bad_json(handle, message);
+		goto cleanup;
+	}
+
+	/* Apps only learn about their own usage */
+	if (luna_service_message_is_privileged(message)) {
+		app_id = luna_service_message_get_string(parsed_obj, "appId", NULL);
+	}
+	else {
+		app_id = luna_service_message_get_caller_id(message);
+		if (!app_id) {
+			luna_service_message_reply_custom_error_code(handle, message, CODE_PermissionDenied);
+			goto cleanup;
+		}
+	}
+
+	reply_obj = jobject_create();
+	jobject_put(reply_obj, J_CSTR_TO_JVAL("returnValue"), jboolean_create(true));
+	location_usage_to_reply(service->usage, app_id, reply_obj);
+	luna_service_message_validate_and_send(handle, message, reply_obj);
+	j_release(&reply_obj);
+
+cleanup:
+	g_free(app_id);
+	if (!jis_null(parsed_obj))
+		j_release(&parsed_obj);
+
+	return true;
+}
+
+/* "sessionTime" is the number of seconds of GeoClue session "appId" may
+ * hold per budget period, 0 removes its budget. Budgets last until the
+ * service restarts and only privileged callers may set them. */
+static bool cbSetUsageBudget(LSHandle *handle, LSMessage *message, void *user_data)
+{
+	struct location_service *service = user_data;
+	jvalue_ref parsed_obj = NULL;
+	jvalue_ref value_obj = NULL;
+	char *app_id = NULL;
+	double seconds = -1;
+
+	if (!check_privileged(handle, message))
+		return true;
+
+	parsed_obj = luna_service_message_parse_and_validate(LSMessageGetPayload(message));
+	if (jis_null(parsed_obj)) {
+		luna_service_message_reply_error_bad_json(handle, message);
+		goto cleanup;
+	}
+
+	app_id = luna_service_message_get_string(parsed_obj, "appId", NULL);
+	if (jobject_get_exists(parsed_obj, J_CSTR_TO_BUF("sessionTime"), &value_obj) &&
+		jis_number(value_obj))
+		jnumber_get_f64(value_obj, &seconds);
+
+	if (!app_id || seconds < 0 ||
+		!location_usage_set_budget(service->usage, app_id, (guint) MIN(seconds, G_MAXUINT))) {
+		luna_service_message_reply_error_invalid_params(handle, message);
+		goto cleanup;
+	}
+
+	/* A lowered budget may already be used up */
+	update_budget_timer(service);
+	luna_service_message_reply_success(handle, message);
+
+cleanup:
+	g_free(app_id);
+	if (!jis_null(parsed_obj))
+		j_release(&parsed_obj);
+
+	return true;
+}
+
+static bool valid_coordinates(double latitude, double longitude)
+{
+	return latitude >= -90 && latitude <= 90 && longitude >= -180 && longitude <= 180;
+}
+
+/* Returns the time zone at "latitude"/"longitude" or at the last known
+ * fix. With subscribe the tracking session is kept running at city
+ * accuracy and the subscriber hears about every change of the zone. */
+static bool cbGetTimeZone(LSHandle *handle, LSMessage *message, void *user_data)
+{
+	struct location_service *service = user_data;
+	struct timezone_subscriber *subscriber;
+	const struct location_fix *fix = NULL;
+	jvalue_ref parsed_obj = NULL;
+	jvalue_ref latitude_obj = NULL;
+	jvalue_ref longitude_obj = NULL;
+	jvalue_ref reply_obj = NULL;
+	double latitude, longitude;
+	const char *zone = NULL;
+	bool subscribed;
+
+	if (!service->timezones) {
+		luna_service_message_reply_custom_error(handle, message, "Time zone index is not available");
+		return true;
+	}
+
+	parsed_obj = luna_service_message_parse_and_validate(LSMessageGetPayload(message));
+	if (jis_null(parsed_obj)) {
+		luna_service_message_reply_error_bad_json(handle, message);
+		goto cleanup;
+	}
+
+	if (jobject_get_exists(parsed_obj, J_CSTR_TO_BUF("latitude"), &latitude_obj) &&
+		jobject_get_exists(parsed_obj, J_CSTR_TO_BUF("longitude"), &longitude_obj) &&
+		jis_number(latitude_obj) && jis_number(longitude_obj)) {
+		jnumber_get_f64(latitude_obj, &latitude);
+		jnumber_get_f64(longitude_obj, &longitude);
+		if (!valid_coordinates(latitude, longitude)) {
+			luna_service_message_reply_custom_error(handle, message, "Invalid coordinates");
+			goto cleanup;
+		}
+
+		reply_obj = timezone_reply(location_timezone_lookup(service->timezones, latitude, longitude), NULL);
+		luna_service_message_validate_and_send(handle, message, reply_obj);
+		goto cleanup;
+	}
+
+	if (!check_permission(service, handle, message))
+		goto cleanup;
+
+	if (!location_services_enabled(service)) {
+		luna_service_message_reply_custom_error_code(handle, message, CODE_LocationServiceOFF);
+		goto cleanup;
+	}
+
+	fix = location_cache_latest(service->cache);
+	if (fix)
+		zone = location_timezone_lookup(service->timezones, fix->latitude, fix->longitude);
+
+	subscribed = luna_service_check_for_subscription_and_process(handle, message);
+	if (!subscribed && !zone) {
+		luna_service_message_reply_custom_error_code(handle, message, CODE_Position_Unavailable);
+		goto cleanup;
+	}
+
+	if (subscribed) {
+		if (!session_start(service)) {
+			luna_service_message_reply_custom_error_code(handle, message, CODE_Unknown);
+			goto cleanup;
+		}
+
+		subscriber = g_new0(struct timezone_subscriber, 1);
+		subscriber->handle = handle;
+		subscriber->message = message;
+		LSMessageRef(message);
+		subscriber->token = g_strdup(LSMessageGetUniqueToken(message));
+		subscriber->zone = zone;
+		service->timezone_subscribers = g_list_append(service->timezone_subscribers, subscriber);
+		update_demand(service);
+	}
+
+	if (zone) {
+		reply_obj = timezone_reply(zone, fix);
+	}
+	else {
+		reply_obj = jobject_create();
+		jobject_put(reply_obj, J_CSTR_TO_JVAL("returnValue"), jboolean_create(true));
+	}
+	jobject_put(reply_obj, J_CSTR_TO_JVAL("subscribed"), jboolean_create(subscribed));
+	luna_service_message_validate_and_send(handle, message, reply_obj);
+
+cleanup:
+	if (!jis_null(reply_obj))
+		j_release(&reply_obj);
+	if (!jis_null(parsed_obj))
+		j_release(&parsed_obj);
+
+	return true;
+}
+
+/* A fix located from the offline radio map. It answers getCurrentPosition
+ * for a while and goes into the cache; a running session gets it when it
+ * is good enough for the subscribers and the provider has nothing better,
+ * e.g. while GeoClue has no network. */
+void location_service_radio_fix(GClueAccuracyLevel level, const struct location_fix *fix, void *user_data)
+{
+	struct location_service *service = user_data;
+
+	service->radio_fix = *fix;
+	service->radio_level = level;
+	service->has_radio_fix = true;
+
+	if (service->tracking && !service->starting &&
+		location_fix_satisfies(fix, level, service->demand.level) &&
+		(service->degraded || !service->has_session_fix || service->session_level <= level))
+		location_service_handle_fix(service, level, fix);
+	else
+		location_cache_update(service->cache, level, fix);
+}
+
+void location_service_prefs_changed(int pref, void *user_data)
+{
+	struct location_service *service = user_data;
+	const struct pref_method *method;
+	jvalue_ref reply_obj = NULL;
+
+	if (pref != LOCATION_PREF_WEB_SETTINGS) {
+		for (method = pref_methods; method->method; method++) {
+			if (method->pref != pref || method->type != PREF_METHOD_GET)
+				continue;
+
+			reply_obj = pref_method_reply(service, method);
+			post_to_all_handles(service, method->method, reply_obj);
+			j_release(&reply_obj);
+		}
+	}
+
+	reply_obj = prefs_reply(service);
+	post_to_all_handles(service, "getLocationServicePrefs", reply_obj);
+	j_release(&reply_obj);
+
+	if ((pref == LOCATION_PREF_USE_GPS || pref == LOCATION_PREF_USE_GOOGLE) &&
+		!location_services_enabled(service))
+		end_all_sessions(service);
+	else if (pref == LOCATION_PREF_USE_GPS)
+		update_demand(service);
+}
+
+static bool cbGetStatus(LSHandle *handle, LSMessage *message, void *user_data)
+{
+	struct location_service *service = user_data;
+	jvalue_ref reply_obj = NULL;
+
+	reply_obj = jobject_create();
+	jobject_put(reply_obj, J_CSTR_TO_JVAL("returnValue"), jboolean_create(true));
+	jobject_put(reply_obj, J_CSTR_TO_JVAL("provider"), jstring_create(service->provider->name));
+	jobject_put(reply_obj, J_CSTR_TO_JVAL("tracking"), jboolean_create(service->tracking));
+	jobject_put(reply_obj, J_CSTR_TO_JVAL("degraded"), jboolean_create(service->degraded));
+	jobject_put(reply_obj, J_CSTR_TO_JVAL("trackingSubscribers"),
+	            jnumber_create_i32(g_list_length(service->tracking_subscribers)));
+	jobject_put(reply_obj, J_CSTR_TO_JVAL("avoidedSessions"), jnumber_create_i32(service->avoided_sessions));
+	if (service->watchdog)
+		location_watchdog_to_reply(service->watchdog, reply_obj);
+	luna_service_message_validate_and_send(handle, message, reply_obj);
+	j_release(&reply_obj);
+
+	return true;
+}
+
+/* Every method call goes through here so the watchdog can name the method
+ * when the call stalls the main loop */
+static bool dispatch_method(LSHandle *handle, LSMessage *message, void *user_data)
+{
+	struct location_service *service = user_data;
+	const char *name = LSMessageGetMethod(message);
+	const char *previous;
+	LSMethod *method;
+	bool ret = true;
+
+	for (method = location_service_methods; method->name; method++) {
+		if (!g_strcmp0(method->name, name))
+			break;
+	}
+	if (!method->name)
+		return true;
+
+	previous = location_watchdog_set_activity(service->watchdog, method->name);
+	ret = method->function(handle, message, user_data);
+	location_watchdog_set_activity(service->watchdog, previous);
+
+	return ret;
+}
+
+static LSMethod *dispatched_methods(void)
+{
+	static LSMethod *methods;
+	guint n;
+
+	if (methods)
+		return methods;
+
+	methods = g_new0(LSMethod, G_N_ELEMENTS(location_service_methods));
+	for (n = 0; location_service_methods[n].name; n++) {
+		methods[n] = location_service_methods[n];
+		methods[n].function = dispatch_method;
+	}
+
+	return methods;
 }
 
 bool location_service_register(struct location_service *service, LSHandle **handle, const char *name)
@@ -482,7 +2975,7 @@ bool location_service_register(struct location_service *service, LSHandle **hand
 		goto error;
 	}
 
-	if (!LSRegisterCategory(*handle, "/", location_service_methods,
+	if (!LSRegisterCategory(*handle, "/", dispatched_methods(),
 	                        NULL, NULL, &error)) {
 		g_warning("Could not register service category: %s", error.message);
 		LSErrorFree(&error);
@@ -25,6 +25,54 @@
 
 #include <glib/gi18n.h>
 #include <gio/gio.h>
+#include <luna-service2/lunaservice.h>
+
+#include "location_common.h"
+#include "location_predictor.h"
+#include "location_visits.h"
+
+struct location_cache;
+struct location_prefs;
+struct location_permissions;
+struct location_trace_writer;
+struct location_shm;
+struct location_admission;
+struct location_ranking;
+struct location_timezone;
+struct location_watchdog;
+struct location_radio;
+struct location_history;
+struct location_usage;
+struct location_service;
+
+/* What the tracking session has to deliver: the loosest settings which
+ * still satisfy every tracking subscriber. Thresholds of 0 ask for every
+ * fix. */
+struct location_demand {
+	GClueAccuracyLevel level;
+	guint time_threshold;
+	guint distance_threshold;
+};
+
+/* A source of fixes for the tracking session. Fixes are handed to
+ * location_service_handle_fix() until stop() is called. An async provider
+ * only begins starting in start() and reports the outcome later with
+ * location_service_provider_started(). With one_shot_helper set single
+ * requests are served by location-getposition instead of the session.
+ * set_demand() is called whenever service->demand changes while the session
+ * is running. A provider which lost its source without the session being
+ * stopped reports it with location_service_provider_degraded() and again
+ * once fixes can flow again. */
+struct location_provider {
+	const char *name;
+	bool async;
+	bool one_shot_helper;
+	bool (*start)(struct location_provider *provider, struct location_service *service);
+	void (*stop)(struct location_provider *provider, struct location_service *service);
+	void (*set_demand)(struct location_provider *provider, struct location_service *service,
+	                   const struct location_demand *demand);
+	void (*free)(struct location_provider *provider);
+};
 
 struct location_service {
 	LSHandle *handle_ports1;
@@ -33,18 +81,58 @@ struct location_service {
 	LSHandle *handle_palm2;
 	LSHandle *handle_webos1;
 	LSHandle *handle_webos2;
-	GDBusProxy *manager;
-	GDBusProxy *client_props;
-	GDBusProxy *subscribed_client;
-	int num_clients_ports1;
-	int num_clients_ports2;
-	int num_clients_palm1;
-	int num_clients_palm2;
-	int num_clients_webos1;
-	int num_clients_webos2;
+	GList *tracking_subscribers;
+	GList *tracking_batches;
+	GList *rank_subscribers;
+	GList *timezone_subscribers;
+	GList *history_subscribers;
+	GList *visit_subscribers;
+	struct location_visit_detector visits;
+	guint coalesce_timeout;
+	struct location_predictor predictor;
+	guint prediction_timeout;
+	guint prediction_interval;
+	guint budget_timeout;
+	int num_shm_readers;
+	struct location_demand demand;
+	struct location_provider *provider;
+	bool tracking;
+	bool starting;
+	bool degraded;
+	bool has_session_fix;
+	GClueAccuracyLevel session_level;
+	struct location_fix session_fix;
+	gint64 session_fix_time;
+	bool has_radio_fix;
+	GClueAccuracyLevel radio_level;
+	struct location_fix radio_fix;
+	guint avoided_sessions;
+	GList *pending_starts;
+	GList *position_waiters;
+	GHashTable *one_shots;
+	struct location_cache *cache;
+	struct location_prefs *prefs;
+	struct location_permissions *permissions;
+	struct location_trace_writer *trace_writer;
+	struct location_shm *shm;
+	struct location_admission *admission;
+	struct location_ranking *ranking;
+	struct location_timezone *timezones;
+	struct location_watchdog *watchdog;
+	struct location_radio *radio;
+	struct location_history *history;
+	struct location_usage *usage;
 };
 
 bool location_service_register(struct location_service *service, LSHandle **handle, const char *name);
 void location_service_unregister(LSHandle *handle);
+void location_service_prefs_changed(int pref, void *user_data);
+void location_service_radio_fix(GClueAccuracyLevel level, const struct location_fix *fix, void *user_data);
+void location_service_one_shot_free(gpointer data);
+void location_service_free_subscribers(struct location_service *service);
+void location_service_provider_started(struct location_service *service, bool success);
+void location_service_provider_degraded(struct location_service *service, bool degraded);
+void location_service_handle_fix(struct location_service *service, GClueAccuracyLevel level,
+                                 const struct location_fix *fix);
 
 #endif
@@ -0,0 +1,157 @@
+/* @@@LICENSE
+*
+* Copyright (c) 2026 LuneOS Project
+*
+* This file is part of location-service.
+*
+* location-service is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* location-service is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with location-service.  If not, see <http://www.gnu.org/licenses/>.
+*
+* LICENSE@@@ */
+
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <glib.h>
+
+#include "location_shm.h"
+
+struct location_shm {
+	int fd;
+	struct location_shm_header *header;
+};
+
+static bool header_valid(const struct location_shm_header *header)
+{
+	return header->magic == LOCATION_SHM_MAGIC &&
+		header->version == LOCATION_SHM_VERSION &&
+		header->record_size == sizeof(struct location_shm_record) &&
+		header->capacity == LOCATION_SHM_CAPACITY;
+}
+
+/* A record whose counter is still odd was being written when an earlier
+ * run died. Its contents are garbage, so it is cleared and the counter made
+ * even again, otherwise readers would spin on it until it is overwritten. */
+static void clear_torn_records(struct location_shm_header *header)
+{
+	struct location_shm_record *slot;
+	uint32_t seq;
+	int n;
+
+	for (n = 0; n < LOCATION_SHM_CAPACITY; n++) {
+		slot = &header->records[n];
+		seq = slot->seq;
+		if (!(seq & 1))
+			continue;
+
+		memset((char *) slot + sizeof(slot->seq), 0, sizeof(*slot) - sizeof(slot->seq));
+		__atomic_store_n(&slot->seq, seq + 1, __ATOMIC_RELEASE);
+	}
+}
+
+struct location_shm *location_shm_new(void)
+{
+	struct location_shm *shm;
+	void *mapping;
+	int fd;
+
+	fd = shm_open(LOCATION_SHM_NAME, O_CREAT | O_RDWR, 0640);
+	if (fd < 0) {
+		g_warning("Failed to open shared memory %s: %s", LOCATION_SHM_NAME, strerror(errno));
+		return NULL;
+	}
+
+	/* Readers only ever get read access, whatever the umask is. Membership
+	 * of the group grants access to every fix, see location_shm.h. */
+	if (fchmod(fd, 0640) < 0 || ftruncate(fd, LOCATION_SHM_SIZE) < 0) {
+		g_warning("Failed to set up shared memory %s: %s", LOCATION_SHM_NAME, strerror(errno));
+		close(fd);
+		return NULL;
+	}
+
+	mapping = mmap(NULL, LOCATION_SHM_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (mapping == MAP_FAILED) {
+		g_warning("Failed to map shared memory %s: %s", LOCATION_SHM_NAME, strerror(errno));
+		close(fd);
+		return NULL;
+	}
+
+	shm = g_new0(struct location_shm, 1);
+	shm->fd = fd;
+	shm->header = mapping;
+
+	/* A segment left by an earlier run is kept so readers which still have
+	 * it mapped continue seamlessly, anything else is reset */
+	if (!header_valid(shm->header)) {
+		memset(shm->header, 0, LOCATION_SHM_SIZE);
+		shm->header->version = LOCATION_SHM_VERSION;
+		shm->header->record_size = sizeof(struct location_shm_record);
+		shm->header->capacity = LOCATION_SHM_CAPACITY;
+		__atomic_store_n(&shm->header->magic, LOCATION_SHM_MAGIC, __ATOMIC_RELEASE);
+	}
+	else {
+		clear_torn_records(shm->header);
+	}
+
+	return shm;
+}
+
+void location_shm_free(struct location_shm *shm)
+{
+	if (!shm)
+		return;
+
+	/* The segment isn't unlinked, see location_shm_new() */
+	munmap(shm->header, LOCATION_SHM_SIZE);
+	close(shm->fd);
+	g_free(shm);
+}
+
+void location_shm_append(struct location_shm *shm, GClueAccuracyLevel level, uint32_t flags,
+						 const struct location_fix *fix)
+{
+	struct location_shm_header *header = shm->header;
+	struct location_shm_record *slot;
+	uint32_t count, seq;
+
+	count = header->count;
+	slot = &header->records[count % LOCATION_SHM_CAPACITY];
+	/* Odd when an earlier run died while writing the record */
+	seq = (slot->seq + 1) & ~1u;
+
+	__atomic_store_n(&slot->seq, seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	slot->flags = flags;
+	slot->monotonic_us = g_get_monotonic_time();
+	slot->level = level;
+	slot->latitude = fix->latitude;
+	slot->longitude = fix->longitude;
+	slot->altitude = fix->altitude;
+	slot->horiz_accuracy = fix->horiz_accuracy;
+	slot->vert_accuracy = fix->vert_accuracy;
+	slot->heading = fix->heading;
+	slot->velocity = fix->velocity;
+	slot->timestamp = fix->timestamp;
+
+	__atomic_store_n(&slot->seq, seq + 2, __ATOMIC_RELEASE);
+	__atomic_store_n(&header->count, count + 1, __ATOMIC_RELEASE);
+
+	/* Not a private futex, the waiters live in other processes */
+	syscall(SYS_futex, &header->count, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+}
+
+// vim:ts=4:sw=4:noexpandtab
@@ -0,0 +1,138 @@
+/* @@@LICENSE
+*
+* Copyright (c) 2026 LuneOS Project
+*
+* This file is part of location-service.
+*
+* location-service is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* location-service is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with location-service.  If not, see <http://www.gnu.org/licenses/>.
+*
+* LICENSE@@@ */
+
+
+#ifndef LOCATION_SHM_H_
+#define LOCATION_SHM_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#include "location_common.h"
+
+/* Shared memory segment with the latest fixes for local readers which want
+ * positions at a high rate without a Luna round trip per update.
+ *
+ * The segment is a header followed by a ring of fixed size records. The
+ * service is the only writer. Every record is guarded by its own sequence
+ * counter which is odd while the record is being written, a reader copies
+ * the record and retries when the counter changed meanwhile. The count field
+ * of the header is incremented after each record and doubles as a futex
+ * word, readers sleep on it to get woken up for the next fix.
+ *
+ * Readers find the segment with the getSharedMemory method, open it with
+ * shm_open(name, O_RDONLY, 0) and map it read-only.
+ *
+ * The segment is readable by the group of the service. Per-app permission
+ * decisions can't be applied to it, so the group is trusted like the
+ * service itself and may only contain system components; getSharedMemory
+ * is limited to privileged callers for the same reason. */
+
+#define LOCATION_SHM_NAME			"/org.webosports.service.location"
+#define LOCATION_SHM_MAGIC			0x53434f4c
+#define LOCATION_SHM_VERSION		1
+#define LOCATION_SHM_CAPACITY		64
+
+/* The record is an estimate and not a measured fix */
+#define LOCATION_SHM_FLAG_PREDICTED	(1 << 0)
+
+struct location_shm_record {
+	uint32_t seq;
+	uint32_t flags;
+	int64_t monotonic_us;
+	uint32_t level;
+	uint32_t reserved;
+	double latitude;
+	double longitude;
+	double altitude;
+	double horiz_accuracy;
+	double vert_accuracy;
+	double heading;
+	double velocity;
+	double timestamp;
+};
+
+struct location_shm_header {
+	uint32_t magic;
+	uint16_t version;
+	uint16_t record_size;
+	uint32_t capacity;
+	uint32_t count;
+	uint64_t reserved[6];
+	struct location_shm_record records[];
+};
+
+#define LOCATION_SHM_SIZE	(sizeof(struct location_shm_header) + \
+							 LOCATION_SHM_CAPACITY * sizeof(struct location_shm_record))
+
+/* Copies record number index (count - 1 is the latest one). Fails when the
+ * writer kept overwriting the record. */
+static inline bool location_shm_read(const struct location_shm_header *header, uint32_t index,
+									 struct location_shm_record *record)
+{
+	const struct location_shm_record *slot = &header->records[index % header->capacity];
+	uint32_t seq;
+	int tries;
+
+	for (tries = 0; tries < 100; tries++) {
+		seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+		if (seq & 1)
+			continue;
+
+		memcpy(record, slot, sizeof(*record));
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if (__atomic_load_n(&slot->seq, __ATOMIC_RELAXED) == seq)
+			return true;
+	}
+
+	return false;
+}
+
+/* Sleeps until the count moved past last_count or the timeout expired and
+ * returns the current count */
+static inline uint32_t location_shm_wait(const struct location_shm_header *header, uint32_t last_count,
+										 const struct timespec *timeout)
+{
+	uint32_t count = __atomic_load_n(&header->count, __ATOMIC_ACQUIRE);
+
+	if (count == last_count) {
+		syscall(SYS_futex, &header->count, FUTEX_WAIT, last_count, timeout, NULL, 0);
+		count = __atomic_load_n(&header->count, __ATOMIC_ACQUIRE);
+	}
+
+	return count;
+}
+
+struct location_shm;
+
+struct location_shm *location_shm_new(void);
+void location_shm_free(struct location_shm *shm);
+void location_shm_append(struct location_shm *shm, GClueAccuracyLevel level, uint32_t flags,
+						 const struct location_fix *fix);
+
+#endif
+
+// vim:ts=4:sw=4:noexpandtab
@@ -0,0 +1,79 @@
+/* @@@LICENSE
+*
+* Copyright (c) 2026 LuneOS Project
+*
+* This file is part of location-service.
+*
+* location-service is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* location-service is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with location-service.  If not, see <http://www.gnu.org/licenses/>.
+*
+* LICENSE@@@ */
+
+#include <glib/gstdio.h>
+
+#include "location_state.h"
+
+GKeyFile *location_state_load(const char *name)
+{
+	GKeyFile *keyfile;
+	GError *error = NULL;
+	gchar *path;
+
+	keyfile = g_key_file_new();
+	path = g_build_filename(LOCATION_SERVICE_STATE_DIR, name, NULL);
+
+	if (!g_key_file_load_from_file(keyfile, path, G_KEY_FILE_NONE, &error)) {
+		if (error->code != G_FILE_ERROR_NOENT)
+			g_warning("Failed to load state file %s: %s", path, error->message);
+		g_error_free(error);
+	}
+
+	g_free(path);
+
+	return keyfile;
+}
+
+/* Writes the key file to a temporary file and renames it over the old one
+ * so a crash in the middle of a save never leaves a truncated state file. */
+bool location_state_save(const char *name, GKeyFile *keyfile)
+{
+	GError *error = NULL;
+	gchar *path = NULL;
+	gchar *data = NULL;
+	gsize length = 0;
+	bool ret = false;
+
+	if (g_mkdir_with_parents(LOCATION_SERVICE_STATE_DIR, 0755) < 0) {
+		g_warning("Failed to create state directory %s", LOCATION_SERVICE_STATE_DIR);
+		return false;
+	}
+
+	data = g_key_file_to_data(keyfile, &length, NULL);
+	path = g_build_filename(LOCATION_SERVICE_STATE_DIR, name, NULL);
+
+	if (!g_file_set_contents(path, data, length, &error)) {
+		g_warning("Failed to save state file %s: %s", path, error->message);
+		g_error_free(error);
+		goto cleanup;
+	}
+
+	ret = true;
+
+cleanup:
+	g_free(path);
+	g_free(data);
+
+	return ret;
+}
+
+// vim:ts=4:sw=4:noexpandtab
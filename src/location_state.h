@@ -0,0 +1,35 @@
+/* @@@LICENSE
+*
+* Copyright (c) 2026 LuneOS Project
+*
+* This file is part of location-service.
+*
+* location-service is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* location-service is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with location-service.  If not, see <http://www.gnu.org/licenses/>.
+*
+* LICENSE@@@ */
+
+#ifndef LOCATION_STATE_H_
+#define LOCATION_STATE_H_
+
+#include <stdbool.h>
+#include <glib.h>
+
+#define LOCATION_SERVICE_STATE_DIR "/var/preferences/org.webosports.service.location"
+
+GKeyFile *location_state_load(const char *name);
+bool location_state_save(const char *name, GKeyFile *keyfile);
+
+#endif
+
+// vim:ts=4:sw=4:noexpandtab
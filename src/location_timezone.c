@@ -0,0 +1,221 @@
+/* @@@LICENSE
+*
+* Copyright (c) 2026 LuneOS Project
+*
+* This file is part of location-service.
+*
+* location-service is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* location-service is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with location-service.  If not, see <http://www.gnu.org/licenses/>.
+*
+* LICENSE@@@ */
+
+
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <glib.h>
+
+#include "location_timezone.h"
+
+struct location_timezone {
+	void *mapping;
+	size_t size;
+	const struct location_timezone_header *header;
+	const uint32_t *grid;
+	const uint32_t *cell_entries;
+	const struct location_timezone_polygon *polygons;
+	const float *vertices;
+	const uint32_t *zone_names;
+	const char *names;
+};
+
+/* Zones of the open sea, 15 degrees of longitude each. The sign of the
+ * Etc zones is inverted, Etc/GMT-1 is one hour ahead of UTC. */
+static const char *nautical_zones[] = {
+	"Etc/GMT+12", "Etc/GMT+11", "Etc/GMT+10", "Etc/GMT+9", "Etc/GMT+8",
+	"Etc/GMT+7", "Etc/GMT+6", "Etc/GMT+5", "Etc/GMT+4", "Etc/GMT+3",
+	"Etc/GMT+2", "Etc/GMT+1", "Etc/GMT", "Etc/GMT-1", "Etc/GMT-2",
+	"Etc/GMT-3", "Etc/GMT-4", "Etc/GMT-5", "Etc/GMT-6", "Etc/GMT-7",
+	"Etc/GMT-8", "Etc/GMT-9", "Etc/GMT-10", "Etc/GMT-11", "Etc/GMT-12",
+};
+
+/* Checks every offset in the file once so lookups can trust them */
+static bool index_valid(struct location_timezone *tz)
+{
+	const struct location_timezone_header *header = tz->header;
+	const struct location_timezone_polygon *polygon;
+	uint32_t cell, count, n, i;
+
+	for (n = 0; n < header->columns * header->rows; n++) {
+		cell = tz->grid[n];
+		if (cell == LOCATION_TIMEZONE_CELL_NONE)
+			continue;
+
+		if (!(cell & LOCATION_TIMEZONE_CELL_LIST)) {
+			if (cell >= header->num_zones)
+				return false;
+			continue;
+		}
+
+		cell &= ~LOCATION_TIMEZONE_CELL_LIST;
+		if (cell >= header->num_cell_entries)
+			return false;
+		count = tz->cell_entries[cell];
+		if (count > header->num_cell_entries - cell - 1)
+			return false;
+		for (i = 1; i <= count; i++) {
+			if (tz->cell_entries[cell + i] >= header->num_polygons)
+				return false;
+		}
+	}
+
+	for (n = 0; n < header->num_polygons; n++) {
+		polygon = &tz->polygons[n];
+		if (polygon->zone >= header->num_zones || polygon->num_vertices < 3 ||
+			polygon->first_vertex > header->num_vertices ||
+			polygon->num_vertices > header->num_vertices - polygon->first_vertex)
+			return false;
+	}
+
+	for (n = 0; n < header->num_zones; n++) {
+		if (tz->zone_names[n] >= header->names_size)
+			return false;
+	}
+
+	return header->names_size > 0 && tz->names[header->names_size - 1] == '\0';
+}
+
+struct location_timezone *location_timezone_new(const char *path)
+{
+	struct location_timezone *tz = NULL;
+	const struct location_timezone_header *header;
+	struct stat st;
+	void *mapping;
+	uint64_t size;
+	int fd;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		g_warning("Failed to open time zone index %s: %s", path, strerror(errno));
+		return NULL;
+	}
+
+	if (fstat(fd, &st) < 0 || st.st_size < (off_t) sizeof(struct location_timezone_header))
+		goto invalid;
+
+	mapping = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	if (mapping == MAP_FAILED) {
+		g_warning("Failed to map time zone index %s: %s", path, strerror(errno));
+		goto out;
+	}
+
+	header = mapping;
+	size = sizeof(*header) +
+	       4 * ((uint64_t) header->columns * header->rows + header->num_cell_entries) +
+	       sizeof(struct location_timezone_polygon) * (uint64_t) header->num_polygons +
+	       8 * (uint64_t) header->num_vertices + 4 * (uint64_t) header->num_zones +
+	       header->names_size;
+	if (memcmp(header->magic, LOCATION_TIMEZONE_MAGIC, sizeof(header->magic)) ||
+		header->version != LOCATION_TIMEZONE_VERSION ||
+		header->columns == 0 || header->rows == 0 || size != (uint64_t) st.st_size) {
+		munmap(mapping, st.st_size);
+		goto invalid;
+	}
+
+	tz = g_new0(struct location_timezone, 1);
+	tz->mapping = mapping;
+	tz->size = st.st_size;
+	tz->header = header;
+	tz->grid = (const uint32_t *) (header + 1);
+	tz->cell_entries = tz->grid + header->columns * header->rows;
+	tz->polygons = (const struct location_timezone_polygon *) (tz->cell_entries + header->num_cell_entries);
+	tz->vertices = (const float *) (tz->polygons + header->num_polygons);
+	tz->zone_names = (const uint32_t *) (tz->vertices + 2 * header->num_vertices);
+	tz->names = (const char *) (tz->zone_names + header->num_zones);
+
+	if (!index_valid(tz)) {
+		location_timezone_free(tz);
+		tz = NULL;
+		goto invalid;
+	}
+
+	goto out;
+
+invalid:
+	g_warning("Time zone index %s is invalid", path);
+out:
+	close(fd);
+	return tz;
+}
+
+void location_timezone_free(struct location_timezone *tz)
+{
+	if (!tz)
+		return;
+
+	munmap(tz->mapping, tz->size);
+	g_free(tz);
+}
+
+/* Even-odd test, see location_timezone.h for how holes are stored */
+static bool polygon_contains(struct location_timezone *tz, const struct location_timezone_polygon *polygon,
+                             float x, float y)
+{
+	const float *v = tz->vertices + 2 * polygon->first_vertex;
+	uint32_t i, j;
+	bool inside = false;
+
+	if (x < polygon->min_longitude || x > polygon->max_longitude ||
+		y < polygon->min_latitude || y > polygon->max_latitude)
+		return false;
+
+	for (i = 0, j = polygon->num_vertices - 1; i < polygon->num_vertices; j = i++) {
+		if ((v[2 * i + 1] > y) != (v[2 * j + 1] > y) &&
+			x < (v[2 * j] - v[2 * i]) * (y - v[2 * i + 1]) / (v[2 * j + 1] - v[2 * i + 1]) + v[2 * i])
+			inside = !inside;
+	}
+
+	return inside;
+}
+
+/* Returns the name of the zone, which stays valid as long as the index */
+const char *location_timezone_lookup(struct location_timezone *tz, double latitude, double longitude)
+{
+	const struct location_timezone_header *header = tz->header;
+	const uint32_t *entries;
+	uint32_t column, row, cell, i;
+
+	column = CLAMP((longitude + 180) / 360 * header->columns, 0, header->columns - 1);
+	row = CLAMP((latitude + 90) / 180 * header->rows, 0, header->rows - 1);
+	cell = tz->grid[row * header->columns + column];
+
+	if (cell != LOCATION_TIMEZONE_CELL_NONE && !(cell & LOCATION_TIMEZONE_CELL_LIST))
+		return tz->names + tz->zone_names[cell];
+
+	if (cell != LOCATION_TIMEZONE_CELL_NONE) {
+		entries = tz->cell_entries + (cell & ~LOCATION_TIMEZONE_CELL_LIST);
+		for (i = 1; i <= entries[0]; i++) {
+			if (polygon_contains(tz, &tz->polygons[entries[i]], longitude, latitude))
+				return tz->names + tz->zone_names[tz->polygons[entries[i]].zone];
+		}
+	}
+
+	return nautical_zones[CLAMP(lround(longitude / 15), -12, 12) + 12];
+}
+
+// vim:ts=4:sw=4:noexpandtab
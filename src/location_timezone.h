@@ -0,0 +1,88 @@
+/* @@@LICENSE
+*
+* Copyright (c) 2026 LuneOS Project
+*
+* This file is part of location-service.
+*
+* location-service is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* location-service is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with location-service.  If not, see <http://www.gnu.org/licenses/>.
+*
+* LICENSE@@@ */
+
+
+#ifndef LOCATION_TIMEZONE_H_
+#define LOCATION_TIMEZONE_H_
+
+#include <stdint.h>
+
+/* Time zone index, built from a boundary dataset by location-tzindex and
+ * mapped read-only by the service.
+ *
+ * The world is divided into a grid of columns x rows cells starting at
+ * longitude -180 and latitude -90. A cell either names a zone directly,
+ * holds LOCATION_TIMEZONE_CELL_NONE where no zone is (open sea), or, with
+ * LOCATION_TIMEZONE_CELL_LIST set, is the offset into cell_entries of a
+ * count followed by the polygons crossing the cell. Most cells are
+ * resolved without looking at a polygon.
+ *
+ * A polygon is a single vertex sequence of (longitude, latitude) floats.
+ * Holes follow the outer ring and are connected to it by an edge walked in
+ * both directions, so an even-odd test over all edges handles them.
+ *
+ * After the header, all in host byte order:
+ *
+ *   uint32_t grid[rows * columns]
+ *   uint32_t cell_entries[num_cell_entries]
+ *   struct location_timezone_polygon polygons[num_polygons]
+ *   float vertices[2 * num_vertices]
+ *   uint32_t zone_names[num_zones]     offsets into names
+ *   char names[names_size]             NUL terminated zone names */
+
+#define LOCATION_TIMEZONE_INDEX		"/usr/share/location-service/timezones.idx"
+#define LOCATION_TIMEZONE_MAGIC		"LSTZIDX"
+#define LOCATION_TIMEZONE_VERSION	1
+
+#define LOCATION_TIMEZONE_CELL_NONE	0xffffffff
+#define LOCATION_TIMEZONE_CELL_LIST	0x80000000
+
+struct location_timezone_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t columns;
+	uint32_t rows;
+	uint32_t num_cell_entries;
+	uint32_t num_polygons;
+	uint32_t num_vertices;
+	uint32_t num_zones;
+	uint32_t names_size;
+};
+
+struct location_timezone_polygon {
+	uint32_t zone;
+	uint32_t first_vertex;
+	uint32_t num_vertices;
+	float min_longitude;
+	float min_latitude;
+	float max_longitude;
+	float max_latitude;
+};
+
+struct location_timezone;
+
+struct location_timezone *location_timezone_new(const char *path);
+void location_timezone_free(struct location_timezone *tz);
+const char *location_timezone_lookup(struct location_timezone *tz, double latitude, double longitude);
+
+#endif
+
+// vim:ts=4:sw=4:noexpandtab
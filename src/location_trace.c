@@ -0,0 +1,360 @@
+/* @@@LICENSE
+*
+* Copyright (c) 2026 LuneOS Project
+*
+* This file is part of location-service.
+*
+* location-service is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* location-service is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with location-service.  If not, see <http://www.gnu.org/licenses/>.
+*
+* LICENSE@@@ */
+
+#include <errno.h>
+
+#include "location_trace.h"
+#include "location_service.h"
+
+#define LOCATION_TRACE_FIELDS	8
+/* Records delivered per main loop iteration when replaying as fast as possible */
+#define REPLAY_BATCH_SIZE		32
+
+struct location_trace_writer {
+	FILE *file;
+};
+
+struct location_trace_record {
+	gint64 time;
+	GClueAccuracyLevel level;
+	struct location_fix fix;
+};
+
+struct location_trace_replay {
+	struct location_provider provider;
+	struct location_service *service;
+	char *path;
+	bool fast;
+	FILE *file;
+	struct location_trace_record next;
+	guint32 version;
+	gint64 time_offset;
+	bool new_run;
+	guint source;
+};
+
+static double *fix_field(struct location_fix *fix, int n)
+{
+	double *fields[LOCATION_TRACE_FIELDS] = {
+		&fix->latitude, &fix->longitude, &fix->altitude,
+		&fix->horiz_accuracy, &fix->vert_accuracy,
+		&fix->heading, &fix->velocity, &fix->timestamp,
+	};
+
+	return fields[n];
+}
+
+static bool write_u64(FILE *file, guint64 value)
+{
+	value = GUINT64_TO_LE(value);
+	return fwrite(&value, sizeof(value), 1, file) == 1;
+}
+
+static bool read_u64(FILE *file, guint64 *value)
+{
+	if (fread(value, sizeof(*value), 1, file) != 1)
+		return false;
+
+	*value = GUINT64_FROM_LE(*value);
+	return true;
+}
+
+static bool write_double(FILE *file, double value)
+{
+	guint64 bits;
+
+	memcpy(&bits, &value, sizeof(bits));
+	return write_u64(file, bits);
+}
+
+static bool read_double(FILE *file, double *value)
+{
+	guint64 bits;
+
+	if (!read_u64(file, &bits))
+		return false;
+
+	memcpy(value, &bits, sizeof(bits));
+	return true;
+}
+
+struct location_trace_writer *location_trace_writer_new(const char *path)
+{
+	struct location_trace_writer *writer;
+	guint32 version = GUINT32_TO_LE(LOCATION_TRACE_VERSION);
+	FILE *file;
+
+	char magic[8];
+	guint32 file_version;
+
+	file = fopen(path, "a+b");
+	if (!file) {
+		g_warning("Failed to open trace file %s: %s", path, strerror(errno));
+		return NULL;
+	}
+
+	/* New files get a header, existing traces are appended to when they
+	 * have the same version */
+	fseek(file, 0, SEEK_END);
+	if (ftell(file) == 0) {
+		if (fwrite(LOCATION_TRACE_MAGIC, 8, 1, file) != 1 ||
+			fwrite(&version, sizeof(version), 1, file) != 1) {
+			g_warning("Failed to write trace header to %s", path);
+			fclose(file);
+			return NULL;
+		}
+	}
+	else {
+		rewind(file);
+		if (fread(magic, sizeof(magic), 1, file) != 1 ||
+			memcmp(magic, LOCATION_TRACE_MAGIC, sizeof(magic)) != 0 ||
+			fread(&file_version, sizeof(file_version), 1, file) != 1 ||
+			file_version != version) {
+			g_warning("%s is not a trace file of version %d, not appending to it", path,
+			          LOCATION_TRACE_VERSION);
+			fclose(file);
+			return NULL;
+		}
+		fseek(file, 0, SEEK_END);
+	}
+
+	/* Receive times of this run aren't comparable with earlier ones */
+	if (!write_u64(file, LOCATION_TRACE_RUN_MARK) || fflush(file) != 0) {
+		g_warning("Failed to write trace header to %s", path);
+		fclose(file);
+		return NULL;
+	}
+
+	writer = g_new0(struct location_trace_writer, 1);
+	writer->file = file;
+
+	return writer;
+}
+
+void location_trace_writer_append(struct location_trace_writer *writer, GClueAccuracyLevel level,
+                                  const struct location_fix *fix)
+{
+	struct location_fix copy = *fix;
+	guint8 header[2];
+	guint8 description_len;
+	bool ok;
+	int n;
+
+	header[0] = level;
+	header[1] = 0;
+	for (n = 0; n < LOCATION_TRACE_FIELDS; n++) {
+		if (*fix_field(&copy, n) != -1)
+			header[1] |= 1 << n;
+	}
+
+	ok = write_u64(writer->file, g_get_monotonic_time());
+	ok = ok && fwrite(header, sizeof(header), 1, writer->file) == 1;
+	for (n = 0; ok && n < LOCATION_TRACE_FIELDS; n++) {
+		if (header[1] & (1 << n))
+			ok = write_double(writer->file, *fix_field(&copy, n));
+	}
+
+	description_len = fix->description ? MIN(strlen(fix->description), G_MAXUINT8) : 0;
+	ok = ok && fwrite(&description_len, 1, 1, writer->file) == 1;
+	if (ok && description_len)
+		ok = fwrite(fix->description, description_len, 1, writer->file) == 1;
+
+	/* Keep the trace usable if we crash, a fix is only a few dozen bytes */
+	if (!ok || fflush(writer->file) != 0)
+		g_warning("Failed to write trace record: %s", strerror(errno));
+}
+
+void location_trace_writer_free(struct location_trace_writer *writer)
+{
+	if (!writer)
+		return;
+
+	fclose(writer->file);
+	g_free(writer);
+}
+
+static bool replay_read_record(struct location_trace_replay *replay)
+{
+	struct location_trace_record *record = &replay->next;
+	guint64 time;
+	guint8 header[2];
+	guint8 description_len;
+	char description[G_MAXUINT8 + 1];
+	int n;
+
+	do {
+		if (!read_u64(replay->file, &time))
+			return false;
+		if (replay->version >= 3 && time == LOCATION_TRACE_RUN_MARK)
+			replay->new_run = true;
+	} while (replay->version >= 3 && time == LOCATION_TRACE_RUN_MARK);
+
+	if (fread(header, sizeof(header), 1, replay->file) != 1)
+		return false;
+
+	record->time = time;
+	record->level = header[0];
+	record->fix.description = NULL;
+	for (n = 0; n < LOCATION_TRACE_FIELDS; n++) {
+		double *field = fix_field(&record->fix, n);
+
+		*field = -1;
+		if ((header[1] & (1 << n)) && !read_double(replay->file, field))
+			return false;
+	}
+
+	if (replay->version < 2)
+		return true;
+
+	if (fread(&description_len, 1, 1, replay->file) != 1 ||
+		(description_len && fread(description, description_len, 1, replay->file) != 1))
+		return false;
+	if (description_len) {
+		description[description_len] = '\0';
+		record->fix.description = g_intern_string(description);
+	}
+
+	return true;
+}
+
+static gboolean replay_dispatch_cb(gpointer user_data);
+
+static void replay_schedule(struct location_trace_replay *replay)
+{
+	gint64 delay;
+
+	/* Records of a new run follow right after the last one of the previous
+	 * run, the time between them is unknown */
+	if (replay->new_run) {
+		replay->time_offset = g_get_monotonic_time() - replay->next.time;
+		replay->new_run = false;
+	}
+
+	if (replay->fast) {
+		replay->source = g_idle_add(replay_dispatch_cb, replay);
+		return;
+	}
+
+	delay = (replay->next.time + replay->time_offset - g_get_monotonic_time()) / 1000;
+	replay->source = g_timeout_add(delay > 0 ? delay : 0, replay_dispatch_cb, replay);
+}
+
+static gboolean replay_dispatch_cb(gpointer user_data)
+{
+	struct location_trace_replay *replay = user_data;
+	int n;
+
+	replay->source = 0;
+
+	for (n = 0; n < (replay->fast ? REPLAY_BATCH_SIZE : 1); n++) {
+		location_service_handle_fix(replay->service, replay->next.level, &replay->next.fix);
+
+		/* Delivering the fix may have stopped the session */
+		if (!replay->file)
+			return FALSE;
+
+		if (!replay_read_record(replay)) {
+			g_message("Replay of %s finished", replay->path);
+			return FALSE;
+		}
+	}
+
+	replay_schedule(replay);
+
+	return FALSE;
+}
+
+static void replay_stop(struct location_provider *provider, struct location_service *service)
+{
+	struct location_trace_replay *replay = (struct location_trace_replay *) provider;
+
+	if (replay->source) {
+		g_source_remove(replay->source);
+		replay->source = 0;
+	}
+
+	if (replay->file) {
+		fclose(replay->file);
+		replay->file = NULL;
+	}
+}
+
+static bool replay_start(struct location_provider *provider, struct location_service *service)
+{
+	struct location_trace_replay *replay = (struct location_trace_replay *) provider;
+	char magic[8];
+	guint32 version;
+
+	replay->service = service;
+	replay->file = fopen(replay->path, "rb");
+	if (!replay->file) {
+		g_warning("Failed to open trace file %s: %s", replay->path, strerror(errno));
+		return false;
+	}
+
+	if (fread(magic, sizeof(magic), 1, replay->file) != 1 ||
+		memcmp(magic, LOCATION_TRACE_MAGIC, sizeof(magic)) != 0 ||
+		fread(&version, sizeof(version), 1, replay->file) != 1 ||
+		GUINT32_FROM_LE(version) < 1 || GUINT32_FROM_LE(version) > LOCATION_TRACE_VERSION) {
+		g_warning("%s is not a supported trace file", replay->path);
+		replay_stop(provider, service);
+		return false;
+	}
+	replay->version = GUINT32_FROM_LE(version);
+
+	if (!replay_read_record(replay)) {
+		g_warning("Trace file %s contains no records", replay->path);
+		replay_stop(provider, service);
+		return false;
+	}
+
+	/* Records are delivered relative to the time the replay started */
+	replay->new_run = true;
+	replay_schedule(replay);
+
+	return true;
+}
+
+static void replay_free(struct location_provider *provider)
+{
+	struct location_trace_replay *replay = (struct location_trace_replay *) provider;
+
+	replay_stop(provider, replay->service);
+	g_free(replay->path);
+	g_free(replay);
+}
+
+struct location_provider *location_trace_replay_new(const char *path, bool fast)
+{
+	struct location_trace_replay *replay;
+
+	replay = g_new0(struct location_trace_replay, 1);
+	replay->provider.name = "replay";
+	replay->provider.start = replay_start;
+	replay->provider.stop = replay_stop;
+	replay->provider.free = replay_free;
+	replay->path = g_strdup(path);
+	replay->fast = fast;
+
+	return &replay->provider;
+}
+
+// vim:ts=4:sw=4:noexpandtab
@@ -0,0 +1,67 @@
+/* @@@LICENSE
+*
+* Copyright (c) 2026 LuneOS Project
+*
+* This file is part of location-service.
+*
+* location-service is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* location-service is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with location-service.  If not, see <http://www.gnu.org/licenses/>.
+*
+* LICENSE@@@ */
+
+#ifndef LOCATION_TRACE_H_
+#define LOCATION_TRACE_H_
+
+#include <stdbool.h>
+
+#include "location_common.h"
+
+/* Trace files start with an 8 byte magic and a 32 bit version, followed by
+ * records. All integers and doubles are little endian.
+ *
+ * Record layout:
+ *   int64   receive time in microseconds (monotonic clock of the recorder)
+ *   uint8   GeoClue accuracy level of the session
+ *   uint8   mask of the fields which follow, bit n set means field n of
+ *           struct location_fix is present, absent fields are -1
+ *   double  present fields in struct location_fix order
+ *   uint8   length of the description, 0 when there is none (version 2)
+ *   char    the description, not terminated (version 2)
+ *
+ * Every recording run starts with a receive time of
+ * LOCATION_TRACE_RUN_MARK and nothing else (version 3). The monotonic
+ * clock starts over with every boot, so receive times only compare within
+ * a run.
+ *
+ * Version 1 traces have no description, version 1 and 2 traces hold a
+ * single run. Both can still be replayed.
+ */
+#define LOCATION_TRACE_MAGIC	"LSTRACE\0"
+#define LOCATION_TRACE_VERSION	3
+#define LOCATION_TRACE_RUN_MARK	G_MAXUINT64
+
+struct location_trace_writer;
+struct location_provider;
+
+struct location_trace_writer *location_trace_writer_new(const char *path);
+void location_trace_writer_append(struct location_trace_writer *writer, GClueAccuracyLevel level,
+                                  const struct location_fix *fix);
+void location_trace_writer_free(struct location_trace_writer *writer);
+
+/* Provider feeding a recorded trace into the tracking session, either with
+ * the original timing or as fast as the main loop allows */
+struct location_provider *location_trace_replay_new(const char *path, bool fast);
+
+#endif
+
+// vim:ts=4:sw=4:noexpandtab
@@ -0,0 +1,477 @@
+/* @@@LICENSE
+*
+* Copyright (c) 2026 LuneOS Project
+*
+* This file is part of location-service.
+*
+* location-service is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* location-service is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with location-service.  If not, see <http://www.gnu.org/licenses/>.
+*
+* LICENSE@@@ */
+
+
+/* Builds the time zone index of location_timezone.h from a GeoJSON
+ * FeatureCollection of zone boundaries with a "tzid" property, such as the
+ * releases of timezone-boundary-builder. */
+
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+#include <pbnjson.h>
+
+#include "location_timezone.h"
+
+static gdouble option_resolution = 0.25;
+
+static GOptionEntry options[] = {
+	{ "resolution", 'r', 0, G_OPTION_ARG_DOUBLE, &option_resolution,
+				"Size of a grid cell", "DEG" },
+	{ NULL },
+};
+
+static GArray *polygons;
+static GArray *vertices;
+static GPtrArray *zone_names;
+static GHashTable *zone_ids;
+
+static guint columns, rows;
+static double cell_width, cell_height;
+/* Polygons touching a cell, and whether any of their edges cross it */
+static GArray **candidates;
+static gboolean *has_edge;
+
+static guint zone_id(const char *name)
+{
+	gpointer id;
+
+	id = g_hash_table_lookup(zone_ids, name);
+	if (id)
+		return GPOINTER_TO_UINT(id) - 1;
+
+	g_ptr_array_add(zone_names, g_strdup(name));
+	g_hash_table_insert(zone_ids, g_strdup(name), GUINT_TO_POINTER(zone_names->len));
+
+	return zone_names->len - 1;
+}
+
+static gboolean append_vertex(jvalue_ref point_obj)
+{
+	double longitude, latitude;
+	float v[2];
+
+	if (!jis_array(point_obj) || jarray_size(point_obj) < 2 ||
+		!jis_number(jarray_get(point_obj, 0)) || !jis_number(jarray_get(point_obj, 1)))
+		return FALSE;
+
+	jnumber_get_f64(jarray_get(point_obj, 0), &longitude);
+	jnumber_get_f64(jarray_get(point_obj, 1), &latitude);
+	v[0] = longitude;
+	v[1] = latitude;
+	g_array_append_vals(vertices, v, 2);
+
+	return TRUE;
+}
+
+/* Rings are closed in GeoJSON, every hole is entered from and left to the
+ * first vertex of the outer ring */
+static gboolean add_polygon(guint zone, jvalue_ref rings_obj)
+{
+	struct location_timezone_polygon polygon;
+	jvalue_ref ring_obj;
+	ssize_t ring, n;
+	float *v;
+	guint i;
+
+	if (!jis_array(rings_obj) || jarray_size(rings_obj) < 1)
+		return FALSE;
+
+	polygon.zone = zone;
+	polygon.first_vertex = vertices->len / 2;
+
+	for (ring = 0; ring < jarray_size(rings_obj); ring++) {
+		ring_obj = jarray_get(rings_obj, ring);
+		if (!jis_array(ring_obj) || jarray_size(ring_obj) < 4)
+			return FALSE;
+
+		for (n = 0; n < jarray_size(ring_obj); n++) {
+			if (!append_vertex(jarray_get(ring_obj, n)))
+				return FALSE;
+		}
+
+		if (ring > 0) {
+			v = &g_array_index(vertices, float, 2 * polygon.first_vertex);
+			g_array_append_vals(vertices, (float[]) { v[0], v[1] }, 2);
+		}
+	}
+
+	polygon.num_vertices = vertices->len / 2 - polygon.first_vertex;
+	polygon.min_longitude = polygon.min_latitude = INFINITY;
+	polygon.max_longitude = polygon.max_latitude = -INFINITY;
+	for (i = 0; i < polygon.num_vertices; i++) {
+		v = &g_array_index(vertices, float, 2 * (polygon.first_vertex + i));
+		polygon.min_longitude = MIN(polygon.min_longitude, v[0]);
+		polygon.max_longitude = MAX(polygon.max_longitude, v[0]);
+		polygon.min_latitude = MIN(polygon.min_latitude, v[1]);
+		polygon.max_latitude = MAX(polygon.max_latitude, v[1]);
+	}
+
+	g_array_append_val(polygons, polygon);
+
+	return TRUE;
+}
+
+static gboolean add_feature(jvalue_ref feature_obj)
+{
+	jvalue_ref properties_obj, geometry_obj, value_obj, coordinates_obj;
+	raw_buffer buf;
+	char *name;
+	gboolean ret = TRUE;
+	guint zone;
+	ssize_t n;
+
+	if (!jobject_get_exists(feature_obj, J_CSTR_TO_BUF("properties"), &properties_obj) ||
+		!jobject_get_exists(properties_obj, J_CSTR_TO_BUF("tzid"), &value_obj) ||
+		!jis_string(value_obj) ||
+		!jobject_get_exists(feature_obj, J_CSTR_TO_BUF("geometry"), &geometry_obj) ||
+		!jobject_get_exists(geometry_obj, J_CSTR_TO_BUF("coordinates"), &coordinates_obj))
+		return FALSE;
+
+	buf = jstring_get(value_obj);
+	name = g_strndup(buf.m_str, buf.m_len);
+	zone = zone_id(name);
+	g_free(name);
+
+	if (!jobject_get_exists(geometry_obj, J_CSTR_TO_BUF("type"), &value_obj) || !jis_string(value_obj))
+		return FALSE;
+	buf = jstring_get(value_obj);
+
+	if (buf.m_len == 7 && !strncmp(buf.m_str, "Polygon", 7))
+		return add_polygon(zone, coordinates_obj);
+
+	if (buf.m_len != 12 || strncmp(buf.m_str, "MultiPolygon", 12) || !jis_array(coordinates_obj))
+		return FALSE;
+
+	for (n = 0; n < jarray_size(coordinates_obj) && ret; n++)
+		ret = add_polygon(zone, jarray_get(coordinates_obj, n));
+
+	return ret;
+}
+
+static void add_candidate(guint cell, guint polygon)
+{
+	guint i;
+
+	if (!candidates[cell])
+		candidates[cell] = g_array_new(FALSE, FALSE, sizeof(guint32));
+
+	for (i = 0; i < candidates[cell]->len; i++) {
+		if (g_array_index(candidates[cell], guint32, i) == polygon)
+			return;
+	}
+
+	g_array_append_val(candidates[cell], polygon);
+}
+
+/* Liang-Barsky clipping of the segment against the cell */
+static gboolean segment_crosses_cell(const float *a, const float *b, guint column, guint row)
+{
+	double x0 = -180 + column * cell_width, y0 = -90 + row * cell_height;
+	double p[4] = { a[0] - b[0], b[0] - a[0], a[1] - b[1], b[1] - a[1] };
+	double q[4] = { a[0] - x0, x0 + cell_width - a[0], a[1] - y0, y0 + cell_height - a[1] };
+	double t0 = 0, t1 = 1, t;
+	int i;
+
+	for (i = 0; i < 4; i++) {
+		if (p[i] == 0) {
+			if (q[i] < 0)
+				return FALSE;
+			continue;
+		}
+
+		t = q[i] / p[i];
+		if (p[i] < 0)
+			t0 = MAX(t0, t);
+		else
+			t1 = MIN(t1, t);
+		if (t0 > t1)
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+static guint column_of(double longitude)
+{
+	return CLAMP((longitude + 180) / cell_width, 0, columns - 1);
+}
+
+static guint row_of(double latitude)
+{
+	return CLAMP((latitude + 90) / cell_height, 0, rows - 1);
+}
+
+static void mark_edges(guint index, const struct location_timezone_polygon *polygon)
+{
+	const float *v = &g_array_index(vertices, float, 2 * polygon->first_vertex);
+	guint i, column, row, cell;
+
+	for (i = 0; i + 1 < polygon->num_vertices; i++) {
+		const float *a = v + 2 * i, *b = v + 2 * i + 2;
+
+		if (a[0] == b[0] && a[1] == b[1])
+			continue;
+
+		for (row = row_of(MIN(a[1], b[1])); row <= row_of(MAX(a[1], b[1])); row++) {
+			for (column = column_of(MIN(a[0], b[0])); column <= column_of(MAX(a[0], b[0])); column++) {
+				if (!segment_crosses_cell(a, b, column, row))
+					continue;
+				cell = row * columns + column;
+				add_candidate(cell, index);
+				has_edge[cell] = TRUE;
+			}
+		}
+	}
+}
+
+struct crossing {
+	guint row;
+	double x;
+};
+
+static gint compare_crossings(gconstpointer a, gconstpointer b)
+{
+	const struct crossing *ca = a, *cb = b;
+
+	if (ca->row != cb->row)
+		return ca->row < cb->row ? -1 : 1;
+
+	return ca->x < cb->x ? -1 : ca->x > cb->x;
+}
+
+/* Scanline fill through the cell centers with the same even-odd rule as
+ * the lookup */
+static void mark_interior(guint index, const struct location_timezone_polygon *polygon)
+{
+	const float *v = &g_array_index(vertices, float, 2 * polygon->first_vertex);
+	GArray *crossings = g_array_new(FALSE, FALSE, sizeof(struct crossing));
+	struct crossing crossing, *end;
+	double y, x;
+	guint i, j, n, column, row;
+
+	for (i = 0, j = polygon->num_vertices - 1; i < polygon->num_vertices; j = i++) {
+		for (row = row_of(MIN(v[2 * i + 1], v[2 * j + 1])); row <= row_of(MAX(v[2 * i + 1], v[2 * j + 1])); row++) {
+			y = -90 + (row + 0.5) * cell_height;
+			if ((v[2 * i + 1] > y) == (v[2 * j + 1] > y))
+				continue;
+			crossing.row = row;
+			crossing.x = (v[2 * j] - v[2 * i]) * (y - v[2 * i + 1]) / (v[2 * j + 1] - v[2 * i + 1]) + v[2 * i];
+			g_array_append_val(crossings, crossing);
+		}
+	}
+
+	g_array_sort(crossings, compare_crossings);
+
+	for (n = 0; n + 1 < crossings->len; n += 2) {
+		crossing = g_array_index(crossings, struct crossing, n);
+		end = &g_array_index(crossings, struct crossing, n + 1);
+		if (end->row != crossing.row) {
+			/* Odd number of crossings in a row, only with broken input */
+			n--;
+			continue;
+		}
+
+		for (column = column_of(crossing.x); column <= column_of(end->x); column++) {
+			x = -180 + (column + 0.5) * cell_width;
+			if (x > crossing.x && x <= end->x)
+				add_candidate(end->row * columns + column, index);
+		}
+	}
+
+	g_array_free(crossings, TRUE);
+}
+
+static gboolean write_index(const char *path)
+{
+	struct location_timezone_header header;
+	GArray *cell_entries = g_array_new(FALSE, FALSE, sizeof(guint32));
+	GHashTable *lists = g_hash_table_new_full(g_bytes_hash, g_bytes_equal, (GDestroyNotify) g_bytes_unref, NULL);
+	GString *names = g_string_new(NULL);
+	guint32 *grid, *zone_offsets, count, offset;
+	const struct location_timezone_polygon *polygon;
+	gpointer existing;
+	GBytes *key;
+	guint cell, i;
+	gboolean ret;
+	FILE *f;
+
+	grid = g_new(guint32, columns * rows);
+	for (cell = 0; cell < columns * rows; cell++) {
+		if (!candidates[cell]) {
+			grid[cell] = LOCATION_TIMEZONE_CELL_NONE;
+			continue;
+		}
+
+		if (!has_edge[cell] && candidates[cell]->len == 1) {
+			polygon = &g_array_index(polygons, struct location_timezone_polygon,
+			                         g_array_index(candidates[cell], guint32, 0));
+			grid[cell] = polygon->zone;
+			continue;
+		}
+
+		/* Neighbouring cells along a border mostly share their list */
+		key = g_bytes_new(candidates[cell]->data, candidates[cell]->len * sizeof(guint32));
+		if (g_hash_table_lookup_extended(lists, key, NULL, &existing)) {
+			grid[cell] = GPOINTER_TO_UINT(existing) | LOCATION_TIMEZONE_CELL_LIST;
+			g_bytes_unref(key);
+			continue;
+		}
+
+		offset = cell_entries->len;
+		count = candidates[cell]->len;
+		g_array_append_val(cell_entries, count);
+		g_array_append_vals(cell_entries, candidates[cell]->data, count);
+		g_hash_table_insert(lists, key, GUINT_TO_POINTER(offset));
+		grid[cell] = offset | LOCATION_TIMEZONE_CELL_LIST;
+	}
+
+	zone_offsets = g_new(guint32, zone_names->len);
+	for (i = 0; i < zone_names->len; i++) {
+		zone_offsets[i] = names->len;
+		g_string_append_len(names, g_ptr_array_index(zone_names, i),
+		                    strlen(g_ptr_array_index(zone_names, i)) + 1);
+	}
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, LOCATION_TIMEZONE_MAGIC, sizeof(header.magic));
+	header.version = LOCATION_TIMEZONE_VERSION;
+	header.columns = columns;
+	header.rows = rows;
+	header.num_cell_entries = cell_entries->len;
+	header.num_polygons = polygons->len;
+	header.num_vertices = vertices->len / 2;
+	header.num_zones = zone_names->len;
+	header.names_size = names->len;
+
+	f = fopen(path, "wb");
+	if (!f) {
+		g_printerr("Failed to create %s: %s\n", path, strerror(errno));
+		ret = FALSE;
+		goto out;
+	}
+
+	fwrite(&header, sizeof(header), 1, f);
+	fwrite(grid, sizeof(guint32), columns * rows, f);
+	fwrite(cell_entries->data, sizeof(guint32), cell_entries->len, f);
+	fwrite(polygons->data, sizeof(struct location_timezone_polygon), polygons->len, f);
+	fwrite(vertices->data, sizeof(float), vertices->len, f);
+	fwrite(zone_offsets, sizeof(guint32), zone_names->len, f);
+	fwrite(names->str, 1, names->len, f);
+
+	ret = !ferror(f);
+	if (fclose(f) != 0 || !ret) {
+		g_printerr("Failed to write %s\n", path);
+		ret = FALSE;
+		goto out;
+	}
+
+	printf("%u zones, %u polygons, %u vertices, %u list entries\n",
+	       zone_names->len, polygons->len, vertices->len / 2, cell_entries->len);
+
+out:
+	g_free(grid);
+	g_free(zone_offsets);
+	g_string_free(names, TRUE);
+	g_hash_table_destroy(lists);
+	g_array_free(cell_entries, TRUE);
+
+	return ret;
+}
+
+int main(int argc, char **argv)
+{
+	GOptionContext *context;
+	GError *err = NULL;
+	jschema_ref schema;
+	JSchemaInfo schema_info;
+	jvalue_ref parsed_obj, features_obj;
+	gchar *contents;
+	gsize length;
+	ssize_t n;
+	guint i;
+
+	context = g_option_context_new("INPUT.geojson OUTPUT");
+	g_option_context_add_main_entries(context, options, NULL);
+	if (!g_option_context_parse(context, &argc, &argv, &err)) {
+		g_printerr("%s\n", err->message);
+		g_error_free(err);
+		exit(1);
+	}
+	g_option_context_free(context);
+
+	if (argc != 3 || option_resolution <= 0 || option_resolution > 90) {
+		g_printerr("Usage: %s [--resolution DEG] INPUT.geojson OUTPUT\n", argv[0]);
+		exit(1);
+	}
+
+	if (!g_file_get_contents(argv[1], &contents, &length, &err)) {
+		g_printerr("%s\n", err->message);
+		g_error_free(err);
+		exit(1);
+	}
+
+	schema = jschema_parse(j_cstr_to_buffer("{}"), DOMOPT_NOOPT, NULL);
+	jschema_info_init(&schema_info, schema, NULL, NULL);
+	parsed_obj = jdom_parse(j_str_to_buffer(contents, length), DOMOPT_NOOPT, &schema_info);
+	jschema_release(&schema);
+	g_free(contents);
+
+	if (jis_null(parsed_obj) ||
+		!jobject_get_exists(parsed_obj, J_CSTR_TO_BUF("features"), &features_obj) ||
+		!jis_array(features_obj)) {
+		g_printerr("%s is not a GeoJSON FeatureCollection\n", argv[1]);
+		exit(1);
+	}
+
+	polygons = g_array_new(FALSE, FALSE, sizeof(struct location_timezone_polygon));
+	vertices = g_array_new(FALSE, FALSE, sizeof(float));
+	zone_names = g_ptr_array_new_with_free_func(g_free);
+	zone_ids = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+
+	for (n = 0; n < jarray_size(features_obj); n++) {
+		if (!add_feature(jarray_get(features_obj, n)))
+			g_printerr("Skipping invalid feature %zd\n", n);
+	}
+	j_release(&parsed_obj);
+
+	columns = lround(360 / option_resolution);
+	rows = lround(180 / option_resolution);
+	cell_width = 360.0 / columns;
+	cell_height = 180.0 / rows;
+	candidates = g_new0(GArray *, columns * rows);
+	has_edge = g_new0(gboolean, columns * rows);
+
+	for (i = 0; i < polygons->len; i++) {
+		mark_edges(i, &g_array_index(polygons, struct location_timezone_polygon, i));
+		mark_interior(i, &g_array_index(polygons, struct location_timezone_polygon, i));
+	}
+
+	if (!write_index(argv[2]))
+		exit(1);
+
+	return 0;
+}
+
+// vim:ts=4:sw=4:noexpandtab
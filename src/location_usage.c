@@ -0,0 +1,283 @@
+/* @@@LICENSE
+*
+* Copyright (c) 2026 LuneOS Project
+*
+* This file is part of location-service.
+*
+* location-service is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* location-service is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with location-service.  If not, see <http://www.gnu.org/licenses/>.
+*
+* LICENSE@@@ */
+
+
+
+#include <string.h>
+
+#include "location_usage.h"
+
+#define NUM_LEVELS	(GCLUE_ACCURACY_LEVEL_EXACT + 1)
+
+/* Times are monotonic microseconds. Session time of closed intervals is
+ * summed up, an open one is added when asked for. */
+struct location_usage_app {
+	char app_id[LOCATION_USAGE_APP_ID_LEN];
+	bool used;
+	gint64 last_used;
+	guint active;
+	gint64 active_since;
+	gint64 session_time;
+	guint level_active[NUM_LEVELS];
+	gint64 level_since[NUM_LEVELS];
+	gint64 level_time[NUM_LEVELS];
+	guint64 fixes;
+	guint64 bytes;
+	guint64 one_shots;
+	guint budget;
+	gint64 period_start;
+	gint64 period_base;
+};
+
+/* The last entry is shared by the apps which don't fit */
+struct location_usage {
+	struct location_usage_app apps[LOCATION_USAGE_MAX_APPS + 1];
+};
+
+static const char *level_names[NUM_LEVELS] = {
+	[GCLUE_ACCURACY_LEVEL_COUNTRY] = "country",
+	[GCLUE_ACCURACY_LEVEL_CITY] = "city",
+	[GCLUE_ACCURACY_LEVEL_NEIGHBORHOOD] = "neighborhood",
+	[GCLUE_ACCURACY_LEVEL_STREET] = "street",
+	[GCLUE_ACCURACY_LEVEL_EXACT] = "exact",
+};
+
+struct location_usage *location_usage_new(void)
+{
+	struct location_usage *usage;
+
+	usage = g_new0(struct location_usage, 1);
+	usage->apps[LOCATION_USAGE_MAX_APPS].used = true;
+
+	return usage;
+}
+
+void location_usage_free(struct location_usage *usage)
+{
+	g_free(usage);
+}
+
+static bool app_evictable(const struct location_usage_app *app)
+{
+	return app->active == 0 && app->budget == 0;
+}
+
+struct location_usage_app *location_usage_lookup(struct location_usage *usage, const char *app_id)
+{
+	struct location_usage_app *app, *victim = NULL;
+	int n;
+
+	if (!app_id)
+		return &usage->apps[LOCATION_USAGE_MAX_APPS];
+
+	for (n = 0; n < LOCATION_USAGE_MAX_APPS; n++) {
+		app = &usage->apps[n];
+		if (!app->used) {
+			if (!victim || victim->used)
+				victim = app;
+			continue;
+		}
+		if (!strncmp(app->app_id, app_id, LOCATION_USAGE_APP_ID_LEN - 1))
+			return app;
+		if (app_evictable(app) && (!victim || (victim->used && app->last_used < victim->last_used)))
+			victim = app;
+	}
+
+	if (!victim)
+		return &usage->apps[LOCATION_USAGE_MAX_APPS];
+
+	memset(victim, 0, sizeof(*victim));
+	g_strlcpy(victim->app_id, app_id, sizeof(victim->app_id));
+	victim->used = true;
+	victim->last_used = g_get_monotonic_time();
+
+	return victim;
+}
+
+bool location_usage_session_since(struct location_usage *usage, const char *app_id, double *since)
+{
+	struct location_usage_app *app;
+	int n;
+
+	if (!app_id)
+		return false;
+
+	for (n = 0; n < LOCATION_USAGE_MAX_APPS; n++) {
+		app = &usage->apps[n];
+		if (!app->used || !app->active || strncmp(app->app_id, app_id, LOCATION_USAGE_APP_ID_LEN - 1))
+			continue;
+
+		*since = (g_get_real_time() - (g_get_monotonic_time() - app->active_since)) / (double) G_USEC_PER_SEC;
+		return true;
+	}
+
+	return false;
+}
+
+static guint level_index(GClueAccuracyLevel level)
+{
+	return CLAMP(level, 0, GCLUE_ACCURACY_LEVEL_EXACT);
+}
+
+void location_usage_start(struct location_usage_app *app, GClueAccuracyLevel level)
+{
+	gint64 now = g_get_monotonic_time();
+	guint index = level_index(level);
+
+	app->last_used = now;
+	if (app->active++ == 0)
+		app->active_since = now;
+	if (app->level_active[index]++ == 0)
+		app->level_since[index] = now;
+}
+
+void location_usage_stop(struct location_usage_app *app, GClueAccuracyLevel level)
+{
+	gint64 now = g_get_monotonic_time();
+	guint index = level_index(level);
+
+	app->last_used = now;
+	if (app->level_active[index] > 0 && --app->level_active[index] == 0)
+		app->level_time[index] += now - app->level_since[index];
+	if (app->active > 0 && --app->active == 0)
+		app->session_time += now - app->active_since;
+}
+
+void location_usage_delivered(struct location_usage_app *app, guint fixes, gsize bytes)
+{
+	app->fixes += fixes;
+	app->bytes += bytes;
+}
+
+void location_usage_one_shot(struct location_usage_app *app)
+{
+	app->one_shots++;
+	app->last_used = g_get_monotonic_time();
+}
+
+static gint64 session_time(const struct location_usage_app *app, gint64 now)
+{
+	return app->session_time + (app->active ? now - app->active_since : 0);
+}
+
+static gint64 level_time(const struct location_usage_app *app, guint index, gint64 now)
+{
+	return app->level_time[index] + (app->level_active[index] ? now - app->level_since[index] : 0);
+}
+
+/* Session time used within the current budget period */
+static gint64 budget_used(struct location_usage_app *app, gint64 now)
+{
+	if (now - app->period_start >= (gint64) LOCATION_USAGE_BUDGET_PERIOD * G_USEC_PER_SEC) {
+		app->period_start = now;
+		app->period_base = session_time(app, now);
+	}
+
+	return session_time(app, now) - app->period_base;
+}
+
+bool location_usage_set_budget(struct location_usage *usage, const char *app_id, guint seconds)
+{
+	struct location_usage_app *app;
+	gint64 now = g_get_monotonic_time();
+
+	app = location_usage_lookup(usage, app_id);
+	if (app == &usage->apps[LOCATION_USAGE_MAX_APPS])
+		return false;
+
+	if (!app->budget && seconds) {
+		app->period_start = now;
+		app->period_base = session_time(app, now);
+	}
+	app->budget = seconds;
+
+	return true;
+}
+
+bool location_usage_over_budget(struct location_usage_app *app)
+{
+	if (!app->budget)
+		return false;
+
+	return budget_used(app, g_get_monotonic_time()) >= (gint64) app->budget * G_USEC_PER_SEC;
+}
+
+gint64 location_usage_budget_left(struct location_usage_app *app)
+{
+	if (!app->budget)
+		return -1;
+
+	return MAX((gint64) app->budget * G_USEC_PER_SEC - budget_used(app, g_get_monotonic_time()), 0);
+}
+
+static jvalue_ref app_to_json(struct location_usage_app *app, const char *app_id, gint64 now)
+{
+	jvalue_ref app_obj, levels_obj;
+	guint n;
+
+	levels_obj = jobject_create();
+	for (n = 0; n < NUM_LEVELS; n++) {
+		if (level_names[n] && (app->level_time[n] || app->level_active[n]))
+			jobject_put(levels_obj, jstring_create(level_names[n]),
+			            jnumber_create_f64(level_time(app, n, now) / (double) G_USEC_PER_SEC));
+	}
+
+	app_obj = jobject_create();
+	jobject_put(app_obj, J_CSTR_TO_JVAL("appId"), jstring_create(app_id));
+	jobject_put(app_obj, J_CSTR_TO_JVAL("sessionTime"),
+	            jnumber_create_f64(session_time(app, now) / (double) G_USEC_PER_SEC));
+	jobject_put(app_obj, J_CSTR_TO_JVAL("levels"), levels_obj);
+	jobject_put(app_obj, J_CSTR_TO_JVAL("activeSessions"), jnumber_create_i32(app->active));
+	jobject_put(app_obj, J_CSTR_TO_JVAL("fixes"), jnumber_create_i64(app->fixes));
+	jobject_put(app_obj, J_CSTR_TO_JVAL("bytes"), jnumber_create_i64(app->bytes));
+	jobject_put(app_obj, J_CSTR_TO_JVAL("oneShots"), jnumber_create_i64(app->one_shots));
+	if (app->budget) {
+		jobject_put(app_obj, J_CSTR_TO_JVAL("budget"), jnumber_create_i32(app->budget));
+		jobject_put(app_obj, J_CSTR_TO_JVAL("budgetUsed"),
+		            jnumber_create_f64(budget_used(app, now) / (double) G_USEC_PER_SEC));
+	}
+
+	return app_obj;
+}
+
+void location_usage_to_reply(struct location_usage *usage, const char *app_id, jvalue_ref reply_obj)
+{
+	struct location_usage_app *app;
+	gint64 now = g_get_monotonic_time();
+	jvalue_ref apps_obj;
+	int n;
+
+	apps_obj = jarray_create(NULL);
+	for (n = 0; n < LOCATION_USAGE_MAX_APPS; n++) {
+		app = &usage->apps[n];
+		if (app->used && (!app_id || !strncmp(app->app_id, app_id, LOCATION_USAGE_APP_ID_LEN - 1)))
+			jarray_append(apps_obj, app_to_json(app, app->app_id, now));
+	}
+
+	app = &usage->apps[LOCATION_USAGE_MAX_APPS];
+	if (!app_id && app->last_used)
+		jarray_append(apps_obj, app_to_json(app, "other", now));
+
+	jobject_put(reply_obj, J_CSTR_TO_JVAL("apps"), apps_obj);
+	jobject_put(reply_obj, J_CSTR_TO_JVAL("budgetPeriod"), jnumber_create_i32(LOCATION_USAGE_BUDGET_PERIOD));
+}
+
+// vim:ts=4:sw=4:noexpandtab
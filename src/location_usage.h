@@ -0,0 +1,82 @@
+/* @@@LICENSE
+*
+* Copyright (c) 2026 LuneOS Project
+*
+* This file is part of location-service.
+*
+* location-service is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* location-service is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with location-service.  If not, see <http://www.gnu.org/licenses/>.
+*
+* LICENSE@@@ */
+
+
+
+#ifndef LOCATION_USAGE_H_
+#define LOCATION_USAGE_H_
+
+#include <stdbool.h>
+#include <glib.h>
+#include <pbnjson.h>
+
+#include "location_common.h"
+
+/* What every app costs in location work: how long it kept a GeoClue
+ * session open and at which accuracy, how many fixes and payload bytes it
+ * was sent and how many getCurrentPosition requests it made. Apps live in a
+ * table of fixed size, a request holds the entry of its app while it runs,
+ * so accounting a fix is a couple of additions. */
+
+#define LOCATION_USAGE_MAX_APPS		64
+/* App IDs are cut to this many bytes, including the terminator */
+#define LOCATION_USAGE_APP_ID_LEN	64
+/* Budgets limit the session time of an app within this many seconds */
+#define LOCATION_USAGE_BUDGET_PERIOD	86400
+
+struct location_usage;
+struct location_usage_app;
+
+struct location_usage *location_usage_new(void);
+void location_usage_free(struct location_usage *usage);
+
+/* Returns the entry of the app, taking the place of the least recently
+ * used app without a session or budget when the table is full. Apps which
+ * still don't fit share one entry, reported as "other". Only entries with
+ * a session are kept, so the result must not be held without one. */
+struct location_usage_app *location_usage_lookup(struct location_usage *usage, const char *app_id);
+
+/* The app holds a session at level from start until the matching stop.
+ * Session time counts once for an app however many sessions it holds. */
+void location_usage_start(struct location_usage_app *app, GClueAccuracyLevel level);
+void location_usage_stop(struct location_usage_app *app, GClueAccuracyLevel level);
+void location_usage_delivered(struct location_usage_app *app, guint fixes, gsize bytes);
+void location_usage_one_shot(struct location_usage_app *app);
+
+/* Limits the session time of the app per LOCATION_USAGE_BUDGET_PERIOD,
+ * 0 seconds removes the budget. Fails when the table has no room left. */
+bool location_usage_set_budget(struct location_usage *usage, const char *app_id, guint seconds);
+bool location_usage_over_budget(struct location_usage_app *app);
+/* Microseconds of session time left to the app in the current budget
+ * period, -1 when it has no budget */
+gint64 location_usage_budget_left(struct location_usage_app *app);
+
+/* Wall clock time in seconds since when the app holds a session without a
+ * break. False when it holds none or has no entry of its own, no entry is
+ * created. */
+bool location_usage_session_since(struct location_usage *usage, const char *app_id, double *since);
+
+/* Adds "apps", or only the given app, to the reply */
+void location_usage_to_reply(struct location_usage *usage, const char *app_id, jvalue_ref reply_obj);
+
+#endif
+
+// vim:ts=4:sw=4:noexpandtab
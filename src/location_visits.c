@@ -0,0 +1,137 @@
+/* @@@LICENSE
+*
+* Copyright (c) 2026 LuneOS Project
+*
+* This file is part of location-service.
+*
+* location-service is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* location-service is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with location-service.  If not, see <http://www.gnu.org/licenses/>.
+*
+* LICENSE@@@ */
+
+
+#include <math.h>
+#include <string.h>
+
+#include "location_visits.h"
+
+#define METERS_PER_DEGREE	111319.49
+
+void location_visit_detector_reset(struct location_visit_detector *detector)
+{
+	memset(detector, 0, sizeof(*detector));
+}
+
+static double distance_to(const struct location_visit *visit, const struct location_fix *fix)
+{
+	double north, east;
+
+	north = (fix->latitude - visit->latitude) * METERS_PER_DEGREE;
+	east = remainder(fix->longitude - visit->longitude, 360) * METERS_PER_DEGREE *
+	       cos(visit->latitude * M_PI / 180);
+
+	return sqrt(north * north + east * east);
+}
+
+static void begin_candidate(struct location_visit_detector *detector, const struct location_fix *fix)
+{
+	struct location_visit *visit = &detector->visit;
+
+	visit->latitude = fix->latitude;
+	visit->longitude = fix->longitude;
+	visit->radius = 0;
+	visit->arrival = fix->timestamp;
+	visit->departure = fix->timestamp;
+	detector->count = 1;
+	detector->in_visit = false;
+	detector->outside = 0;
+}
+
+/* Moves the running centroid towards the fix */
+static void join(struct location_visit_detector *detector, const struct location_fix *fix, double distance)
+{
+	struct location_visit *visit = &detector->visit;
+
+	detector->count++;
+	visit->latitude += (fix->latitude - visit->latitude) / detector->count;
+	visit->longitude += remainder(fix->longitude - visit->longitude, 360) / detector->count;
+	if (visit->longitude > 180)
+		visit->longitude -= 360;
+	else if (visit->longitude < -180)
+		visit->longitude += 360;
+	visit->radius = MAX(visit->radius, distance);
+	visit->departure = fix->timestamp;
+	detector->outside = 0;
+}
+
+/* Returns LOCATION_VISIT_START or LOCATION_VISIT_END when the fix starts or
+ * ends a visit and copies the visit to visit then. The fix which ends a
+ * visit is the first of the next candidate. */
+enum location_visit_event location_visit_detector_add(struct location_visit_detector *detector,
+                                                      const struct location_fix *fix, struct location_visit *visit)
+{
+	bool accurate = fix->horiz_accuracy > 0 && fix->horiz_accuracy <= LOCATION_VISIT_MAX_ACCURACY;
+	double distance;
+
+	if (detector->count == 0) {
+		if (accurate)
+			begin_candidate(detector, fix);
+		return LOCATION_VISIT_NONE;
+	}
+
+	distance = distance_to(&detector->visit, fix);
+
+	if (detector->in_visit) {
+		/* Coarse fixes, e.g. while the demand is lowered during the visit,
+		 * only end it when they can't be inside anymore */
+		if (distance - MAX(fix->horiz_accuracy, 0) <= LOCATION_VISIT_RADIUS) {
+			if (accurate)
+				join(detector, fix, distance);
+			else {
+				detector->visit.departure = fix->timestamp;
+				detector->outside = 0;
+			}
+			return LOCATION_VISIT_NONE;
+		}
+
+		if (++detector->outside < LOCATION_VISIT_EXIT_FIXES)
+			return LOCATION_VISIT_NONE;
+
+		*visit = detector->visit;
+		if (accurate)
+			begin_candidate(detector, fix);
+		else
+			location_visit_detector_reset(detector);
+		return LOCATION_VISIT_END;
+	}
+
+	if (!accurate)
+		return LOCATION_VISIT_NONE;
+
+	if (distance > LOCATION_VISIT_RADIUS) {
+		/* A single stray fix doesn't throw away the candidate */
+		if (++detector->outside >= LOCATION_VISIT_EXIT_FIXES)
+			begin_candidate(detector, fix);
+		return LOCATION_VISIT_NONE;
+	}
+
+	join(detector, fix, distance);
+	if (detector->visit.departure - detector->visit.arrival < LOCATION_VISIT_MIN_DURATION)
+		return LOCATION_VISIT_NONE;
+
+	detector->in_visit = true;
+	*visit = detector->visit;
+	return LOCATION_VISIT_START;
+}
+
+// vim:ts=4:sw=4:noexpandtab
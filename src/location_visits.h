@@ -0,0 +1,73 @@
+/* @@@LICENSE
+*
+* Copyright (c) 2026 LuneOS Project
+*
+* This file is part of location-service.
+*
+* location-service is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* location-service is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with location-service.  If not, see <http://www.gnu.org/licenses/>.
+*
+* LICENSE@@@ */
+
+
+#ifndef LOCATION_VISITS_H_
+#define LOCATION_VISITS_H_
+
+#include <stdbool.h>
+#include <glib.h>
+
+#include "location_common.h"
+
+/* Detects stays at one place in the fixes of the session. A visit starts
+ * once fixes stayed within LOCATION_VISIT_RADIUS of their centroid for
+ * LOCATION_VISIT_MIN_DURATION seconds and ends with the second fix in a
+ * row which is outside even allowing for its accuracy, that fix begins the
+ * next candidate. Only a running centroid is kept, every fix is O(1). */
+
+#define LOCATION_VISIT_RADIUS			100.0
+#define LOCATION_VISIT_MIN_DURATION		300
+/* Fixes less accurate than this in meters neither start nor grow a visit */
+#define LOCATION_VISIT_MAX_ACCURACY		150.0
+#define LOCATION_VISIT_EXIT_FIXES		2
+
+enum location_visit_event {
+	LOCATION_VISIT_NONE,
+	LOCATION_VISIT_START,
+	LOCATION_VISIT_END,
+};
+
+/* Timestamps are in seconds since the epoch, the radius in meters is the
+ * farthest any fix of the visit was from the centroid */
+struct location_visit {
+	double latitude;
+	double longitude;
+	double radius;
+	double arrival;
+	double departure;
+};
+
+struct location_visit_detector {
+	/* The visit, or the candidate for one while in_visit isn't set */
+	struct location_visit visit;
+	guint count;
+	bool in_visit;
+	guint outside;
+};
+
+void location_visit_detector_reset(struct location_visit_detector *detector);
+enum location_visit_event location_visit_detector_add(struct location_visit_detector *detector,
+                                                      const struct location_fix *fix, struct location_visit *visit);
+
+#endif
+
+// vim:ts=4:sw=4:noexpandtab
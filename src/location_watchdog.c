@@ -0,0 +1,234 @@
+/* @@@LICENSE
+*
+* Copyright (c) 2026 LuneOS Project
+*
+* This file is part of location-service.
+*
+* location-service is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* location-service is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with location-service.  If not, see <http://www.gnu.org/licenses/>.
+*
+* LICENSE@@@ */
+
+
+#include "location_watchdog.h"
+
+/* Upper bounds in milliseconds of the lag histogram buckets, the last
+ * bucket takes everything above */
+static const guint lag_buckets[] = { 10, 50, 100, 250, 500, 1000, 5000 };
+#define NUM_LAG_BUCKETS		(G_N_ELEMENTS(lag_buckets) + 1)
+
+struct location_watchdog {
+	GThread *thread;
+	GMutex mutex;
+	GCond cond;
+	bool quit;
+
+	/* Written by the main thread, read by the monitor. busy_since is 0
+	 * while the loop is idle. */
+	gint64 busy_since;
+	const char *activity;
+
+	/* Written by the monitor, read by the main thread: the monitor waits
+	 * for the next activity and has to be woken up */
+	bool monitor_idle;
+
+	/* Only used from the main thread */
+	guint64 histogram[NUM_LAG_BUCKETS];
+	guint64 dispatches;
+	guint stalls;
+	guint max_lag;
+};
+
+static void activity_done(struct location_watchdog *watchdog, gint64 since)
+{
+	guint lag, n;
+
+	lag = (g_get_monotonic_time() - since) / 1000;
+
+	for (n = 0; n < G_N_ELEMENTS(lag_buckets) && lag > lag_buckets[n]; n++)
+		;
+	watchdog->histogram[n]++;
+	watchdog->dispatches++;
+
+	if (lag > LOCATION_WATCHDOG_STALL_THRESHOLD)
+		watchdog->stalls++;
+	if (lag > watchdog->max_lag)
+		watchdog->max_lag = lag;
+}
+
+/* Reports every stall once while it is still going on, so the warning
+ * shows up even when the loop never recovers. While the loop is idle the
+ * thread sleeps until the next activity begins. */
+static gpointer monitor_thread(gpointer user_data)
+{
+	struct location_watchdog *watchdog = user_data;
+	gint64 reported = 0, since, now;
+	const char *activity;
+
+	g_mutex_lock(&watchdog->mutex);
+	while (!watchdog->quit) {
+		/* Announce the wait before looking, see location_watchdog_set_activity() */
+		__atomic_store_n(&watchdog->monitor_idle, true, __ATOMIC_SEQ_CST);
+		since = __atomic_load_n(&watchdog->busy_since, __ATOMIC_SEQ_CST);
+		if (!since) {
+			g_cond_wait(&watchdog->cond, &watchdog->mutex);
+			continue;
+		}
+		__atomic_store_n(&watchdog->monitor_idle, false, __ATOMIC_SEQ_CST);
+
+		now = g_get_monotonic_time();
+		if (since != reported && now - since >= LOCATION_WATCHDOG_STALL_THRESHOLD * 1000) {
+			reported = since;
+			activity = __atomic_load_n(&watchdog->activity, __ATOMIC_RELAXED);
+			g_warning("Main loop stalled for %" G_GINT64_FORMAT " ms in %s",
+			          (now - since) / 1000, activity ? activity : "an unknown source");
+		}
+
+		/* Check back when this activity would become a stall, or after
+		 * another threshold once it was reported */
+		if (since == reported)
+			g_cond_wait_until(&watchdog->cond, &watchdog->mutex,
+			                  now + LOCATION_WATCHDOG_STALL_THRESHOLD * 1000);
+		else
+			g_cond_wait_until(&watchdog->cond, &watchdog->mutex,
+			                  since + LOCATION_WATCHDOG_STALL_THRESHOLD * 1000);
+	}
+	g_mutex_unlock(&watchdog->mutex);
+
+	return NULL;
+}
+
+struct location_watchdog *location_watchdog_new(void)
+{
+	struct location_watchdog *watchdog;
+
+	watchdog = g_new0(struct location_watchdog, 1);
+	g_mutex_init(&watchdog->mutex);
+	g_cond_init(&watchdog->cond);
+	watchdog->thread = g_thread_new("watchdog", monitor_thread, watchdog);
+
+	return watchdog;
+}
+
+void location_watchdog_free(struct location_watchdog *watchdog)
+{
+	if (!watchdog)
+		return;
+
+	g_mutex_lock(&watchdog->mutex);
+	watchdog->quit = true;
+	g_cond_signal(&watchdog->cond);
+	g_mutex_unlock(&watchdog->mutex);
+	g_thread_join(watchdog->thread);
+
+	g_cond_clear(&watchdog->cond);
+	g_mutex_clear(&watchdog->mutex);
+	g_free(watchdog);
+}
+
+const char *location_watchdog_set_activity(struct location_watchdog *watchdog, const char *name)
+{
+	const char *previous;
+	gint64 since;
+
+	if (!watchdog)
+		return NULL;
+
+	previous = watchdog->activity;
+	__atomic_store_n(&watchdog->activity, name, __ATOMIC_RELAXED);
+
+	if (!previous && name) {
+		/* The monitor announces its wait before it looks at busy_since,
+		 * so either it sees the activity or it gets woken up */
+		__atomic_store_n(&watchdog->busy_since, g_get_monotonic_time(), __ATOMIC_SEQ_CST);
+		if (__atomic_load_n(&watchdog->monitor_idle, __ATOMIC_SEQ_CST)) {
+			g_mutex_lock(&watchdog->mutex);
+			g_cond_signal(&watchdog->cond);
+			g_mutex_unlock(&watchdog->mutex);
+		}
+	}
+	else if (previous && !name) {
+		since = watchdog->busy_since;
+		__atomic_store_n(&watchdog->busy_since, 0, __ATOMIC_SEQ_CST);
+		activity_done(watchdog, since);
+	}
+
+	return previous;
+}
+
+/* The loop of g_main_loop_run() spelled out, so the dispatch phase can be
+ * timed. Sources which name their activity, like method calls, only
+ * rename the dispatch they run in. */
+void location_watchdog_run(struct location_watchdog *watchdog, GMainLoop *loop)
+{
+	GMainContext *context = g_main_loop_get_context(loop);
+	GPollFunc poll_func;
+	GPollFD *fds = NULL;
+	gint allocated = 0;
+	gint max_priority, timeout, nfds;
+	const char *previous;
+
+	if (!g_main_context_acquire(context)) {
+		g_warning("Main loop context is owned by another thread, not watching it");
+		g_main_loop_run(loop);
+		return;
+	}
+
+	poll_func = g_main_context_get_poll_func(context);
+	while (g_main_loop_is_running(loop)) {
+		g_main_context_prepare(context, &max_priority);
+		while ((nfds = g_main_context_query(context, max_priority, &timeout, fds, allocated)) > allocated) {
+			g_free(fds);
+			fds = g_new(GPollFD, nfds);
+			allocated = nfds;
+		}
+
+		poll_func(fds, nfds, timeout);
+
+		if (g_main_context_check(context, max_priority, fds, nfds)) {
+			previous = location_watchdog_set_activity(watchdog, "a main loop source");
+			g_main_context_dispatch(context);
+			location_watchdog_set_activity(watchdog, previous);
+		}
+	}
+
+	g_free(fds);
+	g_main_context_release(context);
+}
+
+void location_watchdog_to_reply(struct location_watchdog *watchdog, jvalue_ref reply_obj)
+{
+	jvalue_ref watchdog_obj, histogram_obj, bucket_obj;
+	guint n;
+
+	watchdog_obj = jobject_create();
+	jobject_put(watchdog_obj, J_CSTR_TO_JVAL("stallThreshold"),
+	            jnumber_create_i32(LOCATION_WATCHDOG_STALL_THRESHOLD));
+	jobject_put(watchdog_obj, J_CSTR_TO_JVAL("dispatches"), jnumber_create_i64(watchdog->dispatches));
+	jobject_put(watchdog_obj, J_CSTR_TO_JVAL("stalls"), jnumber_create_i32(watchdog->stalls));
+	jobject_put(watchdog_obj, J_CSTR_TO_JVAL("maxLag"), jnumber_create_i32(watchdog->max_lag));
+
+	histogram_obj = jarray_create(NULL);
+	for (n = 0; n < NUM_LAG_BUCKETS; n++) {
+		bucket_obj = jobject_create();
+		if (n < G_N_ELEMENTS(lag_buckets))
+			jobject_put(bucket_obj, J_CSTR_TO_JVAL("upTo"), jnumber_create_i32(lag_buckets[n]));
+		jobject_put(bucket_obj, J_CSTR_TO_JVAL("count"), jnumber_create_i64(watchdog->histogram[n]));
+		jarray_append(histogram_obj, bucket_obj);
+	}
+	jobject_put(watchdog_obj, J_CSTR_TO_JVAL("lagHistogram"), histogram_obj);
+
+	jobject_put(reply_obj, J_CSTR_TO_JVAL("watchdog"), watchdog_obj);
+}
+
+// vim:ts=4:sw=4:noexpandtab
@@ -0,0 +1,59 @@
+/* @@@LICENSE
+*
+* Copyright (c) 2026 LuneOS Project
+*
+* This file is part of location-service.
+*
+* location-service is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* location-service is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with location-service.  If not, see <http://www.gnu.org/licenses/>.
+*
+* LICENSE@@@ */
+
+
+#ifndef LOCATION_WATCHDOG_H_
+#define LOCATION_WATCHDOG_H_
+
+#include <stdbool.h>
+#include <glib.h>
+#include <pbnjson.h>
+
+/* Watches the default main loop for stalls. The loop runs through
+ * location_watchdog_run(), which times every dispatch of its sources from
+ * start to end, whatever they are: method calls, timers, child and io
+ * watches or bus name watches. A monitor thread logs a warning with the
+ * current activity as soon as one takes longer than
+ * LOCATION_WATCHDOG_STALL_THRESHOLD milliseconds. Nothing runs
+ * periodically, the monitor thread sleeps while the loop is idle. */
+
+#define LOCATION_WATCHDOG_STALL_THRESHOLD		500
+
+struct location_watchdog;
+
+struct location_watchdog *location_watchdog_new(void);
+void location_watchdog_free(struct location_watchdog *watchdog);
+
+/* Runs loop like g_main_loop_run() until g_main_loop_quit(), loop has to
+ * be created running */
+void location_watchdog_run(struct location_watchdog *watchdog, GMainLoop *loop);
+
+/* Names what the main loop is busy with, name has to be a static string.
+ * Returns the previous activity, which has to be restored once name is
+ * done, so nested activities don't end the outer one. NULL when it returns
+ * to the loop. */
+const char *location_watchdog_set_activity(struct location_watchdog *watchdog, const char *name);
+
+void location_watchdog_to_reply(struct location_watchdog *watchdog, jvalue_ref reply_obj);
+
+#endif
+
+// vim:ts=4:sw=4:noexpandtab
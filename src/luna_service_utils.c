@@ -122,6 +122,76 @@ char* luna_service_message_get_string(jvalue_ref parsed_obj, const char *name, c
 	return g_strdup(string_buf.m_str);
 }
 
+/* Identifies the caller of a message by its application id, falling back to
+ * the service name or the unique bus name for callers which aren't apps.
+ * The application id may carry a process suffix separated by a space. */
+char* luna_service_message_get_caller_id(LSMessage *message)
+{
+	const char *caller;
+
+	caller = LSMessageGetApplicationID(message);
+	if (!caller || caller[0] == '\0')
+		caller = LSMessageGetSenderServiceName(message);
+	if (!caller || caller[0] == '\0')
+		caller = LSMessageGetSender(message);
+	if (!caller)
+		return NULL;
+
+	return g_strndup(caller, strcspn(caller, " "));
+}
+
+/* System apps allowed to act for other apps, e.g. answer the location
+ * prompt on their behalf */
+static const char *privileged_apps[] = {
+	"com.palm.systemui",
+	"com.palm.app.settings",
+	"com.palm.app.location",
+	"org.webosports.app.settings",
+	"com.webos.app.settings",
+	NULL
+};
+
+/* Names system services are registered under, handed out by their role
+ * files only */
+static const char *privileged_service_prefixes[] = {
+	"com.palm.",
+	"com.webos.",
+	"org.webosports.",
+	NULL
+};
+
+/* Whether the caller is part of the system rather than an ordinary app.
+ * Apps are identified by their application id, which the hub sets, and
+ * must be one of the system apps. Callers without one are services and
+ * must hold a system service name. */
+bool luna_service_message_is_privileged(LSMessage *message)
+{
+	const char *caller;
+	size_t len;
+	int n;
+
+	caller = LSMessageGetApplicationID(message);
+	if (caller && caller[0] != '\0') {
+		len = strcspn(caller, " ");
+		for (n = 0; privileged_apps[n]; n++) {
+			if (strlen(privileged_apps[n]) == len && !strncmp(caller, privileged_apps[n], len))
+				return true;
+		}
+		return false;
+	}
+
+	caller = LSMessageGetSenderServiceName(message);
+	if (!caller)
+		return false;
+
+	for (n = 0; privileged_service_prefixes[n]; n++) {
+		if (g_str_has_prefix(caller, privileged_service_prefixes[n]))
+			return true;
+	}
+
+	return false;
+}
+
 bool luna_service_message_validate_and_send(LSHandle *handle, LSMessage *message, jvalue_ref reply_obj)
 {
 	jschema_ref response_schema = NULL;
@@ -187,4 +257,60 @@ cleanup:
 		jschema_release(&response_schema);
 }
 
+/* Sends payload to a single subscriber. Failures aren't logged, the caller
+ * decides whether they matter. */
+bool luna_service_message_respond(LSMessage *message, const char *payload)
+{
+	LSError lserror;
+
+	LSErrorInit(&lserror);
+
+	if (!LSMessageRespond(message, payload, &lserror)) {
+		LSErrorFree(&lserror);
+		return false;
+	}
+
+	return true;
+}
+
+bool luna_service_subscription_add(LSHandle *handle, const char *key, LSMessage *message)
+{
+	LSError lserror;
+
+	LSErrorInit(&lserror);
+
+	if (!LSSubscriptionAdd(handle, key, message, &lserror)) {
+		LSErrorPrint(&lserror, stderr);
+		LSErrorFree(&lserror);
+		return false;
+	}
+
+	return true;
+}
+
+/* Removes message from the subscriptions under key, nothing happens when the
+ * subscription is already gone */
+void luna_service_subscription_remove(LSHandle *handle, const char *key, LSMessage *message)
+{
+	LSSubscriptionIter *iter = NULL;
+	LSError lserror;
+
+	LSErrorInit(&lserror);
+
+	if (!LSSubscriptionAcquire(handle, key, &iter, &lserror)) {
+		LSErrorPrint(&lserror, stderr);
+		LSErrorFree(&lserror);
+		return;
+	}
+
+	while (LSSubscriptionHasNext(iter)) {
+		if (LSSubscriptionNext(iter) == message) {
+			LSSubscriptionRemove(iter);
+			break;
+		}
+	}
+
+	LSSubscriptionRelease(iter);
+}
+
 // vim:ts=4:sw=4:noexpandtab
@@ -34,8 +34,13 @@ jvalue_ref luna_service_message_parse_and_validate(const char *payload);
 bool luna_service_message_validate_and_send(LSHandle *handle, LSMessage *message, jvalue_ref reply_obj);
 bool luna_service_check_for_subscription_and_process(LSHandle *handle, LSMessage *message);
 void luna_service_post_subscription(LSHandle *handle, const char *path, const char *method, jvalue_ref reply_obj);
+bool luna_service_message_respond(LSMessage *message, const char *payload);
+bool luna_service_subscription_add(LSHandle *handle, const char *key, LSMessage *message);
+void luna_service_subscription_remove(LSHandle *handle, const char *key, LSMessage *message);
 bool luna_service_message_get_boolean(jvalue_ref parsed_obj, const char *name, bool default_value);
 char* luna_service_message_get_string(jvalue_ref parsed_obj, const char *name, const char *default_value);
+char* luna_service_message_get_caller_id(LSMessage *message);
+bool luna_service_message_is_privileged(LSMessage *message);
 
 #endif
 
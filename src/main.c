@@ -22,15 +22,39 @@
 
 #include <luna-service2/lunaservice.h>
 #include <glib.h>
+#include <glib-unix.h>
+#include <signal.h>
 #include <stdlib.h>
 
 #include "location_service.h"
+#include "location_cache.h"
+#include "location_prefs.h"
+#include "location_permissions.h"
+#include "location_trace.h"
+#include "location_nmea.h"
+#include "location_shm.h"
+#include "location_geoclue.h"
+#include "location_admission.h"
+#include "location_ranking.h"
+#include "location_timezone.h"
+#include "location_watchdog.h"
+#include "location_radio.h"
+#include "location_history.h"
+#include "location_usage.h"
 
 #define VERSION						"0.1"
 
 GMainLoop *event_loop;
 static gboolean option_version = FALSE;
 static gboolean option_debug = FALSE;
+static gchar *option_record = NULL;
+static gchar *option_replay = NULL;
+static gboolean option_replay_fast = FALSE;
+static gchar *option_nmea = NULL;
+static gboolean option_shm = FALSE;
+static gchar *option_timezones = LOCATION_TIMEZONE_INDEX;
+static gchar *option_radio_map = LOCATION_RADIO_DB;
+static gchar *option_radio_scans = NULL;
 
 static GOptionEntry options[] = {
 	{ "version", 'v', 0, G_OPTION_ARG_NONE, &option_version,
@@ -38,6 +62,22 @@ static GOptionEntry options[] = {
 	{ "debug", 'd', G_OPTION_FLAG_REVERSE,
 				G_OPTION_ARG_NONE, &option_debug,
 				"Output debug information" },
+	{ "record", 'r', 0, G_OPTION_ARG_FILENAME, &option_record,
+				"Append every received fix to a trace file", "FILE" },
+	{ "replay", 'p', 0, G_OPTION_ARG_FILENAME, &option_replay,
+				"Use fixes from a trace file instead of GeoClue", "FILE" },
+	{ "replay-fast", 'f', 0, G_OPTION_ARG_NONE, &option_replay_fast,
+				"Replay the trace as fast as possible" },
+	{ "nmea", 'n', 0, G_OPTION_ARG_FILENAME, &option_nmea,
+				"Read NMEA sentences from a device instead of using GeoClue", "DEVICE" },
+	{ "shared-memory", 's', 0, G_OPTION_ARG_NONE, &option_shm,
+				"Publish fixes in a shared memory ring for local readers" },
+	{ "timezones", 't', 0, G_OPTION_ARG_FILENAME, &option_timezones,
+				"Time zone index used by getTimeZone", "FILE" },
+	{ "radio-map", 'm', 0, G_OPTION_ARG_FILENAME, &option_radio_map,
+				"Radio map used to locate Wi-Fi and cell scans", "FILE" },
+	{ "radio-scans", 'w', 0, G_OPTION_ARG_FILENAME, &option_radio_scans,
+				"Locate Wi-Fi and cell scans read from a file, FIFO or socket", "SOURCE" },
 	{ NULL },
 };
 
@@ -47,6 +87,13 @@ static void log_handler(const gchar *log_domain, GLogLevelFlags log_level,
 	g_print("%s\n", message);
 }
 
+static gboolean quit_signal_cb(gpointer user_data)
+{
+	g_main_loop_quit(event_loop);
+
+	return FALSE;
+}
+
 int main(int argc, char **argv)
 {
 	GOptionContext *context;
@@ -78,11 +125,42 @@ int main(int argc, char **argv)
 		exit(0);
 	}
 
-	event_loop = g_main_loop_new(NULL, FALSE);
+	/* Created running, location_watchdog_run() runs it until it is quit */
+	event_loop = g_main_loop_new(NULL, TRUE);
+
+	/* Leave the main loop on termination so pending state gets written */
+	g_unix_signal_add(SIGTERM, quit_signal_cb, NULL);
+	g_unix_signal_add(SIGINT, quit_signal_cb, NULL);
 
 	service = g_try_new0(struct location_service, 1);
 	if (!service)
 		goto exit;
+	service->watchdog = location_watchdog_new();
+	/* Replayed fixes must not become the last known position */
+	service->cache = location_cache_new(!option_replay);
+	service->prefs = location_prefs_new(location_service_prefs_changed, service);
+	service->permissions = location_permissions_new();
+	service->admission = location_admission_new();
+	service->ranking = location_ranking_new();
+	service->timezones = location_timezone_new(option_timezones);
+	service->history = location_history_new();
+	service->usage = location_usage_new();
+	service->one_shots = g_hash_table_new(g_str_hash, g_str_equal);
+	if (option_record)
+		service->trace_writer = location_trace_writer_new(option_record);
+	if (option_shm)
+		service->shm = location_shm_new();
+	if (option_radio_scans) {
+		service->radio = location_radio_new(option_radio_map);
+		if (service->radio)
+			location_radio_watch(service->radio, option_radio_scans, location_service_radio_fix, service);
+	}
+	if (option_replay)
+		service->provider = location_trace_replay_new(option_replay, option_replay_fast);
+	else if (option_nmea)
+		service->provider = location_nmea_provider_new(option_nmea);
+	else
+		service->provider = location_geoclue_provider_new();
 	if (!location_service_register(service, &service->handle_ports1, "org.webosports.location"))
 		goto exit;
 	if (!location_service_register(service, &service->handle_ports2, "org.webosports.service.location"))
@@ -96,16 +174,33 @@ int main(int argc, char **argv)
 	if (!location_service_register(service, &service->handle_webos2, "com.webos.service.location"))
 		goto exit;
 
-	g_main_loop_run(event_loop);
+	location_watchdog_run(service->watchdog, event_loop);
 
 exit:
 	if (service) {
+		/* Queued requests still hold subscriptions on the handles */
+		location_admission_free(service->admission, location_service_one_shot_free);
+		location_service_free_subscribers(service);
 		location_service_unregister(service->handle_ports1);
 		location_service_unregister(service->handle_ports2);
 		location_service_unregister(service->handle_palm1);
 		location_service_unregister(service->handle_palm2);
 		location_service_unregister(service->handle_webos1);
 		location_service_unregister(service->handle_webos2);
+		location_cache_free(service->cache);
+		location_prefs_free(service->prefs);
+		location_permissions_free(service->permissions);
+		location_ranking_free(service->ranking);
+		location_timezone_free(service->timezones);
+		location_watchdog_free(service->watchdog);
+		location_radio_free(service->radio);
+		location_history_free(service->history);
+		location_usage_free(service->usage);
+		g_hash_table_destroy(service->one_shots);
+		location_trace_writer_free(service->trace_writer);
+		location_shm_free(service->shm);
+		if (service->provider && service->provider->free)
+			service->provider->free(service->provider);
 		g_free(service);
 	}
 